@@ -45,6 +45,99 @@ struct lbt_ccc_element {
 /* The next (possible) handle after a characterstic (UUID and value) */
 #define LBT_NEXT_HANDLE_AFTER_CHAR(x) ((x) + 2)
 
+/* Attribute indices of a GATT table resolved at compile time.
+ * List the attributes in an enum in the same order as the table.
+ * The name of a characteristic is the index of its value attribute.
+ * The table places each attribute at the index of its name, so a
+ * characteristic can't end up at the index of another one.
+ *
+ * enum foo_attr {
+ *	LBT_GATT_ATTR_PRIMARY_SERVICE(FOO_ATTR_SVC),
+ *	LBT_GATT_ATTR_CHRC(FOO_ATTR_BAR),
+ *	LBT_GATT_ATTR_CCC(FOO_ATTR_BAR),
+ *	FOO_ATTR_COUNT
+ * };
+ *
+ * static struct bt_gatt_attr foo_attrs[] = {
+ *	LBT_GATT_PRIMARY_SERVICE(FOO_ATTR_SVC, &FOO_UUID),
+ *	LBT_GATT_CHARACTERISTIC(FOO_ATTR_BAR, &BAR_UUID.uuid, ...),
+ *	LBT_GATT_CHARACTERISTIC_CCC(FOO_ATTR_BAR, bar),
+ * };
+ * LBT_GATT_BUILD_ASSERT_ATTR_COUNT(foo_attrs, FOO_ATTR_COUNT);
+ */
+#define LBT_GATT_ATTR_PRIMARY_SERVICE(name) name
+#define LBT_GATT_ATTR_CHRC(name) name##_DECLARATION, name
+#define LBT_GATT_ATTR_CCC(name) name##_CCC
+
+#define LBT_GATT_PRIMARY_SERVICE(name, _service)                               \
+	[name] = BT_GATT_PRIMARY_SERVICE(_service)
+
+/* The value attribute follows the declaration attribute */
+#define LBT_GATT_CHARACTERISTIC(name, _uuid, _props, _perm, _read, _write,     \
+				_value)                                        \
+	[name##_DECLARATION] = BT_GATT_CHARACTERISTIC(_uuid, _props, _perm,    \
+						       _read, _write, _value)
+
+#define LBT_GATT_CHARACTERISTIC_CCC(name, ccc_name)                            \
+	[name##_CCC] = LBT_GATT_CCC(ccc_name)
+
+/* Table and enum must have the same number of attributes */
+#define LBT_GATT_BUILD_ASSERT_ATTR_COUNT(attrs, count)                         \
+	BUILD_ASSERT(ARRAY_SIZE(attrs) == (count),                             \
+		     #attrs " doesn't match attribute enum")
+
+/* A snapshot characteristic returns all of the fields of a service in one
+ * (long) read. The value is a version byte followed by tag, length, value
+ * entries. The tag is the lower byte of the 16-bit portion of the UUID of the
+ * characteristic that the field also belongs to. Integers are little endian.
+ */
+#define LBT_SNAPSHOT_VERSION 1
+
+enum lbt_snapshot_type {
+	/* Integer of 1, 2, 4 or 8 bytes */
+	LBT_SNAPSHOT_TYPE_INTEGER = 0,
+	/* Length is the string length (without terminator) */
+	LBT_SNAPSHOT_TYPE_STRING,
+};
+
+struct lbt_snapshot_field {
+	uint8_t tag;
+	uint8_t type;
+	uint16_t size;
+	const void *data;
+};
+
+#define LBT_SNAPSHOT_FIELD(_tag, _var)                                         \
+	{                                                                      \
+		.tag = (_tag), .type = LBT_SNAPSHOT_TYPE_INTEGER,              \
+		.size = sizeof(_var), .data = &(_var)                          \
+	}
+
+#define LBT_SNAPSHOT_STRING(_tag, _str)                                        \
+	{                                                                      \
+		.tag = (_tag), .type = LBT_SNAPSHOT_TYPE_STRING,               \
+		.size = sizeof(_str), .data = (_str)                           \
+	}
+
+/* Attribute values can't be longer than this (long read limit) */
+#define LBT_ATT_MAX_ATTRIBUTE_LEN 512
+
+/* Upper bound of the snapshot of all of the fields of a struct */
+#define LBT_SNAPSHOT_BUFFER_SIZE(data_size, fields)                            \
+	(1 + (2 * ARRAY_SIZE(fields)) + (data_size))
+
+/* The snapshot is built when a read at offset 0 occurs.
+ * Blob reads at other offsets return the same snapshot. With multiple
+ * connections, a long read may see a snapshot that was built for a newer read.
+ */
+struct lbt_snapshot {
+	const struct lbt_snapshot_field *fields;
+	size_t count;
+	uint8_t *buffer;
+	uint16_t size;
+	uint16_t length;
+};
+
 #define BT_SUCCESS 0
 
 /** ATT_MTU - OpCode (1 byte) - Handle (2 bytes) */
@@ -118,9 +211,18 @@ ssize_t lbt_write_u16(struct bt_conn *conn, const struct bt_gatt_attr *attr,
 		      const void *buf, uint16_t len, uint16_t offset,
 		      uint8_t flags);
 
+/**
+ * @brief Read callback for a snapshot characteristic.
+ * The user data of the characteristic must be a struct lbt_snapshot.
+ */
+ssize_t lbt_read_snapshot(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			  void *buf, uint16_t len, uint16_t offset);
+
 /**
  * @brief Helper function for finding a characteristic handle in the GATT
  * table.
+ *
+ * @note Prefer LBT_GATT_ATTR_CHRC indices that are resolved at compile time.
  */
 uint16_t lbt_find_gatt_index(struct bt_uuid *uuid, struct bt_gatt_attr *gatt,
 			     size_t size);
@@ -0,0 +1,72 @@
+/**
+ * @file lcz_bt_notify.h
+ * @brief Coalesced GATT notifications for multiple connections.
+ *
+ * Each characteristic has a slot that holds its latest value. Updates within
+ * the coalescing interval overwrite the slot and only the latest value is
+ * sent. Values are sent to every connection that has subscribed to the
+ * characteristic.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LCZ_BT_NOTIFY_H__
+#define __LCZ_BT_NOTIFY_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/types.h>
+#include <bluetooth/gatt.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+struct lcz_bt_notify_stats {
+	/* Values passed to lcz_bt_notify */
+	uint32_t updates;
+	/* Updates that replaced a value that hadn't been sent */
+	uint32_t coalesced;
+	/* Notifications sent (one per connection) */
+	uint32_t sent;
+	/* Notifications that couldn't be queued by the stack */
+	uint32_t errors;
+};
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+/**
+ * @brief Queue the latest value of a characteristic.
+ * The value is copied. If the value is too large, or there isn't a free slot,
+ * then it is notified immediately and a pending value of the characteristic
+ * is discarded.
+ *
+ * @param attr characteristic value attribute
+ * @param data value
+ * @param len of value
+ *
+ * @return int negative error code, 0 on success
+ */
+int lcz_bt_notify(const struct bt_gatt_attr *attr, const void *data, uint16_t len);
+
+/**
+ * @brief Send pending values without waiting for the end of the interval.
+ */
+void lcz_bt_notify_flush(void);
+
+/**
+ * @brief Get statistics
+ */
+void lcz_bt_notify_get_stats(struct lcz_bt_notify_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_BT_NOTIFY_H__ */
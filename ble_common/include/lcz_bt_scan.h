@@ -23,6 +23,28 @@
 extern "C" {
 #endif
 
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/**
+ * @brief Extended scan report callback.
+ * Provides PHY, SID, and advertising properties in addition to the
+ * address and RSSI of the legacy callback.
+ */
+typedef void lcz_bt_scan_ext_cb_t(const struct bt_le_scan_recv_info *info,
+				  struct net_buf_simple *ad);
+
+struct lcz_bt_scan_user_stats {
+	/* Advertisements passed to the user's callback */
+	uint32_t adverts;
+	/* Advertisements skipped because the user was being unregistered */
+	uint32_t drops;
+	/* Total time spent in the user's callback */
+	uint32_t callback_time_us;
+	/* Longest single callback */
+	uint32_t max_callback_time_us;
+};
+
 /******************************************************************************/
 /* Global Function Prototypes                                                 */
 /******************************************************************************/
@@ -38,13 +60,45 @@ bool lcz_bt_scan_set_parameters(const struct bt_le_scan_param *param);
 /**
  * @brief Register user of scan module.
  *
- * @param pId user id
+ * @note The callback is run from the Bluetooth RX thread without a lock.
+ * Each user receives the advertisement buffer at its original offset.
+ *
+ * @param pId user id (-1 if registration failed)
  * @param cb Register advertisement handler callback
  *
  * @retval true if new user was registered, false otherwise.
  */
 bool lcz_bt_scan_register(int *pId, bt_le_scan_cb_t *cb);
 
+#if defined(CONFIG_BT_EXT_ADV)
+/**
+ * @brief Register user of scan module that receives extended reports.
+ * Legacy and extended (including coded PHY) advertisements are delivered
+ * with their report information. Coded PHY scanning must be enabled with
+ * BT_LE_SCAN_OPT_CODED in the scan parameters.
+ *
+ * @param pId user id (-1 if registration failed)
+ * @param cb Register extended advertisement handler callback
+ *
+ * @retval true if new user was registered, false otherwise.
+ */
+bool lcz_bt_scan_register_ext(int *pId, lcz_bt_scan_ext_cb_t *cb);
+#endif
+
+/**
+ * @brief Unregister user of scan module.
+ * Any start or stop requests of the user are cleared. Scanning is stopped
+ * if no users are requesting it.
+ *
+ * @note When called from a thread other than the Bluetooth RX thread,
+ * this blocks until an in-progress callback for this user completes.
+ *
+ * @param id user id
+ *
+ * @return int negative error code, 0 on success
+ */
+int lcz_bt_scan_unregister(int id);
+
 /**
  * @brief Start scanning (if there aren't any stop requests).
  *
@@ -105,6 +159,27 @@ uint32_t lcz_bt_scan_get_num_starts(void);
  */
 uint32_t lcz_bt_scan_get_num_stops(void);
 
+/**
+ * @brief Get statistics for a user.
+ * Statistics are cleared when a user registers and remain readable after
+ * the user unregisters (until the id is reused).
+ *
+ * @param id user id
+ * @param stats copy of the statistics
+ *
+ * @return int negative error code, 0 on success
+ */
+int lcz_bt_scan_get_user_stats(int id, struct lcz_bt_scan_user_stats *stats);
+
+/**
+ * @brief Clear statistics for a user.
+ *
+ * @param id user id
+ *
+ * @return int negative error code, 0 on success
+ */
+int lcz_bt_scan_reset_user_stats(int id);
+
 /**
  * @brief Stop scanning, update parameters, restart scanning
  *
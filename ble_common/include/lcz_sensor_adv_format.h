@@ -262,6 +262,30 @@ enum LczSensorModelId {
 	LCZ_SENSOR_MODEL_ID_IG60 = 0x50
 };
 
+/* Flags, manufacturer specific data (event + response), and name */
+#define LCZ_SENSOR_ADV_EXT_BT_DATA_COUNT 3
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+/**
+ * @brief Build the data of an extended advertisement (1M or coded PHY).
+ * The event and response are sent in one PDU so a scanner doesn't need a
+ * scan request. The elements reference flags, msd, and name; they must
+ * remain valid until the advertising data is set.
+ *
+ * @param ad array for use with bt_le_ext_adv_set_data
+ * @param count number of elements in ad
+ * @param flags advertising flags, NULL to omit
+ * @param msd manufacturer specific data (company and protocol id filled in)
+ * @param name complete name, shortened if it doesn't fit, NULL to omit
+ *
+ * @return int number of elements used, negative error code otherwise
+ */
+int lcz_sensor_adv_ext_build(struct bt_data *ad, size_t count,
+			     const uint8_t *flags, const LczSensorAdExt_t *msd,
+			     const char *name);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,11 +17,30 @@
 #include <bluetooth/bluetooth.h>
 
 #include "ad_find.h"
+#include "lcz_sensor_adv_format.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/******************************************************************************/
+/* Global Constants, Macros and Type Definitions                              */
+/******************************************************************************/
+/* Sensor fields found in a legacy, scan response, coded, or extended report.
+ * Pointers reference the report buffer (packed, unaligned).
+ */
+struct lcz_sensor_adv_info {
+	/* AD_PROTOCOL_ID of the advertisement or scan response */
+	uint16_t protocol_id;
+	/* Event data, NULL if not present */
+	const LczSensorAdEvent_t *event;
+	/* Product and version data, NULL if not present */
+	const LczSensorRsp_t *rsp;
+	/* Complete or shortened name (not NULL terminated), NULL if not present */
+	const char *name;
+	uint8_t name_len;
+};
+
 /******************************************************************************/
 /* Global Function Prototypes                                                 */
 /******************************************************************************/
@@ -63,6 +82,30 @@ uint16_t lcz_sensor_adv_match_rsp(AdHandle_t *handle);
  */
 uint16_t lcz_sensor_adv_match_coded(AdHandle_t *handle);
 
+/**
+ * @brief Match BT510 or BT6xx extended advertisement.
+ * Extended advertisements carry the coded PHY format (event and response
+ * in one PDU) on either PHY. Longer payloads from newer firmware are
+ * accepted; DM coded advertisements must match exactly.
+ *
+ * @param handle payload of manufacturer specific ad
+ * @return The protocol id if found, 0 otherwise.
+ */
+uint16_t lcz_sensor_adv_match_ext(AdHandle_t *handle);
+
+/**
+ * @brief Walk every AD structure of a report once and collect the sensor
+ * event, response, and name. An extended report can contain all of them.
+ *
+ * @param ad buffer from scan callback (legacy or extended, up to 255 bytes
+ * of AD structures are parsed)
+ * @param info pointers into ad for the fields that were found
+ * @return uint16_t RESERVED_AD_PROTOCOL_ID (0) if ad doesn't match,
+ * AD_PROTOCOL_ID otherwise.
+ */
+uint16_t lcz_sensor_adv_parse(struct net_buf_simple *ad,
+			      struct lcz_sensor_adv_info *info);
+
 #ifdef __cplusplus
 }
 #endif
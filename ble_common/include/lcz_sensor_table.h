@@ -0,0 +1,197 @@
+/**
+ * @file lcz_sensor_table.h
+ * @brief Fixed capacity table of Bluetooth sensors seen by a gateway.
+ *
+ * The table is keyed by Bluetooth address and uses open addressing with
+ * linear probing. Sensor fields are stored as separate arrays so that a probe
+ * only touches the hash slots and the addresses. Entries are kept on an LRU
+ * list; the least recently seen sensor is evicted when the table is full.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LCZ_SENSOR_TABLE_H__
+#define __LCZ_SENSOR_TABLE_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <bluetooth/bluetooth.h>
+
+#include "lcz_sensor_adv_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+/* Flags returned by update functions */
+#define LCZ_SENSOR_TABLE_NEW_SENSOR BIT(0)
+#define LCZ_SENSOR_TABLE_NEW_EVENT BIT(1)
+#define LCZ_SENSOR_TABLE_EVICTED BIT(2)
+
+#define LCZ_SENSOR_TABLE_TX_POWER_UNKNOWN INT8_MIN
+
+#define LCZ_SENSOR_TABLE_FW_VERSION(major, minor, patch)                                          \
+	((((uint32_t)(major)) << 16) | (((uint32_t)(minor)) << 8) | ((uint32_t)(patch)))
+
+struct lcz_sensor_table_entry {
+	bt_addr_t addr;
+	int8_t rssi;
+	uint16_t id;
+	uint32_t epoch;
+	/* INVALID_PRODUCT_ID until a scan response (or coded ad) is received */
+	uint16_t product_id;
+	/* LCZ_SENSOR_TABLE_FW_VERSION format */
+	uint32_t firmware_version;
+	/* k_uptime_get_32() of the last advertisement */
+	uint32_t last_seen;
+};
+
+/* Filtered RSSI of a sensor */
+struct lcz_sensor_table_rssi {
+	int8_t last;
+	/* Exponentially weighted moving average */
+	int8_t ewma;
+	/* Median of the last CONFIG_LCZ_SENSOR_TABLE_RSSI_WINDOW samples */
+	int8_t median;
+	/* Number of samples in median window */
+	uint8_t samples;
+	/* Transmit power advertised by sensor (LCZ_SENSOR_TABLE_TX_POWER_UNKNOWN if not known) */
+	int8_t tx_power;
+	/* Estimate from median RSSI and tx power (0 if tx power isn't known) */
+	uint32_t distance_cm;
+};
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+/**
+ * @brief Add or refresh a sensor using the event fields of an advertisement.
+ * The sensor becomes the most recently seen entry.
+ *
+ * @param addr address of sensor
+ * @param rssi of advertisement
+ * @param id event id of advertisement
+ * @param epoch event epoch of advertisement
+ *
+ * @return int negative error code, otherwise LCZ_SENSOR_TABLE_ flags.
+ * NEW_EVENT is set when id or epoch differs from the stored values.
+ */
+int lcz_sensor_table_update(const bt_addr_t *addr, int8_t rssi, uint16_t id, uint32_t epoch);
+
+/**
+ * @brief Add or refresh a sensor from a 1M or coded PHY sensor event advertisement.
+ *
+ * @param rssi of advertisement
+ * @param ad event portion of advertisement
+ *
+ * @return int see lcz_sensor_table_update
+ */
+int lcz_sensor_table_update_ad(int8_t rssi, const LczSensorAdEvent_t *ad);
+
+/**
+ * @brief Add or refresh a sensor from a contact tracing advertisement.
+ * The transmit power is saved for distance estimation.
+ *
+ * @param rssi of advertisement
+ * @param ad contact tracing advertisement
+ *
+ * @return int see lcz_sensor_table_update (id is always 0)
+ */
+int lcz_sensor_table_update_ct(int8_t rssi, const LczContactTracingAd_t *ad);
+
+/**
+ * @brief Set product and firmware version of a sensor from a scan response.
+ * The sensor must already be in the table.
+ *
+ * @param addr address of sensor
+ * @param rsp response (or second half of coded advertisement)
+ *
+ * @return int negative error code, 0 on success
+ */
+int lcz_sensor_table_update_rsp(const bt_addr_t *addr, const LczSensorRsp_t *rsp);
+
+/**
+ * @brief Find a sensor
+ *
+ * @param addr address of sensor
+ *
+ * @return int index of sensor, -ENOENT if not found.
+ * The index is valid until the sensor is removed or evicted.
+ */
+int lcz_sensor_table_find(const bt_addr_t *addr);
+
+/**
+ * @brief Copy entry of table
+ *
+ * @param index of sensor
+ * @param entry copy of sensor information
+ *
+ * @return int negative error code, 0 on success
+ */
+int lcz_sensor_table_get(int index, struct lcz_sensor_table_entry *entry);
+
+#if defined(CONFIG_LCZ_SENSOR_TABLE_RSSI_FILTER)
+/**
+ * @brief Get filtered RSSI and distance estimate of a sensor.
+ * Filters are updated with every advertisement so this is O(1).
+ *
+ * @param index of sensor
+ * @param stats filtered values
+ *
+ * @return int negative error code, 0 on success
+ */
+int lcz_sensor_table_get_rssi(int index, struct lcz_sensor_table_rssi *stats);
+#endif
+
+#if defined(CONFIG_LCZ_SENSOR_TABLE_ADV_HANDLER)
+/**
+ * @brief Update the table from a scan report.
+ * Sensor advertisements, scan responses, and contact tracing
+ * advertisements are recognized. This can be registered directly with
+ * lcz_bt_scan_register or called from an application's handler.
+ */
+void lcz_sensor_table_adv_handler(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+				  struct net_buf_simple *ad);
+#endif
+
+/**
+ * @brief Remove a sensor
+ *
+ * @param addr address of sensor
+ *
+ * @return int negative error code, 0 on success
+ */
+int lcz_sensor_table_remove(const bt_addr_t *addr);
+
+/**
+ * @brief Remove sensors that haven't been seen recently.
+ * Only entries that are removed (and the first one that isn't) are visited.
+ *
+ * @param max_age_ms maximum time since last advertisement
+ *
+ * @return size_t number of sensors removed
+ */
+size_t lcz_sensor_table_age(uint32_t max_age_ms);
+
+/**
+ * @retval number of sensors in table
+ */
+size_t lcz_sensor_table_count(void);
+
+/**
+ * @brief Remove all sensors
+ */
+void lcz_sensor_table_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_SENSOR_TABLE_H__ */
@@ -16,6 +16,7 @@ LOG_MODULE_REGISTER(lcz_bluetooth);
 /******************************************************************************/
 #include <bluetooth/gatt.h>
 #include <bluetooth/conn.h>
+#include <sys/byteorder.h>
 
 #include "laird_utility_macros.h"
 #include "lcz_bluetooth.h"
@@ -27,6 +28,14 @@ LOG_MODULE_REGISTER(lcz_bluetooth);
 
 #define PSCRS PREFIXED_SWITCH_CASE_RETURN_STRING
 
+#define SNAPSHOT_MAX_FIELD_LENGTH UINT8_MAX
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static void build_snapshot(struct lbt_snapshot *snapshot);
+static void put_le_integer(uint8_t *dst, const void *src, size_t size);
+
 /******************************************************************************/
 /* Global Function Definitions                                                */
 /******************************************************************************/
@@ -125,6 +134,19 @@ ssize_t lbt_write_u16(struct bt_conn *conn, const struct bt_gatt_attr *attr,
 	return len;
 }
 
+ssize_t lbt_read_snapshot(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			  void *buf, uint16_t len, uint16_t offset)
+{
+	struct lbt_snapshot *snapshot = attr->user_data;
+
+	if (offset == 0) {
+		build_snapshot(snapshot);
+	}
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, snapshot->buffer,
+				 snapshot->length);
+}
+
 uint16_t lbt_find_gatt_index(struct bt_uuid *uuid, struct bt_gatt_attr *gatt,
 			     size_t size)
 {
@@ -273,3 +295,62 @@ bool lbt_peripheral_role(struct bt_conn *conn)
 		return false;
 	}
 }
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static void build_snapshot(struct lbt_snapshot *snapshot)
+{
+	const struct lbt_snapshot_field *field;
+	uint16_t length = 0;
+	size_t n;
+	size_t i;
+
+	snapshot->buffer[length++] = LBT_SNAPSHOT_VERSION;
+
+	for (i = 0; i < snapshot->count; i++) {
+		field = &snapshot->fields[i];
+		if (field->type == LBT_SNAPSHOT_TYPE_STRING) {
+			n = strnlen(field->data, field->size);
+		} else {
+			n = field->size;
+		}
+		n = MIN(n, SNAPSHOT_MAX_FIELD_LENGTH);
+
+		if ((length + 2 + n) > snapshot->size) {
+			__ASSERT(false, "Snapshot buffer too small");
+			break;
+		}
+
+		snapshot->buffer[length++] = field->tag;
+		snapshot->buffer[length++] = (uint8_t)n;
+		if (field->type == LBT_SNAPSHOT_TYPE_INTEGER) {
+			put_le_integer(&snapshot->buffer[length], field->data,
+				       n);
+		} else {
+			memcpy(&snapshot->buffer[length], field->data, n);
+		}
+		length += n;
+	}
+
+	snapshot->length = length;
+}
+
+static void put_le_integer(uint8_t *dst, const void *src, size_t size)
+{
+	switch (size) {
+	case sizeof(uint16_t):
+		sys_put_le16(*(const uint16_t *)src, dst);
+		break;
+	case sizeof(uint32_t):
+		sys_put_le32(*(const uint32_t *)src, dst);
+		break;
+	case sizeof(uint64_t):
+		sys_put_le64(*(const uint64_t *)src, dst);
+		break;
+	default:
+		__ASSERT(size == sizeof(uint8_t), "Unsupported integer size");
+		memcpy(dst, src, size);
+		break;
+	}
+}
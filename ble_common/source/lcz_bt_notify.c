@@ -0,0 +1,283 @@
+/**
+ * @file lcz_bt_notify.c
+ * @brief Coalesced GATT notifications for multiple connections.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(lcz_bt_notify, CONFIG_LCZ_BT_NOTIFY_LOG_LEVEL);
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <kernel.h>
+#include <string.h>
+#include <bluetooth/conn.h>
+
+#include "lcz_bt_notify.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define MAX_SLOTS CONFIG_LCZ_BT_NOTIFY_MAX_SLOTS
+#define MAX_VALUE_SIZE CONFIG_LCZ_BT_NOTIFY_MAX_VALUE_SIZE
+
+/* Connections are identified by a bit (bt_conn_index) */
+#define ALL_CONNS UINT32_MAX
+BUILD_ASSERT(CONFIG_BT_MAX_CONN <= 32, "Too many connections for retry bitmap");
+
+/* Slots are assigned to a characteristic on first use and are never freed */
+struct slot {
+	const struct bt_gatt_attr *attr;
+	/* A new value is sent to all connections */
+	bool pending;
+	/* Connections that the stack didn't have room for the value for */
+	uint32_t retry_conns;
+	uint16_t len;
+	uint8_t value[MAX_VALUE_SIZE];
+};
+
+/* Snapshot of pending values; only accessed from the work handler */
+struct batch {
+	size_t count;
+	uint8_t slot[MAX_SLOTS];
+	uint32_t conns[MAX_SLOTS];
+	uint8_t value[MAX_SLOTS][MAX_VALUE_SIZE];
+	struct bt_gatt_notify_params params[MAX_SLOTS];
+	/* Subset of params subscribed to by a connection */
+	size_t subscribed_count;
+	uint8_t subscribed_slot[MAX_SLOTS];
+	struct bt_gatt_notify_params subscribed[MAX_SLOTS];
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static struct slot *find_slot(const struct bt_gatt_attr *attr, bool assign);
+static void notify_work_handler(struct k_work *work);
+static void notify_conn(struct bt_conn *conn, void *data);
+static void notify_result(uint8_t slot, uint32_t conn_bit, int r);
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static struct {
+	struct k_spinlock lock;
+	size_t slots_used;
+	struct slot slots[MAX_SLOTS];
+	bool retry;
+	struct lcz_bt_notify_stats stats;
+} ntf;
+
+static struct batch batch;
+
+/* Orders values that are sent immediately with values sent by the work handler */
+static K_MUTEX_DEFINE(send_mutex);
+
+static K_WORK_DELAYABLE_DEFINE(notify_work, notify_work_handler);
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int lcz_bt_notify(const struct bt_gatt_attr *attr, const void *data, uint16_t len)
+{
+	k_spinlock_key_t key;
+	struct slot *s = NULL;
+	int r;
+
+	if (attr == NULL || (data == NULL && len != 0)) {
+		return -EINVAL;
+	}
+
+	if (len <= MAX_VALUE_SIZE) {
+		key = k_spin_lock(&ntf.lock);
+		s = find_slot(attr, true);
+		if (s != NULL) {
+			ntf.stats.updates += 1;
+			if (s->pending) {
+				ntf.stats.coalesced += 1;
+			}
+			memcpy(s->value, data, len);
+			s->len = len;
+			s->pending = true;
+		}
+		k_spin_unlock(&ntf.lock, key);
+	}
+
+	if (s == NULL) {
+		/* An older value of the characteristic must not be sent after this one */
+		k_mutex_lock(&send_mutex, K_FOREVER);
+		key = k_spin_lock(&ntf.lock);
+		s = find_slot(attr, false);
+		if (s != NULL) {
+			s->pending = false;
+			s->retry_conns = 0;
+		}
+		k_spin_unlock(&ntf.lock, key);
+
+		/* A NULL connection notifies all subscribed connections */
+		r = bt_gatt_notify(NULL, attr, data, len);
+		k_mutex_unlock(&send_mutex);
+		return r;
+	}
+
+	/* Does nothing if already scheduled; this is what limits the rate */
+	k_work_schedule(&notify_work, K_MSEC(CONFIG_LCZ_BT_NOTIFY_INTERVAL_MS));
+	return 0;
+}
+
+void lcz_bt_notify_flush(void)
+{
+	k_work_reschedule(&notify_work, K_NO_WAIT);
+}
+
+void lcz_bt_notify_get_stats(struct lcz_bt_notify_stats *stats)
+{
+	k_spinlock_key_t key;
+
+	if (stats != NULL) {
+		key = k_spin_lock(&ntf.lock);
+		*stats = ntf.stats;
+		k_spin_unlock(&ntf.lock, key);
+	}
+}
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+/* Lock must be held. A free slot is assigned to the attribute if assign is true. */
+static struct slot *find_slot(const struct bt_gatt_attr *attr, bool assign)
+{
+	size_t i;
+
+	for (i = 0; i < ntf.slots_used; i++) {
+		if (ntf.slots[i].attr == attr) {
+			return &ntf.slots[i];
+		}
+	}
+
+	if (assign && ntf.slots_used < MAX_SLOTS) {
+		ntf.slots[ntf.slots_used].attr = attr;
+		return &ntf.slots[ntf.slots_used++];
+	}
+
+	return NULL;
+}
+
+static void notify_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+	k_spinlock_key_t key;
+	bool retry;
+	size_t i;
+
+	batch.count = 0;
+
+	k_mutex_lock(&send_mutex, K_FOREVER);
+
+	/* Copy values so that setters aren't blocked while the stack is busy */
+	key = k_spin_lock(&ntf.lock);
+	for (i = 0; i < ntf.slots_used; i++) {
+		if (ntf.slots[i].pending || ntf.slots[i].retry_conns != 0) {
+			batch.conns[batch.count] =
+				ntf.slots[i].pending ? ALL_CONNS : ntf.slots[i].retry_conns;
+			memcpy(batch.value[batch.count], ntf.slots[i].value, ntf.slots[i].len);
+			memset(&batch.params[batch.count], 0, sizeof(batch.params[0]));
+			batch.params[batch.count].attr = ntf.slots[i].attr;
+			batch.params[batch.count].data = batch.value[batch.count];
+			batch.params[batch.count].len = ntf.slots[i].len;
+			batch.slot[batch.count] = i;
+			batch.count += 1;
+			ntf.slots[i].pending = false;
+			ntf.slots[i].retry_conns = 0;
+		}
+	}
+	ntf.retry = false;
+	k_spin_unlock(&ntf.lock, key);
+
+	if (batch.count > 0) {
+		bt_conn_foreach(BT_CONN_TYPE_LE, notify_conn, NULL);
+	}
+
+	k_mutex_unlock(&send_mutex);
+
+	key = k_spin_lock(&ntf.lock);
+	retry = ntf.retry;
+	k_spin_unlock(&ntf.lock, key);
+
+	/* Values the stack didn't have room for are sent again after the interval */
+	if (retry) {
+		k_work_schedule(&notify_work, K_MSEC(CONFIG_LCZ_BT_NOTIFY_INTERVAL_MS));
+	}
+}
+
+static void notify_conn(struct bt_conn *conn, void *data)
+{
+	ARG_UNUSED(data);
+	uint32_t conn_bit = BIT(bt_conn_index(conn));
+	size_t i;
+	int r;
+
+	batch.subscribed_count = 0;
+	for (i = 0; i < batch.count; i++) {
+		if ((batch.conns[i] & conn_bit) != 0 &&
+		    bt_gatt_is_subscribed(conn, batch.params[i].attr, BT_GATT_CCC_NOTIFY)) {
+			batch.subscribed[batch.subscribed_count] = batch.params[i];
+			batch.subscribed_slot[batch.subscribed_count] = batch.slot[i];
+			batch.subscribed_count += 1;
+		}
+	}
+
+	if (batch.subscribed_count == 0) {
+		return;
+	}
+
+#if defined(CONFIG_BT_GATT_NOTIFY_MULTIPLE)
+	/* Multiple values are sent in a single PDU when the peer supports it.
+	 * The error doesn't say which values were sent, so on failure each value is
+	 * sent on its own to get a result per value.
+	 */
+	if (batch.subscribed_count > 1) {
+		r = bt_gatt_notify_multiple(conn, batch.subscribed_count, batch.subscribed);
+		if (r == 0) {
+			for (i = 0; i < batch.subscribed_count; i++) {
+				notify_result(batch.subscribed_slot[i], conn_bit, r);
+			}
+			return;
+		}
+		LOG_DBG("Notify multiple failed %d", r);
+	}
+#endif
+
+	for (i = 0; i < batch.subscribed_count; i++) {
+		r = bt_gatt_notify_cb(conn, &batch.subscribed[i]);
+		notify_result(batch.subscribed_slot[i], conn_bit, r);
+	}
+}
+
+static void notify_result(uint8_t slot, uint32_t conn_bit, int r)
+{
+	k_spinlock_key_t key = k_spin_lock(&ntf.lock);
+
+	if (r == 0) {
+		ntf.stats.sent += 1;
+	} else {
+		ntf.stats.errors += 1;
+		/* Only this connection is retried. A newer value that is already pending is
+		 * sent to all connections.
+		 */
+		if (r == -ENOMEM && !ntf.slots[slot].pending) {
+			ntf.slots[slot].retry_conns |= conn_bit;
+			ntf.retry = true;
+		}
+	}
+
+	k_spin_unlock(&ntf.lock, key);
+
+	if (r < 0) {
+		LOG_DBG("Unable to notify %d", r);
+	}
+}
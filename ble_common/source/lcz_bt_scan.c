@@ -14,19 +14,67 @@ LOG_MODULE_REGISTER(lcz_bt_scan, CONFIG_LCZ_BT_SCAN_LOG_LEVEL);
 /* Includes                                                                   */
 /******************************************************************************/
 #include <kernel.h>
+#include <init.h>
 #include <stddef.h>
 
 #include "lcz_bt_scan.h"
 
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+enum scan_user_state {
+	SCAN_USER_FREE = 0,
+	SCAN_USER_CLAIMED,
+	SCAN_USER_ACTIVE,
+	SCAN_USER_RELEASING,
+};
+
+/* A slot is claimed/released with compare-and-swap on state.
+ * The advertisement handler never takes a lock; it marks the slot busy,
+ * re-checks the state, and then calls the handler. Unregister waits for
+ * busy to drop to zero before the slot can be reused. The handler gives idle
+ * when the last callback of a releasing user returns.
+ */
+struct scan_user {
+	atomic_t state;
+	atomic_t busy;
+	struct k_sem idle;
+	bt_le_scan_cb_t *cb;
+#if defined(CONFIG_BT_EXT_ADV)
+	lcz_bt_scan_ext_cb_t *ext_cb;
+#endif
+
+	atomic_t adverts;
+	atomic_t drops;
+	atomic_t callback_time_us;
+	atomic_t max_callback_time_us;
+};
+
 /******************************************************************************/
 /* Local Function Prototypes                                                  */
 /******************************************************************************/
+static int lcz_bt_scan_init(const struct device *device);
 static int scan_start(void);
 static bool valid_user_id(int id);
 static bool valid_scan_param_user_id(int id);
+static bool registered_user_id(int id);
+static bool register_user(int *pId, bt_le_scan_cb_t *cb,
+			  lcz_bt_scan_ext_cb_t *ext_cb);
+static bool dispatch_begin(struct scan_user *user,
+			   struct net_buf_simple *ad,
+			   struct net_buf_simple_state *state);
+static void dispatch_end(struct scan_user *user, uint32_t start,
+			 struct net_buf_simple *ad,
+			 struct net_buf_simple_state *state);
+static void dispatch_done(struct scan_user *user);
 static void lcz_bt_scan_adv_handler(const bt_addr_le_t *addr, int8_t rssi,
 				    uint8_t type, struct net_buf_simple *ad);
 
+#if defined(CONFIG_BT_EXT_ADV)
+static void lcz_bt_scan_recv_handler(const struct bt_le_scan_recv_info *info,
+				     struct net_buf_simple *ad);
+#endif
+
 /******************************************************************************/
 /* Local Data Definitions                                                     */
 /******************************************************************************/
@@ -35,14 +83,23 @@ static struct {
 	atomic_t users;
 	atomic_t stop_requests;
 	atomic_t start_requests;
-	bt_le_scan_cb_t *adv_handlers[CONFIG_LCZ_BT_SCAN_MAX_USERS];
+	struct scan_user user[CONFIG_LCZ_BT_SCAN_MAX_USERS];
+	k_tid_t dispatch_thread;
 
-	uint32_t num_stops;
-	uint32_t num_starts;
+	atomic_t num_stops;
+	atomic_t num_starts;
 } bts;
 
 static int scan_param_id = -1;
 
+#if defined(CONFIG_BT_EXT_ADV)
+static struct bt_le_scan_cb scan_callbacks = {
+	.recv = lcz_bt_scan_recv_handler,
+};
+
+static atomic_t scan_callbacks_registered;
+#endif
+
 static struct bt_le_scan_param scan_parameters = BT_LE_SCAN_PARAM_INIT(
 	BT_LE_SCAN_TYPE_PASSIVE, BT_LE_SCAN_OPT_FILTER_DUPLICATE,
 	CONFIG_LCZ_BT_SCAN_DEFAULT_INTERVAL, CONFIG_LCZ_BT_SCAN_DEFAULT_WINDOW);
@@ -50,6 +107,8 @@ static struct bt_le_scan_param scan_parameters = BT_LE_SCAN_PARAM_INIT(
 /******************************************************************************/
 /* Global Function Definitions                                                */
 /******************************************************************************/
+SYS_INIT(lcz_bt_scan_init, PRE_KERNEL_1, CONFIG_KERNEL_INIT_PRIORITY_OBJECTS);
+
 bool lcz_bt_scan_set_parameters(const struct bt_le_scan_param *param)
 {
 	if (atomic_get(&bts.users) != 0) {
@@ -62,21 +121,78 @@ bool lcz_bt_scan_set_parameters(const struct bt_le_scan_param *param)
 
 bool lcz_bt_scan_register(int *pId, bt_le_scan_cb_t *cb)
 {
-	*pId = (int)atomic_inc(&bts.users);
+	return register_user(pId, cb, NULL);
+}
 
-	if (valid_user_id(*pId)) {
-		bts.adv_handlers[*pId] = cb;
-		return true;
+#if defined(CONFIG_BT_EXT_ADV)
+bool lcz_bt_scan_register_ext(int *pId, lcz_bt_scan_ext_cb_t *cb)
+{
+	if (atomic_cas(&scan_callbacks_registered, 0, 1)) {
+		bt_le_scan_cb_register(&scan_callbacks);
+	}
+
+	return register_user(pId, NULL, cb);
+}
+#endif
+
+int lcz_bt_scan_unregister(int id)
+{
+	struct scan_user *user;
+
+	if (!valid_user_id(id)) {
+		return -EPERM;
+	}
+
+	user = &bts.user[id];
+	if (!atomic_cas(&user->state, SCAN_USER_ACTIVE, SCAN_USER_RELEASING)) {
+		return -EALREADY;
+	}
+
+	/* Wait for an in-progress callback to complete.
+	 * When called from a handler the dispatch is our own caller.
+	 * A give left over from an earlier release only costs an extra check.
+	 */
+	if (k_current_get() != bts.dispatch_thread) {
+		k_sem_reset(&user->idle);
+		while (atomic_get(&user->busy) != 0) {
+			k_sem_take(&user->idle, K_FOREVER);
+		}
+	}
+
+	if (scan_param_id == id) {
+		scan_param_id = -1;
+	}
+
+	user->cb = NULL;
+#if defined(CONFIG_BT_EXT_ADV)
+	user->ext_cb = NULL;
+#endif
+	atomic_dec(&bts.users);
+	atomic_clear_bit(&bts.start_requests, id);
+	atomic_clear_bit(&bts.stop_requests, id);
+	atomic_set(&user->state, SCAN_USER_FREE);
+
+	/* Don't leave the radio scanning for nobody, but let a stop request
+	 * from this user no longer block the others.
+	 */
+	if (atomic_get(&bts.start_requests) == 0) {
+		if (atomic_cas(&bts.scanning, 1, 0)) {
+			if (bt_le_scan_stop() == 0) {
+				atomic_inc(&bts.num_stops);
+			}
+		}
 	} else {
-		return false;
+		(void)scan_start();
 	}
+
+	return 0;
 }
 
 int lcz_bt_scan_start(int id)
 {
 	int r = -EPERM;
 
-	if (valid_user_id(id)) {
+	if (registered_user_id(id)) {
 		atomic_set_bit(&bts.start_requests, id);
 		r = scan_start();
 	}
@@ -88,14 +204,14 @@ int lcz_bt_scan_stop(int id)
 {
 	int r = -EPERM;
 
-	if (valid_user_id(id)) {
+	if (registered_user_id(id)) {
 		atomic_clear_bit(&bts.start_requests, id);
 		atomic_set_bit(&bts.stop_requests, id);
 		if (atomic_cas(&bts.scanning, 1, 0)) {
 			r = bt_le_scan_stop();
 			LOG_DBG("%d", r);
 			if (r == 0) {
-				bts.num_stops += 1;
+				atomic_inc(&bts.num_stops);
 			}
 		} else {
 			r = 0;
@@ -109,7 +225,7 @@ int lcz_bt_scan_resume(int id)
 {
 	int r = -EPERM;
 
-	if (valid_user_id(id)) {
+	if (registered_user_id(id)) {
 		atomic_clear_bit(&bts.stop_requests, id);
 		r = scan_start();
 	}
@@ -121,7 +237,7 @@ int lcz_bt_scan_restart(int id)
 {
 	int r = -EPERM;
 
-	if (valid_user_id(id)) {
+	if (registered_user_id(id)) {
 		atomic_clear_bit(&bts.stop_requests, id);
 		atomic_set_bit(&bts.start_requests, id);
 		r = scan_start();
@@ -137,12 +253,48 @@ bool lcz_bt_scan_active(void)
 
 uint32_t lcz_bt_scan_get_num_starts(void)
 {
-	return bts.num_starts;
+	return (uint32_t)atomic_get(&bts.num_starts);
 }
 
 uint32_t lcz_bt_scan_get_num_stops(void)
 {
-	return bts.num_stops;
+	return (uint32_t)atomic_get(&bts.num_stops);
+}
+
+int lcz_bt_scan_get_user_stats(int id, struct lcz_bt_scan_user_stats *stats)
+{
+	struct scan_user *user;
+
+	/* Statistics remain readable after unregister until the slot is reused */
+	if (!valid_user_id(id) || stats == NULL) {
+		return -EPERM;
+	}
+
+	user = &bts.user[id];
+	stats->adverts = (uint32_t)atomic_get(&user->adverts);
+	stats->drops = (uint32_t)atomic_get(&user->drops);
+	stats->callback_time_us = (uint32_t)atomic_get(&user->callback_time_us);
+	stats->max_callback_time_us =
+		(uint32_t)atomic_get(&user->max_callback_time_us);
+
+	return 0;
+}
+
+int lcz_bt_scan_reset_user_stats(int id)
+{
+	struct scan_user *user;
+
+	if (!registered_user_id(id)) {
+		return -EPERM;
+	}
+
+	user = &bts.user[id];
+	atomic_clear(&user->adverts);
+	atomic_clear(&user->drops);
+	atomic_clear(&user->callback_time_us);
+	atomic_clear(&user->max_callback_time_us);
+
+	return 0;
 }
 
 int lcz_bt_scan_update_parameters(int id, const struct bt_le_scan_param *param)
@@ -164,6 +316,18 @@ int lcz_bt_scan_update_parameters(int id, const struct bt_le_scan_param *param)
 /******************************************************************************/
 /* Local Function Definitions                                                 */
 /******************************************************************************/
+static int lcz_bt_scan_init(const struct device *device)
+{
+	ARG_UNUSED(device);
+	int i;
+
+	for (i = 0; i < CONFIG_LCZ_BT_SCAN_MAX_USERS; i++) {
+		k_sem_init(&bts.user[i].idle, 0, 1);
+	}
+
+	return 0;
+}
+
 static int scan_start(void)
 {
 	int r = 0;
@@ -186,7 +350,7 @@ static int scan_start(void)
 			atomic_clear(&bts.scanning);
 		} else {
 			LOG_DBG("%d", r);
-			bts.num_starts += 1;
+			atomic_inc(&bts.num_starts);
 		}
 	}
 
@@ -203,12 +367,26 @@ static bool valid_user_id(int id)
 	}
 }
 
+static bool registered_user_id(int id)
+{
+	if (!valid_user_id(id)) {
+		return false;
+	}
+
+	if (atomic_get(&bts.user[id].state) != SCAN_USER_ACTIVE) {
+		LOG_ERR("Bt scan user id %d is not registered", id);
+		return false;
+	}
+
+	return true;
+}
+
 /* Is the user ID valid for updating the scan parameters? */
 static bool valid_scan_param_user_id(int id)
 {
 	bool valid = false;
 
-	if (valid_user_id(id)) {
+	if (registered_user_id(id)) {
 		if (scan_param_id == -1 || scan_param_id == id) {
 			valid = true;
 		} else if (IS_ENABLED(CONFIG_LCZ_BT_SCAN_ALLOW_MULTIPLE_SCAN_PARAM_UPDATERS)) {
@@ -226,9 +404,94 @@ static bool valid_scan_param_user_id(int id)
 	return valid;
 }
 
+static bool register_user(int *pId, bt_le_scan_cb_t *cb,
+			  lcz_bt_scan_ext_cb_t *ext_cb)
+{
+	struct scan_user *user;
+	int i;
+
+	*pId = -1;
+
+	for (i = 0; i < CONFIG_LCZ_BT_SCAN_MAX_USERS; i++) {
+		user = &bts.user[i];
+		if (atomic_cas(&user->state, SCAN_USER_FREE,
+			       SCAN_USER_CLAIMED)) {
+			user->cb = cb;
+#if defined(CONFIG_BT_EXT_ADV)
+			user->ext_cb = ext_cb;
+#else
+			ARG_UNUSED(ext_cb);
+#endif
+			atomic_clear(&user->adverts);
+			atomic_clear(&user->drops);
+			atomic_clear(&user->callback_time_us);
+			atomic_clear(&user->max_callback_time_us);
+			/* Publishing the state makes the handler visible */
+			atomic_set(&user->state, SCAN_USER_ACTIVE);
+			atomic_inc(&bts.users);
+			*pId = i;
+			return true;
+		}
+	}
+
+	LOG_ERR("Scan user limit reached");
+	return false;
+}
+
+static bool dispatch_begin(struct scan_user *user,
+			   struct net_buf_simple *ad,
+			   struct net_buf_simple_state *state)
+{
+	atomic_inc(&user->busy);
+
+	/* Re-check after marking busy; unregister may have started. */
+	if (atomic_get(&user->state) != SCAN_USER_ACTIVE) {
+		atomic_inc(&user->drops);
+		dispatch_done(user);
+		return false;
+	}
+
+	/* Each user gets the advertisement at the original offset */
+	net_buf_simple_save(ad, state);
+	return true;
+}
+
+static void dispatch_end(struct scan_user *user, uint32_t start,
+			 struct net_buf_simple *ad,
+			 struct net_buf_simple_state *state)
+{
+	uint32_t us = (uint32_t)k_cyc_to_us_floor32(k_cycle_get_32() - start);
+	atomic_val_t max;
+
+	net_buf_simple_restore(ad, state);
+
+	atomic_inc(&user->adverts);
+	atomic_add(&user->callback_time_us, (atomic_val_t)us);
+	do {
+		max = atomic_get(&user->max_callback_time_us);
+	} while ((uint32_t)max < us &&
+		 !atomic_cas(&user->max_callback_time_us, max, us));
+
+	dispatch_done(user);
+}
+
+static void dispatch_done(struct scan_user *user)
+{
+	/* Wake unregister when the last callback for the user has returned */
+	if (atomic_dec(&user->busy) == 1 &&
+	    atomic_get(&user->state) == SCAN_USER_RELEASING) {
+		k_sem_give(&user->idle);
+	}
+}
+
 static void lcz_bt_scan_adv_handler(const bt_addr_le_t *addr, int8_t rssi,
 				    uint8_t type, struct net_buf_simple *ad)
 {
+	struct net_buf_simple_state state;
+	struct scan_user *user;
+	atomic_val_t user_state;
+	bt_le_scan_cb_t *cb;
+	uint32_t start;
 #ifdef CONFIG_LCZ_BT_SCAN_VERBOSE_ADV_HANDLER
 	char bt_addr[BT_ADDR_LE_STR_LEN];
 	memset(bt_addr, 0, BT_ADDR_LE_STR_LEN);
@@ -239,9 +502,74 @@ static void lcz_bt_scan_adv_handler(const bt_addr_le_t *addr, int8_t rssi,
 #endif
 
 	size_t i;
+
+	bts.dispatch_thread = k_current_get();
+
+	for (i = 0; i < CONFIG_LCZ_BT_SCAN_MAX_USERS; i++) {
+		user = &bts.user[i];
+		user_state = atomic_get(&user->state);
+		if (user->cb == NULL) {
+			continue;
+		} else if (user_state == SCAN_USER_ACTIVE) {
+			if (dispatch_begin(user, ad, &state)) {
+				/* The callback may have been cleared since
+				 * the check above.
+				 */
+				cb = user->cb;
+				if (cb == NULL) {
+					dispatch_done(user);
+					continue;
+				}
+				start = k_cycle_get_32();
+				cb(addr, rssi, type, ad);
+				dispatch_end(user, start, ad, &state);
+			}
+		} else if (user_state == SCAN_USER_RELEASING) {
+			atomic_inc(&user->drops);
+		}
+	}
+}
+
+#if defined(CONFIG_BT_EXT_ADV)
+/* Extended users get the report information (PHY, SID, properties).
+ * The stack calls this in addition to the legacy handler.
+ */
+static void lcz_bt_scan_recv_handler(const struct bt_le_scan_recv_info *info,
+				     struct net_buf_simple *ad)
+{
+	struct net_buf_simple_state state;
+	struct scan_user *user;
+	atomic_val_t user_state;
+	lcz_bt_scan_ext_cb_t *ext_cb;
+	uint32_t start;
+	size_t i;
+
+	/* Reports are only wanted while this module has scanning enabled */
+	if (atomic_get(&bts.scanning) == 0) {
+		return;
+	}
+
+	bts.dispatch_thread = k_current_get();
+
 	for (i = 0; i < CONFIG_LCZ_BT_SCAN_MAX_USERS; i++) {
-		if (bts.adv_handlers[i] != NULL) {
-			bts.adv_handlers[i](addr, rssi, type, ad);
+		user = &bts.user[i];
+		user_state = atomic_get(&user->state);
+		if (user->ext_cb == NULL) {
+			continue;
+		} else if (user_state == SCAN_USER_ACTIVE) {
+			if (dispatch_begin(user, ad, &state)) {
+				ext_cb = user->ext_cb;
+				if (ext_cb == NULL) {
+					dispatch_done(user);
+					continue;
+				}
+				start = k_cycle_get_32();
+				ext_cb(info, ad);
+				dispatch_end(user, start, ad, &state);
+			}
+		} else if (user_state == SCAN_USER_RELEASING) {
+			atomic_inc(&user->drops);
 		}
 	}
 }
+#endif
@@ -10,9 +10,18 @@
 /******************************************************************************/
 /* Includes                                                                   */
 /******************************************************************************/
+#include <errno.h>
+#include <string.h>
+
 #include "lcz_bluetooth.h"
 #include "lcz_sensor_adv_format.h"
 
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+/* Length and type bytes of each AD structure */
+#define AD_OVERHEAD 2
+
 /******************************************************************************/
 /* Global Data Definitions                                                    */
 /******************************************************************************/
@@ -83,3 +92,52 @@ const uint8_t CT_DATA_DOWNLOAD_AD_HEADER[LCZ_SENSOR_AD_HEADER_SIZE] = {
 	LSB_16(CT_DATA_DOWNLOAD_AD_PROTOCOL_ID),
 	MSB_16(CT_DATA_DOWNLOAD_AD_PROTOCOL_ID)
 };
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+int lcz_sensor_adv_ext_build(struct bt_data *ad, size_t count,
+			     const uint8_t *flags, const LczSensorAdExt_t *msd,
+			     const char *name)
+{
+	size_t total = AD_OVERHEAD + sizeof(LczSensorAdExt_t);
+	size_t name_len;
+	size_t n = 0;
+
+	if (ad == NULL || msd == NULL || count < LCZ_SENSOR_ADV_EXT_BT_DATA_COUNT) {
+		return -EINVAL;
+	}
+
+	if (flags != NULL) {
+		ad[n].type = BT_DATA_FLAGS;
+		ad[n].data_len = sizeof(uint8_t);
+		ad[n].data = flags;
+		total += AD_OVERHEAD + sizeof(uint8_t);
+		n++;
+	}
+
+	ad[n].type = BT_DATA_MANUFACTURER_DATA;
+	ad[n].data_len = sizeof(LczSensorAdExt_t);
+	ad[n].data = (const uint8_t *)msd;
+	n++;
+
+	if (name != NULL) {
+		name_len = strlen(name);
+		if (name_len > SENSOR_MAX_NAME_LENGTH_EXTENDED) {
+			name_len = SENSOR_MAX_NAME_LENGTH_EXTENDED;
+			ad[n].type = BT_DATA_NAME_SHORTENED;
+		} else {
+			ad[n].type = BT_DATA_NAME_COMPLETE;
+		}
+		ad[n].data_len = (uint8_t)name_len;
+		ad[n].data = (const uint8_t *)name;
+		total += AD_OVERHEAD + name_len;
+		n++;
+	}
+
+	if (total > SENSOR_MAX_ADV_LENGTH_EXTENDED) {
+		return -ENOMEM;
+	}
+
+	return (int)n;
+}
@@ -14,6 +14,14 @@
 #include "lcz_sensor_adv_format.h"
 #include "lcz_sensor_adv_match.h"
 
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define MAX_PARSE_LENGTH 255
+
+/* In the TLV structure the value follows the length and type */
+#define AD_VALUE_INDEX 2
+
 /**************************************************************************************************/
 /* Global Function Definitions                                                                    */
 /**************************************************************************************************/
@@ -111,3 +119,81 @@ uint16_t lcz_sensor_adv_match_coded(AdHandle_t *handle)
 	}
 	return 0;
 }
+
+uint16_t lcz_sensor_adv_match_ext(AdHandle_t *handle)
+{
+	if (handle->pPayload != NULL) {
+		if (handle->size > LCZ_SENSOR_MSD_CODED_PAYLOAD_LENGTH) {
+			if (memcmp(handle->pPayload, BTXXX_CODED_HEADER,
+				   sizeof(BTXXX_CODED_HEADER)) == 0) {
+				return BTXXX_CODED_PHY_AD_PROTOCOL_ID;
+			}
+		}
+	}
+	return lcz_sensor_adv_match_coded(handle);
+}
+
+uint16_t lcz_sensor_adv_parse(struct net_buf_simple *ad, struct lcz_sensor_adv_info *info)
+{
+	size_t length = MIN(ad->len, MAX_PARSE_LENGTH);
+	uint8_t *p = ad->data;
+	AdHandle_t handle;
+	uint16_t type;
+	size_t i = 0;
+	uint8_t size;
+
+	memset(info, 0, sizeof(*info));
+
+	while (i < length) {
+		size = p[i];
+		/* A zero length field ends the significant part of the data */
+		if (size == 0 || (i + 1 + size) > length) {
+			break;
+		}
+
+		handle.pPayload = &p[i + AD_VALUE_INDEX];
+		handle.size = size - 1;
+
+		switch (p[i + 1]) {
+		case BT_DATA_MANUFACTURER_DATA:
+			type = lcz_sensor_adv_match_1m(&handle);
+			if (type == BTXXX_1M_PHY_AD_PROTOCOL_ID) {
+				info->event = (const LczSensorAdEvent_t *)handle.pPayload;
+			} else if (type == 0) {
+				type = lcz_sensor_adv_match_rsp(&handle);
+				if (type != 0) {
+					info->rsp = &((const LczSensorRspWithHeader_t *)handle.pPayload)
+							     ->rsp;
+				}
+			}
+			if (type == 0) {
+				type = lcz_sensor_adv_match_ext(&handle);
+				if (type == BTXXX_CODED_PHY_AD_PROTOCOL_ID) {
+					info->event =
+						&((const LczSensorAdCoded_t *)handle.pPayload)->ad;
+					info->rsp = &((const LczSensorAdCoded_t *)handle.pPayload)->rsp;
+				}
+			}
+			/* The advertisement identifies the report when both are present */
+			if (type != 0 && (info->protocol_id == RESERVED_AD_PROTOCOL_ID ||
+					  info->protocol_id == BTXXX_1M_PHY_RSP_PROTOCOL_ID)) {
+				info->protocol_id = type;
+			}
+			break;
+
+		case BT_DATA_NAME_SHORTENED:
+		case BT_DATA_NAME_COMPLETE:
+			info->name = (const char *)handle.pPayload;
+			info->name_len = (uint8_t)handle.size;
+			break;
+
+		default:
+			break;
+		}
+
+		/* skip one extra byte because length field not included in length */
+		i += size + 1;
+	}
+
+	return info->protocol_id;
+}
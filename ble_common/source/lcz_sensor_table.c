@@ -0,0 +1,625 @@
+/**
+ * @file lcz_sensor_table.c
+ * @brief
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr.h>
+#include <sys/byteorder.h>
+#include <sys/util.h>
+
+#include "lcz_sensor_table.h"
+#if defined(CONFIG_LCZ_SENSOR_TABLE_ADV_HANDLER)
+#include "lcz_sensor_adv_match.h"
+#endif
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define MAX_SENSORS CONFIG_LCZ_SENSOR_TABLE_MAX_SENSORS
+#define SLOTS CONFIG_LCZ_SENSOR_TABLE_HASH_SLOTS
+#define SLOT_MASK (SLOTS - 1)
+#define NIL UINT16_MAX
+#define TX_POWER_UNKNOWN LCZ_SENSOR_TABLE_TX_POWER_UNKNOWN
+
+#if defined(CONFIG_LCZ_SENSOR_TABLE_RSSI_FILTER)
+#define RSSI_WINDOW CONFIG_LCZ_SENSOR_TABLE_RSSI_WINDOW
+#define EWMA_SHIFT CONFIG_LCZ_SENSOR_TABLE_RSSI_EWMA_SHIFT
+/* EWMA is kept with 8 fractional bits */
+#define EWMA_FRAC_BITS 8
+
+/* 10^(n/20) * 1000 for n = 0..20; distance resolution is 0.05 decade */
+static const uint16_t POW10_TWENTIETHS[] = { 1000, 1122, 1259, 1413, 1585, 1778, 1995,
+					     2239, 2512, 2818, 3162, 3548, 3981, 4467,
+					     5012, 5623, 6310, 7079, 7943, 8913, 10000 };
+#endif
+
+BUILD_ASSERT((SLOTS & SLOT_MASK) == 0, "Number of hash slots must be a power of 2");
+BUILD_ASSERT((SLOTS * 3) >= (MAX_SENSORS * 4), "Hash table load must not exceed 75%");
+BUILD_ASSERT(SLOTS < NIL, "Too many hash slots");
+
+/* Structure of arrays; a probe only touches slot, tag, and addr. */
+static struct {
+	struct k_spinlock lock;
+	/* Hash table */
+	uint16_t slot[SLOTS];
+	uint8_t tag[SLOTS];
+	/* Sensors */
+	bt_addr_t addr[MAX_SENSORS];
+	int8_t rssi[MAX_SENSORS];
+	uint16_t id[MAX_SENSORS];
+	uint32_t epoch[MAX_SENSORS];
+	uint16_t product_id[MAX_SENSORS];
+	uint32_t firmware_version[MAX_SENSORS];
+	uint32_t last_seen[MAX_SENSORS];
+#if defined(CONFIG_LCZ_SENSOR_TABLE_RSSI_FILTER)
+	int16_t rssi_ewma[MAX_SENSORS];
+	int8_t rssi_median[MAX_SENSORS];
+	int8_t tx_power[MAX_SENSORS];
+	uint8_t rssi_samples[MAX_SENSORS];
+	uint8_t rssi_next[MAX_SENSORS];
+	int8_t rssi_window[MAX_SENSORS][RSSI_WINDOW];
+#endif
+	/* Bookkeeping */
+	uint16_t pos[MAX_SENSORS];
+	uint16_t prev[MAX_SENSORS];
+	uint16_t next[MAX_SENSORS];
+	uint16_t head;
+	uint16_t tail;
+	uint16_t free;
+	size_t count;
+	bool initialized;
+} st;
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static void init(void);
+static uint32_t hash(const bt_addr_t *addr);
+static int find(const bt_addr_t *addr, uint32_t h, uint16_t *empty);
+static void lru_unlink(uint16_t e);
+static void lru_push_head(uint16_t e);
+static void remove_entry(uint16_t e);
+static int insert(const bt_addr_t *addr, uint32_t h);
+static int update(const bt_addr_t *addr, int8_t rssi, uint16_t id, uint32_t epoch,
+		  int8_t tx_power);
+
+#if defined(CONFIG_LCZ_SENSOR_TABLE_RSSI_FILTER)
+static void rssi_filter_reset(uint16_t e);
+static void rssi_filter_add(uint16_t e, int8_t rssi);
+static uint32_t distance_cm(int8_t tx_power, int8_t rssi);
+#endif
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int lcz_sensor_table_update(const bt_addr_t *addr, int8_t rssi, uint16_t id, uint32_t epoch)
+{
+	return update(addr, rssi, id, epoch, TX_POWER_UNKNOWN);
+}
+
+int lcz_sensor_table_update_ad(int8_t rssi, const LczSensorAdEvent_t *ad)
+{
+	bt_addr_t addr;
+
+	if (ad == NULL) {
+		return -EINVAL;
+	}
+
+	/* Advertisement is packed */
+	memcpy(&addr, &ad->addr, sizeof(addr));
+	return lcz_sensor_table_update(&addr, rssi, sys_le16_to_cpu(ad->id),
+				       sys_le32_to_cpu(ad->epoch));
+}
+
+int lcz_sensor_table_update_ct(int8_t rssi, const LczContactTracingAd_t *ad)
+{
+	bt_addr_t addr;
+
+	if (ad == NULL) {
+		return -EINVAL;
+	}
+
+	/* Contact tracing ads don't have an event id; epoch marks new data */
+	memcpy(&addr, &ad->addr, sizeof(addr));
+	return update(&addr, rssi, 0, sys_le32_to_cpu(ad->epoch), ad->txPower);
+}
+
+int lcz_sensor_table_update_rsp(const bt_addr_t *addr, const LczSensorRsp_t *rsp)
+{
+	k_spinlock_key_t key;
+	uint32_t h;
+	uint16_t e;
+	int p;
+
+	if (addr == NULL || rsp == NULL) {
+		return -EINVAL;
+	}
+
+	h = hash(addr);
+	key = k_spin_lock(&st.lock);
+	init();
+
+	p = find(addr, h, NULL);
+	if (p >= 0) {
+		e = st.slot[p];
+		st.product_id[e] = sys_le16_to_cpu(rsp->productId);
+		st.firmware_version[e] =
+			LCZ_SENSOR_TABLE_FW_VERSION(rsp->firmwareVersionMajor,
+						    rsp->firmwareVersionMinor,
+						    rsp->firmwareVersionPatch);
+		p = 0;
+	} else {
+		p = -ENOENT;
+	}
+
+	k_spin_unlock(&st.lock, key);
+
+	return p;
+}
+
+int lcz_sensor_table_find(const bt_addr_t *addr)
+{
+	k_spinlock_key_t key;
+	uint32_t h;
+	int p;
+
+	if (addr == NULL) {
+		return -EINVAL;
+	}
+
+	h = hash(addr);
+	key = k_spin_lock(&st.lock);
+	init();
+
+	p = find(addr, h, NULL);
+	if (p >= 0) {
+		p = st.slot[p];
+	}
+
+	k_spin_unlock(&st.lock, key);
+
+	return p;
+}
+
+int lcz_sensor_table_get(int index, struct lcz_sensor_table_entry *entry)
+{
+	k_spinlock_key_t key;
+	int r = -ENOENT;
+
+	if (index < 0 || index >= MAX_SENSORS || entry == NULL) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&st.lock);
+	init();
+
+	/* Entries on the free list aren't in the hash table */
+	if (st.pos[index] != NIL) {
+		bt_addr_copy(&entry->addr, &st.addr[index]);
+		entry->rssi = st.rssi[index];
+		entry->id = st.id[index];
+		entry->epoch = st.epoch[index];
+		entry->product_id = st.product_id[index];
+		entry->firmware_version = st.firmware_version[index];
+		entry->last_seen = st.last_seen[index];
+		r = 0;
+	}
+
+	k_spin_unlock(&st.lock, key);
+
+	return r;
+}
+
+int lcz_sensor_table_remove(const bt_addr_t *addr)
+{
+	k_spinlock_key_t key;
+	uint32_t h;
+	int p;
+
+	if (addr == NULL) {
+		return -EINVAL;
+	}
+
+	h = hash(addr);
+	key = k_spin_lock(&st.lock);
+	init();
+
+	p = find(addr, h, NULL);
+	if (p >= 0) {
+		remove_entry(st.slot[p]);
+		p = 0;
+	}
+
+	k_spin_unlock(&st.lock, key);
+
+	return p;
+}
+
+#if defined(CONFIG_LCZ_SENSOR_TABLE_RSSI_FILTER)
+int lcz_sensor_table_get_rssi(int index, struct lcz_sensor_table_rssi *stats)
+{
+	k_spinlock_key_t key;
+	int r = -ENOENT;
+
+	if (index < 0 || index >= MAX_SENSORS || stats == NULL) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&st.lock);
+	init();
+
+	if (st.pos[index] != NIL) {
+		stats->last = st.rssi[index];
+		stats->ewma = (int8_t)(st.rssi_ewma[index] >> EWMA_FRAC_BITS);
+		stats->median = st.rssi_median[index];
+		stats->samples = st.rssi_samples[index];
+		stats->tx_power = st.tx_power[index];
+		stats->distance_cm = distance_cm(st.tx_power[index], st.rssi_median[index]);
+		r = 0;
+	}
+
+	k_spin_unlock(&st.lock, key);
+
+	return r;
+}
+#endif
+
+#if defined(CONFIG_LCZ_SENSOR_TABLE_ADV_HANDLER)
+void lcz_sensor_table_adv_handler(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+				  struct net_buf_simple *ad)
+{
+	struct lcz_sensor_adv_info info;
+	AdHandle_t handle;
+
+	ARG_UNUSED(type);
+
+	if (lcz_sensor_adv_parse(ad, &info) != RESERVED_AD_PROTOCOL_ID) {
+		if (info.event != NULL) {
+			(void)lcz_sensor_table_update_ad(rssi, info.event);
+		}
+		/* A scan response only has the address of the advertiser */
+		if (info.rsp != NULL) {
+			(void)lcz_sensor_table_update_rsp(&addr->a, info.rsp);
+		}
+		return;
+	}
+
+	handle = AdFind_Type(ad->data, ad->len, BT_DATA_MANUFACTURER_DATA, BT_DATA_INVALID);
+	if (handle.pPayload != NULL && handle.size == sizeof(LczContactTracingAd_t)) {
+		if (memcmp(handle.pPayload, CT_TRACKER_AD_HEADER, LCZ_SENSOR_AD_HEADER_SIZE) == 0 ||
+		    memcmp(handle.pPayload, CT_GATEWAY_AD_HEADER, LCZ_SENSOR_AD_HEADER_SIZE) == 0) {
+			(void)lcz_sensor_table_update_ct(rssi,
+							 (LczContactTracingAd_t *)handle.pPayload);
+		}
+	}
+}
+#endif
+
+size_t lcz_sensor_table_age(uint32_t max_age_ms)
+{
+	k_spinlock_key_t key;
+	uint32_t now = k_uptime_get_32();
+	size_t removed = 0;
+
+	key = k_spin_lock(&st.lock);
+	init();
+
+	while (st.tail != NIL && (now - st.last_seen[st.tail]) > max_age_ms) {
+		remove_entry(st.tail);
+		removed += 1;
+	}
+
+	k_spin_unlock(&st.lock, key);
+
+	return removed;
+}
+
+size_t lcz_sensor_table_count(void)
+{
+	return st.count;
+}
+
+void lcz_sensor_table_clear(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&st.lock);
+
+	st.initialized = false;
+	init();
+
+	k_spin_unlock(&st.lock, key);
+}
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static void init(void)
+{
+	size_t i;
+
+	if (st.initialized) {
+		return;
+	}
+
+	for (i = 0; i < SLOTS; i++) {
+		st.slot[i] = NIL;
+	}
+
+	for (i = 0; i < MAX_SENSORS; i++) {
+		st.pos[i] = NIL;
+		st.prev[i] = NIL;
+		st.next[i] = (i + 1) < MAX_SENSORS ? (uint16_t)(i + 1) : NIL;
+	}
+
+	st.head = NIL;
+	st.tail = NIL;
+	st.free = 0;
+	st.count = 0;
+	st.initialized = true;
+}
+
+/* Multiplicative hash of the 48-bit address.
+ * The low bits select the home slot and the upper byte is a tag that
+ * avoids an address compare for most collisions.
+ */
+static uint32_t hash(const bt_addr_t *addr)
+{
+	uint32_t lo = sys_get_le32(&addr->val[0]);
+	uint32_t hi = sys_get_le16(&addr->val[4]);
+	uint32_t h = (lo * 0x9E3779B1u) ^ (hi * 0x85EBCA6Bu);
+
+	return h ^ (h >> 15);
+}
+
+static inline uint16_t home(uint32_t h)
+{
+	return (uint16_t)(h & SLOT_MASK);
+}
+
+static inline uint8_t tag(uint32_t h)
+{
+	return (uint8_t)(h >> 24);
+}
+
+/* Returns slot of address or -ENOENT.  The load limit guarantees an empty slot. */
+static int find(const bt_addr_t *addr, uint32_t h, uint16_t *empty)
+{
+	uint16_t p = home(h);
+	uint8_t t = tag(h);
+
+	while (st.slot[p] != NIL) {
+		if (st.tag[p] == t && bt_addr_cmp(&st.addr[st.slot[p]], addr) == 0) {
+			return p;
+		}
+		p = (p + 1) & SLOT_MASK;
+	}
+
+	if (empty != NULL) {
+		*empty = p;
+	}
+
+	return -ENOENT;
+}
+
+static void lru_unlink(uint16_t e)
+{
+	if (st.prev[e] != NIL) {
+		st.next[st.prev[e]] = st.next[e];
+	} else {
+		st.head = st.next[e];
+	}
+
+	if (st.next[e] != NIL) {
+		st.prev[st.next[e]] = st.prev[e];
+	} else {
+		st.tail = st.prev[e];
+	}
+
+	st.prev[e] = NIL;
+	st.next[e] = NIL;
+}
+
+static void lru_push_head(uint16_t e)
+{
+	st.prev[e] = NIL;
+	st.next[e] = st.head;
+	if (st.head != NIL) {
+		st.prev[st.head] = e;
+	} else {
+		st.tail = e;
+	}
+	st.head = e;
+}
+
+/* Backward shift deletion keeps probe sequences intact without tombstones. */
+static void remove_entry(uint16_t e)
+{
+	uint16_t i = st.pos[e];
+	uint16_t j = i;
+	uint16_t k;
+
+	lru_unlink(e);
+
+	st.slot[i] = NIL;
+	for (;;) {
+		j = (j + 1) & SLOT_MASK;
+		if (st.slot[j] == NIL) {
+			break;
+		}
+		k = home(hash(&st.addr[st.slot[j]]));
+		/* Leave the entry if its home slot lies cyclically in (i, j] */
+		if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j))) {
+			continue;
+		}
+		st.slot[i] = st.slot[j];
+		st.tag[i] = st.tag[j];
+		st.pos[st.slot[i]] = i;
+		st.slot[j] = NIL;
+		i = j;
+	}
+
+	st.pos[e] = NIL;
+	st.next[e] = st.free;
+	st.free = e;
+	st.count -= 1;
+}
+
+static int update(const bt_addr_t *addr, int8_t rssi, uint16_t id, uint32_t epoch,
+		  int8_t tx_power)
+{
+	k_spinlock_key_t key;
+	uint32_t h;
+	int flags = 0;
+	int p;
+	uint16_t e;
+
+	if (addr == NULL) {
+		return -EINVAL;
+	}
+
+	h = hash(addr);
+	key = k_spin_lock(&st.lock);
+	init();
+
+	p = find(addr, h, NULL);
+	if (p >= 0) {
+		e = st.slot[p];
+		lru_unlink(e);
+		if (st.id[e] != id || st.epoch[e] != epoch) {
+			flags |= LCZ_SENSOR_TABLE_NEW_EVENT;
+		}
+	} else {
+		if (st.count >= MAX_SENSORS) {
+			remove_entry(st.tail);
+			flags |= LCZ_SENSOR_TABLE_EVICTED;
+		}
+		e = (uint16_t)insert(addr, h);
+		st.product_id[e] = INVALID_PRODUCT_ID;
+		st.firmware_version[e] = 0;
+#if defined(CONFIG_LCZ_SENSOR_TABLE_RSSI_FILTER)
+		rssi_filter_reset(e);
+#endif
+		flags |= (LCZ_SENSOR_TABLE_NEW_SENSOR | LCZ_SENSOR_TABLE_NEW_EVENT);
+	}
+
+	st.rssi[e] = rssi;
+	st.id[e] = id;
+	st.epoch[e] = epoch;
+	st.last_seen[e] = k_uptime_get_32();
+#if defined(CONFIG_LCZ_SENSOR_TABLE_RSSI_FILTER)
+	rssi_filter_add(e, rssi);
+	if (tx_power != TX_POWER_UNKNOWN) {
+		st.tx_power[e] = tx_power;
+	}
+#else
+	ARG_UNUSED(tx_power);
+#endif
+	lru_push_head(e);
+
+	k_spin_unlock(&st.lock, key);
+
+	return flags;
+}
+
+static int insert(const bt_addr_t *addr, uint32_t h)
+{
+	uint16_t p = 0;
+	uint16_t e;
+
+	(void)find(addr, h, &p);
+
+	e = st.free;
+	st.free = st.next[e];
+	st.next[e] = NIL;
+
+	bt_addr_copy(&st.addr[e], addr);
+	st.slot[p] = e;
+	st.tag[p] = tag(h);
+	st.pos[e] = p;
+	st.count += 1;
+
+	return e;
+}
+
+#if defined(CONFIG_LCZ_SENSOR_TABLE_RSSI_FILTER)
+static void rssi_filter_reset(uint16_t e)
+{
+	st.rssi_samples[e] = 0;
+	st.rssi_next[e] = 0;
+	st.tx_power[e] = TX_POWER_UNKNOWN;
+}
+
+static void rssi_filter_add(uint16_t e, int8_t rssi)
+{
+	int8_t sorted[RSSI_WINDOW];
+	uint8_t n;
+	uint8_t i;
+	int8_t j;
+
+	if (st.rssi_samples[e] == 0) {
+		st.rssi_ewma[e] = (int16_t)(rssi * (1 << EWMA_FRAC_BITS));
+	} else {
+		st.rssi_ewma[e] += (int16_t)(((rssi * (1 << EWMA_FRAC_BITS)) - st.rssi_ewma[e]) >>
+					     EWMA_SHIFT);
+	}
+
+	st.rssi_window[e][st.rssi_next[e]] = rssi;
+	st.rssi_next[e] = (st.rssi_next[e] + 1) % RSSI_WINDOW;
+	if (st.rssi_samples[e] < RSSI_WINDOW) {
+		st.rssi_samples[e] += 1;
+	}
+
+	/* The window is small; insertion sort keeps reads O(1) */
+	n = st.rssi_samples[e];
+	for (i = 0; i < n; i++) {
+		int8_t v = st.rssi_window[e][i];
+
+		for (j = (int8_t)i - 1; j >= 0 && sorted[j] > v; j--) {
+			sorted[j + 1] = sorted[j];
+		}
+		sorted[j + 1] = v;
+	}
+	st.rssi_median[e] = sorted[n / 2];
+}
+
+/* Log-distance path loss model.
+ * 10 * n * log10(d) = (tx_power - loss at 1 m) - rssi
+ */
+static uint32_t distance_cm(int8_t tx_power, int8_t rssi)
+{
+	int32_t loss;
+	int32_t twentieths;
+	uint32_t d = 100;
+
+	if (tx_power == TX_POWER_UNKNOWN) {
+		return 0;
+	}
+
+	loss = (int32_t)tx_power - CONFIG_LCZ_SENSOR_TABLE_RSSI_LOSS_AT_1M - rssi;
+
+	/* Decades of distance in units of 0.05 (n is scaled by 10) */
+	twentieths = (loss * 20) / CONFIG_LCZ_SENSOR_TABLE_PATH_LOSS_EXPONENT_X10;
+	/* 1 cm to 1 km */
+	twentieths = CLAMP(twentieths, -40, 60);
+
+	if (twentieths >= 0) {
+		for (; twentieths >= 20; twentieths -= 20) {
+			d *= 10;
+		}
+		return (d * POW10_TWENTIETHS[twentieths]) / 1000;
+	} else {
+		twentieths = -twentieths;
+		for (; twentieths >= 20; twentieths -= 20) {
+			d *= 10;
+		}
+		/* 100 cm * 100 cm / d */
+		return (10000 * 1000) / (d * POW10_TWENTIETHS[twentieths]);
+	}
+}
+#endif
@@ -58,7 +58,8 @@ void ess_svc_init();
  *         enabled). Temperature format is in degrees celsius in 0.01 units
  *         (e.g. value of 391 is 3.91c)
  *
- *  @param [in]conn - Connection handle to notify (or NULL)
+ *  @param [in]conn - Connection handle to notify (or NULL). Unused with
+ *                    CONFIG_LCZ_BT_NOTIFY (all subscribers are notified).
  *  @param [in]value - new temperature value
  */
 void ess_svc_update_temperature(struct bt_conn *conn, int16_t value);
@@ -67,7 +68,8 @@ void ess_svc_update_temperature(struct bt_conn *conn, int16_t value);
  *         enabled). Humidity format is in percent in 0.01 units (e.g. value
  *         of 524 is 5.24%)
  *
- *  @param [in]conn - Connection handle to notify (or NULL)
+ *  @param [in]conn - Connection handle to notify (or NULL). Unused with
+ *                    CONFIG_LCZ_BT_NOTIFY (all subscribers are notified).
  *  @param [in]value - new humidity value
  */
 void ess_svc_update_humidity(struct bt_conn *conn, int16_t value);
@@ -76,7 +78,8 @@ void ess_svc_update_humidity(struct bt_conn *conn, int16_t value);
  *         enabled). Pressure format is in pascals in 0.1 units (e.g. value of
  *         86 is 8.6Pa)
  *
- *  @param [in]conn - Connection handle to notify (or NULL)
+ *  @param [in]conn - Connection handle to notify (or NULL). Unused with
+ *                    CONFIG_LCZ_BT_NOTIFY (all subscribers are notified).
  *  @param [in]value - new pressure value
  */
 void ess_svc_update_pressure(struct bt_conn *conn, int32_t value);
@@ -85,7 +88,8 @@ void ess_svc_update_pressure(struct bt_conn *conn, int32_t value);
  *         enabled). Dew point format is in degress celcius in 1 units (e.g.
  *         value of 5 is 5c)
  *
- *  @param [in]conn - Connection handle to notify (or NULL)
+ *  @param [in]conn - Connection handle to notify (or NULL). Unused with
+ *                    CONFIG_LCZ_BT_NOTIFY (all subscribers are notified).
  *  @param [in]value - new dew point value
  */
 void ess_svc_update_dew_point(struct bt_conn *conn, int8_t value);
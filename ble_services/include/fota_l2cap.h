@@ -0,0 +1,67 @@
+/**
+ * @file fota_l2cap.h
+ * @brief File upload over an L2CAP connection-oriented channel.
+ *
+ * A client connects to CONFIG_FOTA_L2CAP_PSM and sends an upload header
+ * followed by file data. Each SDU is written to the file before credits are
+ * returned to the client, so the file system sets the transfer rate.
+ * When the transfer completes (or fails) a status SDU is sent to the client.
+ * Data is written to "<name>.tmp", which replaces the file only when the
+ * transfer completes.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __FOTA_L2CAP_H__
+#define __FOTA_L2CAP_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/types.h>
+#include <toolchain.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+#define FOTA_L2CAP_OPCODE_UPLOAD 1
+
+/* First SDU of a transfer. Multi-byte values are little endian.
+ * The name is relative to CONFIG_FOTA_FS_MOUNT unless it starts with '/'.
+ * Bytes following the name are file data.
+ */
+struct fota_l2cap_header {
+	uint8_t opcode;
+	uint8_t name_length;
+	uint32_t size;
+	char name[];
+} __packed;
+
+/* Sent by the device when a transfer ends */
+struct fota_l2cap_status {
+	/* 0 on success, otherwise negative error code */
+	int32_t status;
+	/* Number of bytes written */
+	uint32_t offset;
+} __packed;
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+/**
+ * @brief Register L2CAP server
+ *
+ * @return int negative error code, 0 on success
+ */
+int fota_l2cap_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FOTA_L2CAP_H__ */
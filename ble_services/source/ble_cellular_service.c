@@ -24,6 +24,9 @@ LOG_MODULE_REGISTER(oob_cell_svc);
 #include <bluetooth/bluetooth.h>
 
 #include "lcz_bluetooth.h"
+#ifdef CONFIG_LCZ_BT_NOTIFY
+#include "lcz_bt_notify.h"
+#endif
 #include "ble_cellular_service.h"
 
 /******************************************************************************/
@@ -50,6 +53,12 @@ static struct bt_uuid_128 ICCID_UUID = CELL_SVC_BASE_UUID_128(0x7c6c);
 static struct bt_uuid_128 SERIAL_NUMBER_UUID = CELL_SVC_BASE_UUID_128(0x7c6d);
 static struct bt_uuid_128 BANDS_UUID = CELL_SVC_BASE_UUID_128(0x7c6e);
 static struct bt_uuid_128 ACTIVE_BANDS_UUID = CELL_SVC_BASE_UUID_128(0x7c6f);
+#ifdef CONFIG_BLE_CELLULAR_SERVICE_SNAPSHOT
+static struct bt_uuid_128 SNAPSHOT_UUID = CELL_SVC_BASE_UUID_128(0x7c70);
+#endif
+
+/* Snapshot tag is the lower byte of the UUID of the characteristic */
+#define CELL_TAG(uuid16) LSB_16(uuid16)
 
 struct ble_cellular_service {
 	char imei_value[MDM_HL7800_IMEI_SIZE];
@@ -65,17 +74,40 @@ struct ble_cellular_service {
 	char serial_number[MDM_HL7800_SERIAL_NUMBER_SIZE];
 	char bands[MDM_HL7800_LTE_BAND_STR_SIZE];
 	char active_bands[MDM_HL7800_LTE_BAND_STR_SIZE];
+};
 
-	uint16_t apn_index;
-	uint16_t apn_username_index;
-	uint16_t apn_password_index;
-	uint16_t network_state_index;
-	uint16_t startup_state_index;
-	uint16_t rssi_index;
-	uint16_t sinr_index;
-	uint16_t sleep_state_index;
-	uint16_t rat_index;
-	uint16_t active_bands_index;
+/* Order of cell_attrs */
+enum cell_attr {
+	LBT_GATT_ATTR_PRIMARY_SERVICE(CELL_ATTR_SVC),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_IMEI),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_FW_VERSION),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_APN),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_APN),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_APN_USERNAME),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_APN_USERNAME),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_APN_PASSWORD),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_APN_PASSWORD),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_NETWORK_STATE),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_NETWORK_STATE),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_STARTUP_STATE),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_STARTUP_STATE),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_RSSI),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_RSSI),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_SINR),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_SINR),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_SLEEP_STATE),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_SLEEP_STATE),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_RAT),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_RAT),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_ICCID),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_SERIAL_NUMBER),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_BANDS),
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_ACTIVE_BANDS),
+	LBT_GATT_ATTR_CCC(CELL_ATTR_ACTIVE_BANDS),
+#ifdef CONFIG_BLE_CELLULAR_SERVICE_SNAPSHOT
+	LBT_GATT_ATTR_CHRC(CELL_ATTR_SNAPSHOT),
+#endif
+	CELL_ATTR_COUNT
 };
 
 struct ccc_table {
@@ -98,6 +130,39 @@ static struct ble_cellular_service bcs;
 static struct ccc_table ccc;
 static struct bt_conn *cell_svc_conn = NULL;
 
+#ifdef CONFIG_BLE_CELLULAR_SERVICE_SNAPSHOT
+static const struct lbt_snapshot_field cell_snapshot_fields[] = {
+	LBT_SNAPSHOT_STRING(CELL_TAG(0x7c61), bcs.imei_value),
+	LBT_SNAPSHOT_STRING(CELL_TAG(0x7c62), bcs.apn.value),
+	LBT_SNAPSHOT_STRING(CELL_TAG(0x7c63), bcs.apn.username),
+	LBT_SNAPSHOT_STRING(CELL_TAG(0x7c64), bcs.apn.password),
+	LBT_SNAPSHOT_FIELD(CELL_TAG(0x7c65), bcs.network_state),
+	LBT_SNAPSHOT_STRING(CELL_TAG(0x7c66), bcs.fw_ver_value),
+	LBT_SNAPSHOT_FIELD(CELL_TAG(0x7c67), bcs.startup_state),
+	LBT_SNAPSHOT_FIELD(CELL_TAG(0x7c68), bcs.rssi),
+	LBT_SNAPSHOT_FIELD(CELL_TAG(0x7c69), bcs.sinr),
+	LBT_SNAPSHOT_FIELD(CELL_TAG(0x7c6a), bcs.sleep_state),
+	LBT_SNAPSHOT_FIELD(CELL_TAG(0x7c6b), bcs.rat),
+	LBT_SNAPSHOT_STRING(CELL_TAG(0x7c6c), bcs.iccid),
+	LBT_SNAPSHOT_STRING(CELL_TAG(0x7c6d), bcs.serial_number),
+	LBT_SNAPSHOT_STRING(CELL_TAG(0x7c6e), bcs.bands),
+	LBT_SNAPSHOT_STRING(CELL_TAG(0x7c6f), bcs.active_bands),
+};
+
+static uint8_t cell_snapshot_buffer[LBT_SNAPSHOT_BUFFER_SIZE(
+	sizeof(bcs), cell_snapshot_fields)];
+
+BUILD_ASSERT(sizeof(cell_snapshot_buffer) <= LBT_ATT_MAX_ATTRIBUTE_LEN,
+	     "Cellular snapshot too large");
+
+static struct lbt_snapshot cell_snapshot = {
+	.fields = cell_snapshot_fields,
+	.count = ARRAY_SIZE(cell_snapshot_fields),
+	.buffer = cell_snapshot_buffer,
+	.size = sizeof(cell_snapshot_buffer),
+};
+#endif
+
 /******************************************************************************/
 /* Local Function Prototypes                                                  */
 /******************************************************************************/
@@ -154,71 +219,92 @@ static void cell_svc_disconnected(struct bt_conn *conn, uint8_t reason);
 /* Cellular Service Declaration                                               */
 /******************************************************************************/
 static struct bt_gatt_attr cell_attrs[] = {
-	BT_GATT_PRIMARY_SERVICE(&CELL_SVC_UUID),
-	BT_GATT_CHARACTERISTIC(&IMEI_UUID.uuid, BT_GATT_CHRC_READ,
-			       BT_GATT_PERM_READ, read_imei, NULL,
-			       bcs.imei_value),
-	BT_GATT_CHARACTERISTIC(&FW_VERSION_UUID.uuid, BT_GATT_CHRC_READ,
-			       BT_GATT_PERM_READ, read_fw_ver, NULL,
-			       bcs.fw_ver_value),
-	BT_GATT_CHARACTERISTIC(&APN_UUID.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE |
-				       BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, read_apn,
-			       write_apn, bcs.apn.value),
-	LBT_GATT_CCC(apn_value),
-	BT_GATT_CHARACTERISTIC(&APN_USERNAME_UUID.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ, read_apn_username, NULL,
-			       bcs.apn.username),
-	LBT_GATT_CCC(apn_username),
-	BT_GATT_CHARACTERISTIC(&APN_PASSWORD_UUID.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ, read_apn_password, NULL,
-			       bcs.apn.password),
-	LBT_GATT_CCC(apn_password),
-	BT_GATT_CHARACTERISTIC(&NETWORK_STATE_UUID.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ, lbt_read_u8, NULL,
-			       &bcs.network_state),
-	LBT_GATT_CCC(network_state),
-	BT_GATT_CHARACTERISTIC(&STARTUP_STATE_UUID.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ, lbt_read_u8, NULL,
-			       &bcs.startup_state),
-	LBT_GATT_CCC(startup_state),
-	BT_GATT_CHARACTERISTIC(
-		&RSSI_UUID.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-		BT_GATT_PERM_READ, lbt_read_integer, NULL, &bcs.rssi),
-	LBT_GATT_CCC(rssi),
-	BT_GATT_CHARACTERISTIC(
-		&SINR_UUID.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-		BT_GATT_PERM_READ, lbt_read_integer, NULL, &bcs.sinr),
-	LBT_GATT_CCC(sinr),
-	BT_GATT_CHARACTERISTIC(
-		&SLEEP_STATE_UUID.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-		BT_GATT_PERM_READ, lbt_read_u8, NULL, &bcs.sleep_state),
-	LBT_GATT_CCC(sleep_state),
-	BT_GATT_CHARACTERISTIC(&RAT_UUID.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE |
-				       BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-			       lbt_read_u8, write_rat, &bcs.rat),
-	LBT_GATT_CCC(rat),
-	BT_GATT_CHARACTERISTIC(&ICCID_UUID.uuid, BT_GATT_CHRC_READ,
-			       BT_GATT_PERM_READ, read_iccid, NULL, bcs.iccid),
-	BT_GATT_CHARACTERISTIC(&SERIAL_NUMBER_UUID.uuid, BT_GATT_CHRC_READ,
-			       BT_GATT_PERM_READ, read_serial_number, NULL,
-			       bcs.serial_number),
-	BT_GATT_CHARACTERISTIC(&BANDS_UUID.uuid, BT_GATT_CHRC_READ,
-			       BT_GATT_PERM_READ, read_bands, NULL, bcs.bands),
-	BT_GATT_CHARACTERISTIC(&ACTIVE_BANDS_UUID.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ, read_bands, NULL,
-			       bcs.active_bands),
-	LBT_GATT_CCC(active_bands),
+	LBT_GATT_PRIMARY_SERVICE(CELL_ATTR_SVC, &CELL_SVC_UUID),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_IMEI, &IMEI_UUID.uuid,
+				BT_GATT_CHRC_READ,
+				BT_GATT_PERM_READ, read_imei, NULL,
+				bcs.imei_value),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_FW_VERSION, &FW_VERSION_UUID.uuid,
+				BT_GATT_CHRC_READ,
+				BT_GATT_PERM_READ, read_fw_ver, NULL,
+				bcs.fw_ver_value),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_APN, &APN_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE |
+					BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+				read_apn, write_apn, bcs.apn.value),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_APN, apn_value),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_APN_USERNAME, &APN_USERNAME_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, read_apn_username, NULL,
+				bcs.apn.username),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_APN_USERNAME, apn_username),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_APN_PASSWORD, &APN_PASSWORD_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, read_apn_password, NULL,
+				bcs.apn.password),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_APN_PASSWORD, apn_password),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_NETWORK_STATE,
+				&NETWORK_STATE_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, lbt_read_u8, NULL,
+				&bcs.network_state),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_NETWORK_STATE, network_state),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_STARTUP_STATE,
+				&STARTUP_STATE_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, lbt_read_u8, NULL,
+				&bcs.startup_state),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_STARTUP_STATE, startup_state),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_RSSI, &RSSI_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, lbt_read_integer, NULL,
+				&bcs.rssi),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_RSSI, rssi),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_SINR, &SINR_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, lbt_read_integer, NULL,
+				&bcs.sinr),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_SINR, sinr),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_SLEEP_STATE, &SLEEP_STATE_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, lbt_read_u8, NULL,
+				&bcs.sleep_state),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_SLEEP_STATE, sleep_state),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_RAT, &RAT_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE |
+					BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+				lbt_read_u8, write_rat, &bcs.rat),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_RAT, rat),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_ICCID, &ICCID_UUID.uuid,
+				BT_GATT_CHRC_READ,
+				BT_GATT_PERM_READ, read_iccid, NULL,
+				bcs.iccid),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_SERIAL_NUMBER,
+				&SERIAL_NUMBER_UUID.uuid,
+				BT_GATT_CHRC_READ,
+				BT_GATT_PERM_READ, read_serial_number, NULL,
+				bcs.serial_number),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_BANDS, &BANDS_UUID.uuid,
+				BT_GATT_CHRC_READ,
+				BT_GATT_PERM_READ, read_bands, NULL,
+				bcs.bands),
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_ACTIVE_BANDS, &ACTIVE_BANDS_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, read_bands, NULL,
+				bcs.active_bands),
+	LBT_GATT_CHARACTERISTIC_CCC(CELL_ATTR_ACTIVE_BANDS, active_bands),
+#ifdef CONFIG_BLE_CELLULAR_SERVICE_SNAPSHOT
+	LBT_GATT_CHARACTERISTIC(CELL_ATTR_SNAPSHOT, &SNAPSHOT_UUID.uuid,
+				BT_GATT_CHRC_READ,
+				BT_GATT_PERM_READ, lbt_read_snapshot, NULL,
+				&cell_snapshot),
+#endif
 };
 
+LBT_GATT_BUILD_ASSERT_ATTR_COUNT(cell_attrs, CELL_ATTR_COUNT);
+
 static struct bt_gatt_service cell_svc = BT_GATT_SERVICE(cell_attrs);
 
 static struct bt_conn_cb cell_svc_conn_callbacks = {
@@ -239,21 +325,21 @@ void cell_svc_set_imei(const char *imei)
 void cell_svc_set_network_state(uint8_t state)
 {
 	bcs.network_state = state;
-	cell_svc_notify(ccc.network_state.notify, bcs.network_state_index,
+	cell_svc_notify(ccc.network_state.notify, CELL_ATTR_NETWORK_STATE,
 			sizeof(bcs.network_state));
 }
 
 void cell_svc_set_startup_state(uint8_t state)
 {
 	bcs.startup_state = state;
-	cell_svc_notify(ccc.startup_state.notify, bcs.startup_state_index,
+	cell_svc_notify(ccc.startup_state.notify, CELL_ATTR_STARTUP_STATE,
 			sizeof(bcs.startup_state));
 }
 
 void cell_svc_set_sleep_state(uint8_t state)
 {
 	bcs.sleep_state = state;
-	cell_svc_notify(ccc.sleep_state.notify, bcs.sleep_state_index,
+	cell_svc_notify(ccc.sleep_state.notify, CELL_ATTR_SLEEP_STATE,
 			sizeof(bcs.sleep_state));
 }
 
@@ -261,24 +347,24 @@ void cell_svc_set_apn(struct mdm_hl7800_apn *access_point)
 {
 	__ASSERT_NO_MSG(access_point != NULL);
 	memcpy(&bcs.apn, access_point, sizeof(struct mdm_hl7800_apn));
-	cell_svc_notify(ccc.apn_value.notify, bcs.apn_index,
+	cell_svc_notify(ccc.apn_value.notify, CELL_ATTR_APN,
 			strlen(bcs.apn.value));
-	cell_svc_notify(ccc.apn_username.notify, bcs.apn_username_index,
+	cell_svc_notify(ccc.apn_username.notify, CELL_ATTR_APN_USERNAME,
 			strlen(bcs.apn.username));
-	cell_svc_notify(ccc.apn_password.notify, bcs.apn_password_index,
+	cell_svc_notify(ccc.apn_password.notify, CELL_ATTR_APN_PASSWORD,
 			strlen(bcs.apn.password));
 }
 
 void cell_svc_set_rssi(int value)
 {
 	bcs.rssi = (int32_t)value;
-	cell_svc_notify(ccc.rssi.notify, bcs.rssi_index, sizeof(bcs.rssi));
+	cell_svc_notify(ccc.rssi.notify, CELL_ATTR_RSSI, sizeof(bcs.rssi));
 }
 
 void cell_svc_set_sinr(int value)
 {
 	bcs.sinr = (int32_t)value;
-	cell_svc_notify(ccc.sinr.notify, bcs.sinr_index, sizeof(bcs.sinr));
+	cell_svc_notify(ccc.sinr.notify, CELL_ATTR_SINR, sizeof(bcs.sinr));
 }
 
 void cell_svc_set_fw_ver(const char *ver)
@@ -290,7 +376,7 @@ void cell_svc_set_fw_ver(const char *ver)
 void cell_svc_set_rat(uint8_t value)
 {
 	bcs.rat = value;
-	cell_svc_notify(ccc.rat.notify, bcs.rat_index, sizeof(bcs.rat));
+	cell_svc_notify(ccc.rat.notify, CELL_ATTR_RAT, sizeof(bcs.rat));
 }
 
 void cell_svc_set_iccid(const char *value)
@@ -322,29 +408,6 @@ void cell_svc_init()
 	bt_gatt_service_register(&cell_svc);
 
 	bt_conn_cb_register(&cell_svc_conn_callbacks);
-
-	size_t gatt_size = (sizeof(cell_attrs) / sizeof(cell_attrs[0]));
-	bcs.apn_index =
-		lbt_find_gatt_index(&APN_UUID.uuid, cell_attrs, gatt_size);
-	bcs.apn_username_index = lbt_find_gatt_index(&APN_USERNAME_UUID.uuid,
-						     cell_attrs, gatt_size);
-	bcs.apn_password_index = lbt_find_gatt_index(&APN_PASSWORD_UUID.uuid,
-						     cell_attrs, gatt_size);
-	bcs.network_state_index = lbt_find_gatt_index(&NETWORK_STATE_UUID.uuid,
-						      cell_attrs, gatt_size);
-	bcs.startup_state_index = lbt_find_gatt_index(&STARTUP_STATE_UUID.uuid,
-						      cell_attrs, gatt_size);
-	bcs.rssi_index =
-		lbt_find_gatt_index(&RSSI_UUID.uuid, cell_attrs, gatt_size);
-	bcs.sinr_index =
-		lbt_find_gatt_index(&SINR_UUID.uuid, cell_attrs, gatt_size);
-	bcs.sleep_state_index = lbt_find_gatt_index(&SLEEP_STATE_UUID.uuid,
-						    cell_attrs, gatt_size);
-	bcs.rat_index =
-		lbt_find_gatt_index(&RAT_UUID.uuid, cell_attrs, gatt_size);
-
-	bcs.active_bands_index = lbt_find_gatt_index(&ACTIVE_BANDS_UUID.uuid,
-						     cell_attrs, gatt_size);
 }
 
 /******************************************************************************/
@@ -506,6 +569,12 @@ static void active_bands_ccc_handler(const struct bt_gatt_attr *attr,
 
 static void cell_svc_notify(bool notify, uint16_t index, uint16_t length)
 {
+#ifdef CONFIG_LCZ_BT_NOTIFY
+	if (notify) {
+		lcz_bt_notify(&cell_svc.attrs[index],
+			      cell_svc.attrs[index].user_data, length);
+	}
+#else
 	struct bt_conn *connection_handle = cell_svc_get_conn();
 	if (connection_handle != NULL) {
 		if (notify) {
@@ -514,6 +583,7 @@ static void cell_svc_notify(bool notify, uint16_t index, uint16_t length)
 				       cell_svc.attrs[index].user_data, length);
 		}
 	}
+#endif
 }
 
 static void cell_svc_connected(struct bt_conn *conn, uint8_t err)
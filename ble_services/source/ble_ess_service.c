@@ -31,6 +31,9 @@ LOG_MODULE_REGISTER(ble_ess_svc, CONFIG_BLE_ESS_SERVICE_LOG_LEVEL);
 #include <bluetooth/gatt.h>
 
 #include "lcz_bluetooth.h"
+#ifdef CONFIG_LCZ_BT_NOTIFY
+#include "lcz_bt_notify.h"
+#endif
 #include "ble_ess_service.h"
 
 /******************************************************************************/
@@ -58,11 +61,20 @@ struct ble_ess_service {
 	struct humidity_sensor_s humidity_sensor;
 	struct pressure_sensor_s pressure_sensor;
 	struct dew_point_sensor_s dew_point_sensor;
+};
 
-	uint16_t temperature_index;
-	uint16_t humidity_index;
-	uint16_t pressure_index;
-	uint16_t dew_point_index;
+/* Order of ess_attrs */
+enum ess_attr {
+	LBT_GATT_ATTR_PRIMARY_SERVICE(ESS_ATTR_SVC),
+	LBT_GATT_ATTR_CHRC(ESS_ATTR_TEMPERATURE),
+	LBT_GATT_ATTR_CCC(ESS_ATTR_TEMPERATURE),
+	LBT_GATT_ATTR_CHRC(ESS_ATTR_HUMIDITY),
+	LBT_GATT_ATTR_CCC(ESS_ATTR_HUMIDITY),
+	LBT_GATT_ATTR_CHRC(ESS_ATTR_PRESSURE),
+	LBT_GATT_ATTR_CCC(ESS_ATTR_PRESSURE),
+	LBT_GATT_ATTR_CHRC(ESS_ATTR_DEW_POINT),
+	LBT_GATT_ATTR_CCC(ESS_ATTR_DEW_POINT),
+	ESS_ATTR_COUNT
 };
 
 struct ccc_table {
@@ -94,6 +106,9 @@ static void pressure_ccc_handler(const struct bt_gatt_attr *attr,
 static void dew_point_ccc_handler(const struct bt_gatt_attr *attr,
 				  uint16_t value);
 
+static void ess_svc_notify(struct bt_conn *conn, uint16_t index,
+			   const void *data, uint16_t len);
+
 static void ess_svc_connected(struct bt_conn *conn, uint8_t err);
 
 static void ess_svc_disconnected(struct bt_conn *conn, uint8_t reason);
@@ -102,37 +117,39 @@ static void ess_svc_disconnected(struct bt_conn *conn, uint8_t reason);
 /* ESS Service Declaration                                                    */
 /******************************************************************************/
 static struct bt_gatt_attr ess_attrs[] = {
-	BT_GATT_PRIMARY_SERVICE(BT_UUID_ESS),
+	LBT_GATT_PRIMARY_SERVICE(ESS_ATTR_SVC, BT_UUID_ESS),
 
 	/* Temperature Characteristic */
-	BT_GATT_CHARACTERISTIC(BT_UUID_TEMPERATURE,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ,
-			       lbt_read_u16, NULL, &ess.temperature_sensor.temperature_value),
-	LBT_GATT_CCC(temperature),
+	LBT_GATT_CHARACTERISTIC(ESS_ATTR_TEMPERATURE, BT_UUID_TEMPERATURE,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ,
+				lbt_read_u16, NULL, &ess.temperature_sensor.temperature_value),
+	LBT_GATT_CHARACTERISTIC_CCC(ESS_ATTR_TEMPERATURE, temperature),
 
 	/* Humidity Characteristic */
-	BT_GATT_CHARACTERISTIC(BT_UUID_HUMIDITY,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ,
-			       lbt_read_u16, NULL, &ess.humidity_sensor.humidity_value),
-	LBT_GATT_CCC(humidity),
+	LBT_GATT_CHARACTERISTIC(ESS_ATTR_HUMIDITY, BT_UUID_HUMIDITY,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ,
+				lbt_read_u16, NULL, &ess.humidity_sensor.humidity_value),
+	LBT_GATT_CHARACTERISTIC_CCC(ESS_ATTR_HUMIDITY, humidity),
 
 	/* Pressure Characteristic */
-	BT_GATT_CHARACTERISTIC(BT_UUID_PRESSURE,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ,
-			       lbt_read_u32, NULL, &ess.pressure_sensor.pressure_value),
-	LBT_GATT_CCC(pressure),
+	LBT_GATT_CHARACTERISTIC(ESS_ATTR_PRESSURE, BT_UUID_PRESSURE,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ,
+				lbt_read_u32, NULL, &ess.pressure_sensor.pressure_value),
+	LBT_GATT_CHARACTERISTIC_CCC(ESS_ATTR_PRESSURE, pressure),
 
 	/* Dew-Point Characteristic */
-	BT_GATT_CHARACTERISTIC(BT_UUID_DEW_POINT,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ,
-			       lbt_read_u8, NULL, &ess.dew_point_sensor.dew_point_value),
-	LBT_GATT_CCC(dew_point),
+	LBT_GATT_CHARACTERISTIC(ESS_ATTR_DEW_POINT, BT_UUID_DEW_POINT,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ,
+				lbt_read_u8, NULL, &ess.dew_point_sensor.dew_point_value),
+	LBT_GATT_CHARACTERISTIC_CCC(ESS_ATTR_DEW_POINT, dew_point),
 };
 
+LBT_GATT_BUILD_ASSERT_ATTR_COUNT(ess_attrs, ESS_ATTR_COUNT);
+
 static struct bt_gatt_service ess_svc = BT_GATT_SERVICE(ess_attrs);
 
 static struct bt_conn_cb ess_svc_conn_callbacks = {
@@ -153,7 +170,7 @@ void ess_svc_update_temperature(struct bt_conn *conn, int16_t value)
 	if (ccc.temperature.notify) {
 		/* Send notification */
 		value = sys_cpu_to_le16(value);
-		bt_gatt_notify(conn, &ess_svc.attrs[ess.temperature_index], &value, sizeof(value));
+		ess_svc_notify(conn, ESS_ATTR_TEMPERATURE, &value, sizeof(value));
 	}
 }
 
@@ -166,7 +183,7 @@ void ess_svc_update_humidity(struct bt_conn *conn, int16_t value)
 	if (ccc.humidity.notify) {
 		/* Send notification */
 		value = sys_cpu_to_le16(value);
-		bt_gatt_notify(conn, &ess_svc.attrs[ess.humidity_index], &value, sizeof(value));
+		ess_svc_notify(conn, ESS_ATTR_HUMIDITY, &value, sizeof(value));
 	}
 }
 
@@ -179,7 +196,7 @@ void ess_svc_update_pressure(struct bt_conn *conn, int32_t value)
 	if (ccc.pressure.notify) {
 		/* Send notification */
 		value = sys_cpu_to_le32(value);
-		bt_gatt_notify(conn, &ess_svc.attrs[ess.pressure_index], &value, sizeof(value));
+		ess_svc_notify(conn, ESS_ATTR_PRESSURE, &value, sizeof(value));
 	}
 }
 
@@ -191,7 +208,7 @@ void ess_svc_update_dew_point(struct bt_conn *conn, int8_t value)
 
 	if (ccc.dew_point.notify) {
 		/* Send notification */
-		bt_gatt_notify(conn, &ess_svc.attrs[ess.dew_point_index], &value, sizeof(value));
+		ess_svc_notify(conn, ESS_ATTR_DEW_POINT, &value, sizeof(value));
 	}
 }
 
@@ -201,13 +218,6 @@ void ess_svc_init()
 
 	bt_conn_cb_register(&ess_svc_conn_callbacks);
 
-	/* Calculate indexes of characteristics */
-	size_t gatt_size = (sizeof(ess_attrs) / sizeof(ess_attrs[0]));
-	ess.temperature_index = lbt_find_gatt_index(BT_UUID_TEMPERATURE, ess_attrs, gatt_size);
-	ess.humidity_index = lbt_find_gatt_index(BT_UUID_HUMIDITY, ess_attrs, gatt_size);
-	ess.pressure_index = lbt_find_gatt_index(BT_UUID_PRESSURE, ess_attrs, gatt_size);
-	ess.dew_point_index = lbt_find_gatt_index(BT_UUID_DEW_POINT, ess_attrs, gatt_size);
-
 	/* Reset all readings to defaults */
 	ess.temperature_sensor.temperature_value = 0;
 	ess.humidity_sensor.humidity_value = 0;
@@ -246,6 +256,18 @@ static void dew_point_ccc_handler(const struct bt_gatt_attr *attr,
 	ess_notifications_changed(ESS_TYPE_DEW_POINT, ccc.dew_point.notify);
 }
 
+/* With coalescing enabled, the value is sent to every subscribed connection */
+static void ess_svc_notify(struct bt_conn *conn, uint16_t index,
+			   const void *data, uint16_t len)
+{
+#ifdef CONFIG_LCZ_BT_NOTIFY
+	ARG_UNUSED(conn);
+	lcz_bt_notify(&ess_svc.attrs[index], data, len);
+#else
+	bt_gatt_notify(conn, &ess_svc.attrs[index], data, len);
+#endif
+}
+
 static void ess_svc_connected(struct bt_conn *conn, uint8_t err)
 {
 	if (err) {
@@ -23,6 +23,9 @@ LOG_MODULE_REGISTER(ble_power_svc, CONFIG_BLE_POWER_SERVICE_LOG_LEVEL);
 #include <bluetooth/bluetooth.h>
 
 #include "lcz_bluetooth.h"
+#ifdef CONFIG_LCZ_BT_NOTIFY
+#include "lcz_bt_notify.h"
+#endif
 #include "ble_power_service.h"
 #include "laird_power.h"
 
@@ -47,8 +50,17 @@ struct ble_power_service {
 #ifdef CONFIG_REBOOT
 	uint8_t reboot;
 #endif
+};
 
-	uint16_t voltage_index;
+/* Order of power_attrs */
+enum power_attr {
+	LBT_GATT_ATTR_PRIMARY_SERVICE(POWER_ATTR_SVC),
+	LBT_GATT_ATTR_CHRC(POWER_ATTR_VOLTAGE),
+	LBT_GATT_ATTR_CCC(POWER_ATTR_VOLTAGE),
+#ifdef CONFIG_REBOOT
+	LBT_GATT_ATTR_CHRC(POWER_ATTR_REBOOT),
+#endif
+	POWER_ATTR_COUNT
 };
 
 struct ccc_table {
@@ -82,18 +94,20 @@ static void power_svc_disconnected(struct bt_conn *conn, uint8_t reason);
 /* Power Service Declaration                                                  */
 /******************************************************************************/
 static struct bt_gatt_attr power_attrs[] = {
-	BT_GATT_PRIMARY_SERVICE(&POWER_SVC_UUID),
-	BT_GATT_CHARACTERISTIC(&VOLTAGE_UUID.uuid, BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_NONE, NULL, NULL, &bps.voltage),
-	LBT_GATT_CCC(voltage)
+	LBT_GATT_PRIMARY_SERVICE(POWER_ATTR_SVC, &POWER_SVC_UUID),
+	LBT_GATT_CHARACTERISTIC(POWER_ATTR_VOLTAGE, &VOLTAGE_UUID.uuid,
+				BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_NONE, NULL,
+				NULL, &bps.voltage),
+	LBT_GATT_CHARACTERISTIC_CCC(POWER_ATTR_VOLTAGE, voltage),
 #ifdef CONFIG_REBOOT
-		,
-	BT_GATT_CHARACTERISTIC(&REBOOT_UUID.uuid, BT_GATT_CHRC_WRITE,
-			       BT_GATT_PERM_WRITE, NULL, write_power_reboot,
-			       &bps.reboot),
+	LBT_GATT_CHARACTERISTIC(POWER_ATTR_REBOOT, &REBOOT_UUID.uuid,
+				BT_GATT_CHRC_WRITE, BT_GATT_PERM_WRITE, NULL,
+				write_power_reboot, &bps.reboot),
 #endif
 };
 
+LBT_GATT_BUILD_ASSERT_ATTR_COUNT(power_attrs, POWER_ATTR_COUNT);
+
 static struct bt_gatt_service power_svc = BT_GATT_SERVICE(power_attrs);
 
 static struct bt_conn_cb power_svc_conn_callbacks = {
@@ -106,6 +120,12 @@ static struct bt_conn_cb power_svc_conn_callbacks = {
 /******************************************************************************/
 static void power_svc_notify(bool notify, uint16_t index, uint16_t length)
 {
+#ifdef CONFIG_LCZ_BT_NOTIFY
+	if (notify) {
+		lcz_bt_notify(&power_svc.attrs[index],
+			      power_svc.attrs[index].user_data, length);
+	}
+#else
 	struct bt_conn *connection_handle = power_svc_get_conn();
 	if (connection_handle != NULL) {
 		if (notify) {
@@ -115,13 +135,14 @@ static void power_svc_notify(bool notify, uint16_t index, uint16_t length)
 				       length);
 		}
 	}
+#endif
 }
 
 void power_svc_set_voltage(uint8_t integer, uint8_t decimal)
 {
 	bps.voltage.voltage_int = integer;
 	bps.voltage.voltage_dec = decimal;
-	power_svc_notify(ccc.voltage.notify, bps.voltage_index,
+	power_svc_notify(ccc.voltage.notify, POWER_ATTR_VOLTAGE,
 			 sizeof(bps.voltage));
 }
 
@@ -130,10 +151,6 @@ void power_svc_init()
 	bt_gatt_service_register(&power_svc);
 
 	bt_conn_cb_register(&power_svc_conn_callbacks);
-
-	size_t gatt_size = (sizeof(power_attrs) / sizeof(power_attrs[0]));
-	bps.voltage_index =
-		lbt_find_gatt_index(&VOLTAGE_UUID.uuid, power_attrs, gatt_size);
 }
 
 /******************************************************************************/
@@ -23,8 +23,14 @@ LOG_MODULE_REGISTER(fota);
 #endif
 
 #include "lcz_bluetooth.h"
+#ifdef CONFIG_LCZ_BT_NOTIFY
+#include "lcz_bt_notify.h"
+#endif
 #include "file_system_utilities.h"
 #include "fota.h"
+#ifdef CONFIG_FOTA_L2CAP
+#include "fota_l2cap.h"
+#endif
 
 /******************************************************************************/
 /* Local Constant, Macro and Type Definitions                                 */
@@ -53,16 +59,27 @@ struct fota {
 	char file_name[CONFIG_FOTA_FILE_NAME_MAX_SIZE];
 	uint8_t hash[FSU_HASH_SIZE];
 
-	uint16_t status_index;
-	uint16_t count_index;
-	uint16_t size_index;
-	uint16_t file_name_index;
-	uint16_t hash_index;
-
 	struct k_work_q work_q;
 	struct k_work work;
 };
 
+/* Order of fota_attrs */
+enum fota_attr {
+	LBT_GATT_ATTR_PRIMARY_SERVICE(FOTA_ATTR_SVC),
+	LBT_GATT_ATTR_CHRC(FOTA_ATTR_CONTROL_POINT),
+	LBT_GATT_ATTR_CHRC(FOTA_ATTR_STATUS),
+	LBT_GATT_ATTR_CCC(FOTA_ATTR_STATUS),
+	LBT_GATT_ATTR_CHRC(FOTA_ATTR_COUNT),
+	LBT_GATT_ATTR_CCC(FOTA_ATTR_COUNT),
+	LBT_GATT_ATTR_CHRC(FOTA_ATTR_SIZE),
+	LBT_GATT_ATTR_CCC(FOTA_ATTR_SIZE),
+	LBT_GATT_ATTR_CHRC(FOTA_ATTR_FILE_NAME),
+	LBT_GATT_ATTR_CCC(FOTA_ATTR_FILE_NAME),
+	LBT_GATT_ATTR_CHRC(FOTA_ATTR_HASH),
+	LBT_GATT_ATTR_CCC(FOTA_ATTR_HASH),
+	FOTA_ATTR_TOTAL
+};
+
 struct ccc_table {
 	struct lbt_ccc_element status;
 	struct lbt_ccc_element count;
@@ -124,36 +141,43 @@ static void fota_build_full_name(const char *name);
 /* FOTA Service Declaration                                                   */
 /******************************************************************************/
 static struct bt_gatt_attr fota_attrs[] = {
-	BT_GATT_PRIMARY_SERVICE(&FOTA_UUID),
-	BT_GATT_CHARACTERISTIC(&FOTA_CONTROL_POINT_UUID.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
-			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-			       lbt_read_u8, write_control_point,
-			       &fota.control_point),
-	BT_GATT_CHARACTERISTIC(
-		&FOTA_STATUS.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-		BT_GATT_PERM_READ, lbt_read_integer, NULL, &fota.status),
-	LBT_GATT_CCC(status),
-	BT_GATT_CHARACTERISTIC(
-		&FOTA_COUNT.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-		BT_GATT_PERM_READ, lbt_read_u32, NULL, &fota.count),
-	LBT_GATT_CCC(count),
-	BT_GATT_CHARACTERISTIC(
-		&FOTA_SIZE.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-		BT_GATT_PERM_READ, lbt_read_u32, NULL, &fota.size),
-	LBT_GATT_CCC(size),
-	BT_GATT_CHARACTERISTIC(&FOTA_FILE_NAME.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE |
-				       BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-			       read_file_name, write_file_name, fota.file_name),
-	LBT_GATT_CCC(file_name),
-	BT_GATT_CHARACTERISTIC(&FOTA_HASH.uuid,
-			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-			       BT_GATT_PERM_READ, read_hash, NULL, &fota.hash),
-	LBT_GATT_CCC(hash)
+	LBT_GATT_PRIMARY_SERVICE(FOTA_ATTR_SVC, &FOTA_UUID),
+	LBT_GATT_CHARACTERISTIC(FOTA_ATTR_CONTROL_POINT,
+				&FOTA_CONTROL_POINT_UUID.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+				BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+				lbt_read_u8, write_control_point,
+				&fota.control_point),
+	LBT_GATT_CHARACTERISTIC(FOTA_ATTR_STATUS, &FOTA_STATUS.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, lbt_read_integer, NULL,
+				&fota.status),
+	LBT_GATT_CHARACTERISTIC_CCC(FOTA_ATTR_STATUS, status),
+	LBT_GATT_CHARACTERISTIC(FOTA_ATTR_COUNT, &FOTA_COUNT.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, lbt_read_u32, NULL,
+				&fota.count),
+	LBT_GATT_CHARACTERISTIC_CCC(FOTA_ATTR_COUNT, count),
+	LBT_GATT_CHARACTERISTIC(FOTA_ATTR_SIZE, &FOTA_SIZE.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, lbt_read_u32, NULL,
+				&fota.size),
+	LBT_GATT_CHARACTERISTIC_CCC(FOTA_ATTR_SIZE, size),
+	LBT_GATT_CHARACTERISTIC(FOTA_ATTR_FILE_NAME, &FOTA_FILE_NAME.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE |
+					BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+				read_file_name, write_file_name,
+				fota.file_name),
+	LBT_GATT_CHARACTERISTIC_CCC(FOTA_ATTR_FILE_NAME, file_name),
+	LBT_GATT_CHARACTERISTIC(FOTA_ATTR_HASH, &FOTA_HASH.uuid,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, read_hash, NULL, &fota.hash),
+	LBT_GATT_CHARACTERISTIC_CCC(FOTA_ATTR_HASH, hash),
 };
 
+LBT_GATT_BUILD_ASSERT_ATTR_COUNT(fota_attrs, FOTA_ATTR_TOTAL);
+
 static struct bt_gatt_service fota_svc = BT_GATT_SERVICE(fota_attrs);
 
 static struct bt_conn_cb fota_conn_callbacks = {
@@ -167,26 +191,26 @@ static struct bt_conn_cb fota_conn_callbacks = {
 void fota_set_status(int status)
 {
 	fota.status = status;
-	fota_notify(ccc.status.notify, fota.status_index, sizeof(fota.status));
+	fota_notify(ccc.status.notify, FOTA_ATTR_STATUS, sizeof(fota.status));
 }
 
 void fota_set_count(uint32_t count)
 {
 	fota.count = count;
-	fota_notify(ccc.count.notify, fota.count_index, sizeof(fota.count));
+	fota_notify(ccc.count.notify, FOTA_ATTR_COUNT, sizeof(fota.count));
 }
 
 void fota_set_size(uint32_t size)
 {
 	fota.size = size;
-	fota_notify(ccc.size.notify, fota.size_index, sizeof(fota.size));
+	fota_notify(ccc.size.notify, FOTA_ATTR_SIZE, sizeof(fota.size));
 }
 
 void fota_set_file_name(const char *name)
 {
 	__ASSERT_NO_MSG(name != NULL);
 	strncpy(fota.file_name, name, CONFIG_FOTA_FILE_NAME_MAX_SIZE - 1);
-	fota_notify(ccc.file_name.notify, fota.file_name_index,
+	fota_notify(ccc.file_name.notify, FOTA_ATTR_FILE_NAME,
 		    strlen(fota.file_name));
 }
 
@@ -194,7 +218,7 @@ void fota_set_hash(const uint8_t *hash)
 {
 	__ASSERT_NO_MSG(hash != NULL);
 	memcpy(fota.hash, hash, FSU_HASH_SIZE);
-	fota_notify(ccc.hash.notify, fota.hash_index, sizeof(fota.hash));
+	fota_notify(ccc.hash.notify, FOTA_ATTR_HASH, sizeof(fota.hash));
 }
 
 void fota_init()
@@ -203,24 +227,16 @@ void fota_init()
 
 	bt_conn_cb_register(&fota_conn_callbacks);
 
-	size_t gatt_size = ARRAY_SIZE(fota_attrs);
-	fota.status_index =
-		lbt_find_gatt_index(&FOTA_STATUS.uuid, fota_attrs, gatt_size);
-	fota.count_index =
-		lbt_find_gatt_index(&FOTA_COUNT.uuid, fota_attrs, gatt_size);
-	fota.size_index =
-		lbt_find_gatt_index(&FOTA_SIZE.uuid, fota_attrs, gatt_size);
-	fota.file_name_index = lbt_find_gatt_index(&FOTA_FILE_NAME.uuid,
-						   fota_attrs, gatt_size);
-	fota.hash_index =
-		lbt_find_gatt_index(&FOTA_HASH.uuid, fota_attrs, gatt_size);
-
 	k_work_queue_start(&fota.work_q, fcs_workq_stack,
 			   K_THREAD_STACK_SIZEOF(fcs_workq_stack),
 			   FOTA_WORKQ_THREAD_PRIORITY);
 
 	/* The system q isn't used because fota can take a long time */
 	k_work_init(&fota.work, workq_fota_handler);
+
+#ifdef CONFIG_FOTA_L2CAP
+	fota_l2cap_init();
+#endif
 }
 
 void fota_state_handler(uint8_t state)
@@ -259,6 +275,12 @@ __weak struct bt_conn *fota_get_conn(void)
 
 static void fota_notify(bool notify, uint16_t index, uint16_t length)
 {
+#ifdef CONFIG_LCZ_BT_NOTIFY
+	if (notify) {
+		lcz_bt_notify(&fota_svc.attrs[index],
+			      fota_svc.attrs[index].user_data, length);
+	}
+#else
 	struct bt_conn *connection_handle = fota_get_conn();
 	if (connection_handle != NULL) {
 		if (notify) {
@@ -267,6 +289,7 @@ static void fota_notify(bool notify, uint16_t index, uint16_t length)
 				       fota_svc.attrs[index].user_data, length);
 		}
 	}
+#endif
 }
 
 static void fota_connected(struct bt_conn *conn, uint8_t err)
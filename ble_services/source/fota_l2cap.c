@@ -0,0 +1,379 @@
+/**
+ * @file fota_l2cap.c
+ * @brief File upload over an L2CAP connection-oriented channel.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(fota_l2cap, CONFIG_FOTA_L2CAP_LOG_LEVEL);
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr.h>
+#include <fs/fs.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/l2cap.h>
+#include <sys/byteorder.h>
+
+#include "file_system_utilities.h"
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+#include "encrypted_file_storage.h"
+#endif
+#if defined(CONFIG_LCZ_FS_MGMT_FILE_ACCESS_HOOK)
+#include "lcz_fs_mgmt/lcz_fs_mgmt.h"
+#endif
+#include "fota.h"
+#include "fota_l2cap.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define SDU_SIZE CONFIG_FOTA_L2CAP_SDU_SIZE
+#define SDU_COUNT CONFIG_FOTA_L2CAP_SDU_COUNT
+
+/* Data is written to a temporary file that replaces the file when the upload completes */
+#define TEMP_SUFFIX ".tmp"
+
+BUILD_ASSERT(SDU_SIZE > sizeof(struct fota_l2cap_header) + CONFIG_FSU_MAX_FILE_NAME_SIZE,
+	     "SDU must hold upload header");
+
+enum chan_state {
+	CHAN_FREE = 0,
+	CHAN_CONNECTED,
+	/* Waiting for received SDUs to be released */
+	CHAN_DISCONNECTING,
+};
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static int accept_cb(struct bt_conn *conn, struct bt_l2cap_chan **chan);
+static void connected_cb(struct bt_l2cap_chan *chan);
+static void disconnected_cb(struct bt_l2cap_chan *chan);
+static struct net_buf *alloc_buf_cb(struct bt_l2cap_chan *chan);
+static int recv_cb(struct bt_l2cap_chan *chan, struct net_buf *buf);
+
+static void rx_work_handler(struct k_work *work);
+static int process_header(struct net_buf *buf);
+static int write_data(const uint8_t *data, size_t len);
+static void end_transfer(int status);
+static void send_status(int status);
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+/* Received SDUs aren't released until they have been written to the file */
+NET_BUF_POOL_FIXED_DEFINE(rx_pool, SDU_COUNT, SDU_SIZE, NULL);
+
+NET_BUF_POOL_FIXED_DEFINE(tx_pool, 1, BT_L2CAP_SDU_BUF_SIZE(sizeof(struct fota_l2cap_status)),
+			  NULL);
+
+static const struct bt_l2cap_chan_ops chan_ops = {
+	.alloc_buf = alloc_buf_cb,
+	.recv = recv_cb,
+	.connected = connected_cb,
+	.disconnected = disconnected_cb,
+};
+
+static struct bt_l2cap_server server = {
+	.psm = CONFIG_FOTA_L2CAP_PSM,
+	.sec_level = CONFIG_FOTA_L2CAP_SEC_LEVEL,
+	.accept = accept_cb,
+};
+
+static struct {
+	atomic_t state;
+	struct bt_l2cap_le_chan chan;
+	struct k_fifo rx_fifo;
+	struct k_work rx_work;
+	struct k_work_q work_q;
+
+	/* Accessed only from work queue */
+	bool receiving;
+	struct fs_file_t file;
+	uint32_t size;
+	uint32_t offset;
+	char path[FSU_MAX_ABS_PATH_SIZE + 1];
+	char temp_path[FSU_MAX_ABS_PATH_SIZE + sizeof(TEMP_SUFFIX)];
+} ftl;
+
+K_THREAD_STACK_DEFINE(fota_l2cap_workq_stack, CONFIG_FOTA_L2CAP_WORKQ_STACK_SIZE);
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int fota_l2cap_init(void)
+{
+	int r;
+
+	k_fifo_init(&ftl.rx_fifo);
+	k_work_init(&ftl.rx_work, rx_work_handler);
+
+	/* File system writes can take a long time; the system queue isn't used */
+	k_work_queue_start(&ftl.work_q, fota_l2cap_workq_stack,
+			   K_THREAD_STACK_SIZEOF(fota_l2cap_workq_stack),
+			   K_PRIO_PREEMPT(CONFIG_FOTA_L2CAP_WORKQ_PRIORITY), NULL);
+
+	r = bt_l2cap_server_register(&server);
+	if (r < 0) {
+		LOG_ERR("Unable to register L2CAP server %d", r);
+	}
+	return r;
+}
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+/* Bluetooth RX thread */
+static int accept_cb(struct bt_conn *conn, struct bt_l2cap_chan **chan)
+{
+	ARG_UNUSED(conn);
+
+	if (!atomic_cas(&ftl.state, CHAN_FREE, CHAN_CONNECTED)) {
+		LOG_WRN("Transfer channel in use");
+		return -ENOMEM;
+	}
+
+	memset(&ftl.chan, 0, sizeof(ftl.chan));
+	ftl.chan.chan.ops = &chan_ops;
+	ftl.chan.rx.mtu = SDU_SIZE;
+	/* Credits are per PDU, so a client could start an SDU with each of them.
+	 * One credit per receive buffer allows the next SDU while one is being written;
+	 * the stack adds the credits that are needed to complete a segmented SDU.
+	 */
+	ftl.chan.rx.init_credits = SDU_COUNT;
+
+	*chan = &ftl.chan.chan;
+	return 0;
+}
+
+static void connected_cb(struct bt_l2cap_chan *chan)
+{
+	LOG_INF("Transfer channel connected rx mtu: %u tx mtu: %u", BT_L2CAP_LE_CHAN(chan)->rx.mtu,
+		BT_L2CAP_LE_CHAN(chan)->tx.mtu);
+}
+
+static void disconnected_cb(struct bt_l2cap_chan *chan)
+{
+	ARG_UNUSED(chan);
+
+	LOG_INF("Transfer channel disconnected");
+	atomic_set(&ftl.state, CHAN_DISCONNECTING);
+	k_work_submit_to_queue(&ftl.work_q, &ftl.rx_work);
+}
+
+/* Bluetooth RX thread; it must not wait for the work queue. A client that
+ * sends more SDUs than it has credits for is disconnected.
+ */
+static struct net_buf *alloc_buf_cb(struct bt_l2cap_chan *chan)
+{
+	ARG_UNUSED(chan);
+	struct net_buf *buf;
+
+	buf = net_buf_alloc(&rx_pool, K_NO_WAIT);
+	if (buf == NULL) {
+		LOG_ERR("Transfer receive buffers exhausted");
+	}
+	return buf;
+}
+
+/* Credits for the SDU are returned after it has been written */
+static int recv_cb(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+	ARG_UNUSED(chan);
+
+	net_buf_put(&ftl.rx_fifo, buf);
+	k_work_submit_to_queue(&ftl.work_q, &ftl.rx_work);
+	return -EINPROGRESS;
+}
+
+static void rx_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+	struct net_buf *buf;
+	int r;
+
+	while ((buf = net_buf_get(&ftl.rx_fifo, K_NO_WAIT)) != NULL) {
+		if (atomic_get(&ftl.state) == CHAN_CONNECTED) {
+			if (!ftl.receiving) {
+				r = process_header(buf);
+			} else {
+				r = write_data(buf->data, buf->len);
+			}
+
+			if (r < 0) {
+				end_transfer(r);
+			} else if (ftl.receiving && ftl.offset == ftl.size) {
+				end_transfer(0);
+			}
+		}
+
+		if (bt_l2cap_chan_recv_complete(&ftl.chan.chan, buf) < 0) {
+			net_buf_unref(buf);
+		}
+	}
+
+	if (atomic_get(&ftl.state) == CHAN_DISCONNECTING) {
+		if (ftl.receiving) {
+			end_transfer(-ENOTCONN);
+		}
+		atomic_set(&ftl.state, CHAN_FREE);
+	}
+}
+
+static int process_header(struct net_buf *buf)
+{
+	struct fota_l2cap_header *hdr;
+	char name[CONFIG_FSU_MAX_FILE_NAME_SIZE];
+	int r;
+
+	if (buf->len < sizeof(*hdr)) {
+		return -EINVAL;
+	}
+
+	hdr = net_buf_pull_mem(buf, sizeof(*hdr));
+	if (hdr->opcode != FOTA_L2CAP_OPCODE_UPLOAD || hdr->name_length == 0 ||
+	    hdr->name_length > buf->len) {
+		return -EINVAL;
+	}
+
+	ftl.size = sys_le32_to_cpu(hdr->size);
+	ftl.offset = 0;
+
+	if (hdr->name[0] == '/') {
+		if (hdr->name_length >= sizeof(ftl.path)) {
+			return -ENAMETOOLONG;
+		}
+		memcpy(ftl.path, hdr->name, hdr->name_length);
+		ftl.path[hdr->name_length] = 0;
+		strncpy(name, strrchr(ftl.path, '/') + 1, sizeof(name) - 1);
+		name[sizeof(name) - 1] = 0;
+	} else {
+		if (hdr->name_length >= sizeof(name)) {
+			return -ENAMETOOLONG;
+		}
+		memcpy(name, hdr->name, hdr->name_length);
+		name[hdr->name_length] = 0;
+		r = fsu_build_full_name(ftl.path, sizeof(ftl.path), CONFIG_FOTA_FS_MOUNT, name);
+		if (r < 0) {
+			return r;
+		}
+	}
+	net_buf_pull(buf, hdr->name_length);
+
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+	/* Only plaintext files can be streamed */
+	if (efs_is_encrypted_path(ftl.path)) {
+		return -ENOTSUP;
+	}
+#endif
+
+#if defined(CONFIG_LCZ_FS_MGMT_FILE_ACCESS_HOOK)
+	if (!lcz_fs_mgmt_access_allowed(ftl.path, true)) {
+		return -EACCES;
+	}
+#endif
+
+	/* An upload that fails doesn't destroy the existing file */
+	snprintk(ftl.temp_path, sizeof(ftl.temp_path), "%s" TEMP_SUFFIX, ftl.path);
+	r = fsu_delete_abs(ftl.temp_path);
+	if (r < 0 && r != -ENOENT) {
+		return r;
+	}
+
+	fs_file_t_init(&ftl.file);
+	r = fs_open(&ftl.file, ftl.temp_path, FS_O_CREATE | FS_O_WRITE);
+	if (r < 0) {
+		return r;
+	}
+
+	LOG_INF("Upload of %s (%u bytes) started", ftl.path, ftl.size);
+	ftl.receiving = true;
+	fota_set_file_name(name);
+	fota_set_size(ftl.size);
+	fota_set_count(0);
+
+	/* Data may follow the name */
+	return write_data(buf->data, buf->len);
+}
+
+static int write_data(const uint8_t *data, size_t len)
+{
+	ssize_t written;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	if ((ftl.offset + len) > ftl.size) {
+		return -EFBIG;
+	}
+
+	written = fs_write(&ftl.file, data, len);
+	if (written < 0) {
+		return written;
+	} else if (written != len) {
+		return -ENOSPC;
+	}
+
+	ftl.offset += len;
+	fota_set_count(ftl.offset);
+	return 0;
+}
+
+static void end_transfer(int status)
+{
+	int r;
+
+	if (ftl.receiving) {
+		ftl.receiving = false;
+		r = fs_close(&ftl.file);
+		if (status == 0) {
+			status = r;
+		}
+		if (status == 0) {
+			/* The file may be kept open by the file system utilities */
+			(void)fsu_close_cached(ftl.path);
+			status = fs_rename(ftl.temp_path, ftl.path);
+		}
+		if (status < 0) {
+			(void)fsu_delete_abs(ftl.temp_path);
+		}
+	}
+
+	if (status < 0) {
+		LOG_ERR("Upload of %s failed at %u: %d", ftl.path, ftl.offset, status);
+	} else {
+		LOG_INF("Upload of %s complete", ftl.path);
+	}
+
+	if (atomic_get(&ftl.state) == CHAN_CONNECTED) {
+		send_status(status);
+	}
+}
+
+static void send_status(int status)
+{
+	struct net_buf *buf;
+	int r;
+
+	buf = net_buf_alloc(&tx_pool, K_MSEC(CONFIG_FOTA_L2CAP_STATUS_TIMEOUT_MS));
+	if (buf == NULL) {
+		LOG_ERR("Unable to allocate status");
+		return;
+	}
+
+	net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+	net_buf_add_le32(buf, (uint32_t)status);
+	net_buf_add_le32(buf, ftl.offset);
+
+	r = bt_l2cap_chan_send(&ftl.chan.chan, buf);
+	if (r < 0) {
+		LOG_ERR("Unable to send status %d", r);
+		net_buf_unref(buf);
+	}
+}
@@ -60,6 +60,9 @@ static struct bt_uuid_128 BOOTLOADER_COMPRESSION_LAST_FAIL_CODE_UUID = UBS_BASE_
 static struct bt_uuid_128 MODULE_BUILD_DATE_UUID = UBS_BASE_UUID_128(0x0019);
 static struct bt_uuid_128 FIRMWARE_BUILD_DATE_UUID = UBS_BASE_UUID_128(0x001a);
 static struct bt_uuid_128 BOOT_VERIFICATION_UUID = UBS_BASE_UUID_128(0x001b);
+#ifdef CONFIG_UNIVERSAL_BOOTLOADER_SERVICE_SNAPSHOT
+static struct bt_uuid_128 SNAPSHOT_UUID = UBS_BASE_UUID_128(0x001c);
+#endif
 /* clang-format on */
 
 struct universal_bootloader_service {
@@ -97,6 +100,52 @@ struct universal_bootloader_service {
 /******************************************************************************/
 static struct universal_bootloader_service ubs;
 
+#ifdef CONFIG_UNIVERSAL_BOOTLOADER_SERVICE_SNAPSHOT
+/* Tag is the lower byte of the UUID of the characteristic */
+static const struct lbt_snapshot_field ubs_snapshot_fields[] = {
+	LBT_SNAPSHOT_FIELD(0x01, ubs.bootloader_present),
+	LBT_SNAPSHOT_FIELD(0x02, ubs.bootloader_header_checked),
+	LBT_SNAPSHOT_FIELD(0x03, ubs.error_code),
+	LBT_SNAPSHOT_FIELD(0x04, ubs.bootloader_version),
+	LBT_SNAPSHOT_FIELD(0x05, ubs.ext_header_version),
+	LBT_SNAPSHOT_FIELD(0x06, ubs.ext_function_version),
+	LBT_SNAPSHOT_FIELD(0x07, ubs.customer_key_set),
+	LBT_SNAPSHOT_STRING(0x08, ubs.customer_key),
+	LBT_SNAPSHOT_FIELD(0x09, ubs.readback_protection),
+	LBT_SNAPSHOT_FIELD(0x0a, ubs.cpu_debug_protection),
+	LBT_SNAPSHOT_FIELD(0x0b, ubs.QSPI_checked),
+	LBT_SNAPSHOT_FIELD(0x0c, ubs.QSPI_crc),
+	LBT_SNAPSHOT_STRING(0x0d, ubs.QSPI_sha256),
+	LBT_SNAPSHOT_FIELD(0x0e, ubs.bootloader_type),
+	LBT_SNAPSHOT_FIELD(0x0f, ubs.bootloader_update_failures),
+	LBT_SNAPSHOT_FIELD(0x10, ubs.bootloader_update_last_fail_version),
+	LBT_SNAPSHOT_FIELD(0x11, ubs.bootloader_update_last_fail_code),
+	LBT_SNAPSHOT_FIELD(0x12, ubs.bootloader_updates_applied),
+	LBT_SNAPSHOT_FIELD(0x13, ubs.bootloader_section_updates_applied),
+	LBT_SNAPSHOT_FIELD(0x14, ubs.bootloader_modem_updates_applied),
+	LBT_SNAPSHOT_FIELD(0x15, ubs.bootloader_modem_update_last_fail_version),
+	LBT_SNAPSHOT_FIELD(0x16, ubs.bootloader_modem_update_last_fail_code),
+	LBT_SNAPSHOT_FIELD(0x17, ubs.bootloader_compression_errors),
+	LBT_SNAPSHOT_FIELD(0x18, ubs.bootloader_compression_last_fail_code),
+	LBT_SNAPSHOT_STRING(0x19, ubs.module_build_date),
+	LBT_SNAPSHOT_STRING(0x1a, ubs.firmware_build_date),
+	LBT_SNAPSHOT_FIELD(0x1b, ubs.boot_verification),
+};
+
+static uint8_t ubs_snapshot_buffer[LBT_SNAPSHOT_BUFFER_SIZE(
+	sizeof(ubs), ubs_snapshot_fields)];
+
+BUILD_ASSERT(sizeof(ubs_snapshot_buffer) <= LBT_ATT_MAX_ATTRIBUTE_LEN,
+	     "Bootloader snapshot too large");
+
+static struct lbt_snapshot ubs_snapshot = {
+	.fields = ubs_snapshot_fields,
+	.count = ARRAY_SIZE(ubs_snapshot_fields),
+	.buffer = ubs_snapshot_buffer,
+	.size = sizeof(ubs_snapshot_buffer),
+};
+#endif
+
 /******************************************************************************/
 /* Bootloader Service Declaration                                             */
 /******************************************************************************/
@@ -221,7 +270,13 @@ static struct bt_gatt_attr bootloader_attrs[] = {
 
 	BT_GATT_CHARACTERISTIC(&BOOT_VERIFICATION_UUID.uuid, BT_GATT_CHRC_READ,
 			       BT_GATT_PERM_READ, lbt_read_u8, NULL,
-			       &ubs.boot_verification)
+			       &ubs.boot_verification),
+
+#ifdef CONFIG_UNIVERSAL_BOOTLOADER_SERVICE_SNAPSHOT
+	BT_GATT_CHARACTERISTIC(&SNAPSHOT_UUID.uuid, BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ, lbt_read_snapshot, NULL,
+			       &ubs_snapshot),
+#endif
 };
 
 static struct bt_gatt_service bootloader_service =
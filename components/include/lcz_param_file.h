@@ -29,12 +29,52 @@ typedef enum param { PARAM_BIN = 0, PARAM_STR } param_t;
 
 typedef uint16_t param_id_t;
 
+typedef enum lcz_param_file_format {
+	/* id=value\n with binary values in hex */
+	LCZ_PARAM_FILE_FORMAT_TEXT = 0,
+	/* Self-described CBOR tag followed by a sequence of id (uint) and
+	 * value (bstr or tstr) pairs.
+	 */
+	LCZ_PARAM_FILE_FORMAT_CBOR,
+} lcz_param_file_format_t;
+
 typedef struct param_kvp {
 	param_id_t id;
 	char *keystr;
 	int length;
+	/* When true, keystr points to binary data (CBOR file).
+	 * Otherwise, it points to text (hex for binary parameters).
+	 */
+	bool binary;
 } param_kvp_t;
 
+/**
+ * @brief Called by the streaming parser for each parameter.
+ * The value is only valid until the callback returns.
+ *
+ * @param kvp parameter (value is not null terminated)
+ * @param context from lcz_param_file_parse_stream
+ *
+ * @retval negative value to stop parsing, otherwise 0.
+ */
+typedef int (*lcz_param_file_callback_t)(const param_kvp_t *kvp, void *context);
+
+/* Builds a parameter file in RAM or writes it to a file in chunks.
+ * Members are managed by the lcz_param_file_builder functions.
+ */
+typedef struct lcz_param_file_builder {
+	/* Absolute path of output file; NULL when the file is built in RAM */
+	const char *fname;
+	bool encrypted;
+	lcz_param_file_format_t format;
+	/* Null terminated (text format) */
+	char *str;
+	size_t length;
+	size_t capacity;
+	/* Bytes written to the file */
+	size_t flushed;
+} lcz_param_file_builder_t;
+
 /**************************************************************************************************/
 /* Global Function Prototypes                                                                     */
 /**************************************************************************************************/
@@ -105,7 +145,8 @@ int lcz_param_file_mount_fs(void);
 
 /**
  * @brief Parses a parameter text file.  Data is in hex with least
- * significant byte first.
+ * significant byte first.  If CONFIG_LCZ_PARAM_FILE_CBOR is enabled, then
+ * CBOR files are detected and parsed (values aren't in hex).
  *
  * @note Example File:
  * 0000=0A00\n
@@ -154,6 +195,66 @@ int lcz_param_file_enc_parse_from_file(const char *fname, size_t *fsize, char **
 				       param_kvp_t **kv);
 #endif
 
+/**
+ * @brief Parses a parameter text file in a single pass without reading the
+ * entire file into RAM. The file is read in chunks of
+ * CONFIG_LCZ_KV_PARSER_CHUNK_SIZE. CBOR files aren't supported.
+ *
+ * @note Because the file is not validated before the first callback,
+ * the callback may be called for parameters preceding an error in the file.
+ *
+ * @param fname absolute path name of file
+ * @param encrypted true if the file is encrypted
+ * (requires CONFIG_LCZ_PARAM_FILE_ENCRYPTED).
+ * @param cb called for each parameter in file order
+ * @param context passed to callback
+ *
+ * @retval negative error code (or callback error) or number of parameters
+ * found.
+ */
+int lcz_param_file_parse_stream(const char *fname, bool encrypted, lcz_param_file_callback_t cb,
+				void *context);
+
+/**
+ * @brief Build an index of parameters sorted by id.
+ * The key-value pairs are not modified (file order is preserved).
+ *
+ * @param kv array of key-value pairs (from lcz_param_file_parse_from_file)
+ * @param pairs number of key-value pairs
+ * @param index array of positions in kv (allocated by this function)
+ *
+ * @retval negative error code, 0 on success.
+ *
+ * @note Caller is responsible for freeing index.
+ */
+int lcz_param_file_build_index(const param_kvp_t *kv, int pairs, uint16_t **index);
+
+/**
+ * @brief Get the value of a binary parameter from a text (hex) or CBOR file.
+ *
+ * @param kvp key-value pair
+ * @param data output
+ * @param size of data
+ *
+ * @retval negative error code, otherwise number of bytes copied to data.
+ */
+int lcz_param_file_get_bin(const param_kvp_t *kvp, void *data, size_t size);
+
+/**
+ * @brief Find a parameter. If an id occurs more than once, then the last
+ * occurrence in the file is returned (matching the result of applying the
+ * file in order).
+ *
+ * @param kv array of key-value pairs
+ * @param index from lcz_param_file_build_index (O(log N)) or NULL (O(N))
+ * @param pairs number of key-value pairs
+ * @param id of parameter
+ *
+ * @retval key-value pair or NULL if not found.
+ */
+const param_kvp_t *lcz_param_file_find(const param_kvp_t *kv, const uint16_t *index, int pairs,
+				       param_id_t id);
+
 /**
  * @brief Validate a parameter file.
  *
@@ -164,6 +265,18 @@ int lcz_param_file_enc_parse_from_file(const char *fname, size_t *fsize, char **
  */
 int lcz_param_file_validate_file(const char *str, size_t size);
 
+/**
+ * @brief Get the format of a parameter file.
+ *
+ * @param str parameter file (as read or parsed)
+ * @param size length of file.
+ *
+ * @retval LCZ_PARAM_FILE_FORMAT_CBOR if the file starts with the
+ * self-described CBOR tag (requires CONFIG_LCZ_PARAM_FILE_CBOR), otherwise
+ * LCZ_PARAM_FILE_FORMAT_TEXT.
+ */
+lcz_param_file_format_t lcz_param_file_get_format(const char *str, size_t size);
+
 /**
  * @brief Generates a parameter file.  Allocates buffer on first call and
  * appends to buffer on subsequent calls.
@@ -176,12 +289,68 @@ int lcz_param_file_validate_file(const char *str, size_t size);
  * to NULL.
  *
  * @note Caller is responsible for freeing fstr.
+ * @note Each call is O(N) in the length of fstr; lcz_param_file_builder is O(1).
  *
  * @retval negative on error, otherwise number of bytes added to file string.
  */
 int lcz_param_file_generate_file(param_id_t id, param_t type, const void *data, size_t dsize,
 				 char **fstr);
 
+/**
+ * @brief Initialize a file builder. Unlike lcz_param_file_generate_file, the
+ * length of the file is tracked so that appending is O(1) (not O(N)).
+ *
+ * @param builder to initialize
+ * @param fname When NULL, the file is built in RAM (builder->str) and the
+ * buffer grows geometrically to a maximum of
+ * CONFIG_LCZ_PARAM_FILE_MAX_FILE_LENGTH. Otherwise, the absolute path of the
+ * file to write. The buffer is written to the file when it is full and when
+ * lcz_param_file_builder_flush is called. The size of the file isn't limited.
+ * @param encrypted true if file should be written encrypted
+ * (requires CONFIG_LCZ_PARAM_FILE_ENCRYPTED).
+ * @param format of file (CBOR requires CONFIG_LCZ_PARAM_FILE_CBOR)
+ *
+ * @retval negative error code, 0 on success.
+ *
+ * @note Caller is responsible for calling lcz_param_file_builder_free.
+ */
+int lcz_param_file_builder_init(lcz_param_file_builder_t *builder, const char *fname,
+				bool encrypted, lcz_param_file_format_t format);
+
+/**
+ * @brief Append a parameter.
+ *
+ * @param builder file builder
+ * @param id The id of the parameter to add.
+ * @param type The type of the parameter.
+ * @param data pointer
+ * @param dsize size of the data in bytes
+ *
+ * @retval negative on error, otherwise number of bytes added to file.
+ * -EINVAL if a string value can't be read back from a text file (it contains
+ * a non-printable character or the '=' delimiter).
+ */
+int lcz_param_file_builder_append(lcz_param_file_builder_t *builder, param_id_t id, param_t type,
+				  const void *data, size_t dsize);
+
+/**
+ * @brief Write the contents of the buffer to the file.
+ * The first write replaces the file; subsequent writes append to it.
+ * Does nothing when building in RAM.
+ *
+ * @param builder file builder
+ *
+ * @retval negative error code, 0 on success.
+ */
+int lcz_param_file_builder_flush(lcz_param_file_builder_t *builder);
+
+/**
+ * @brief Clear and free the buffer. Data that hasn't been flushed is discarded.
+ *
+ * @param builder file builder
+ */
+void lcz_param_file_builder_free(lcz_param_file_builder_t *builder);
+
 /**
  * @brief Appends parameter load error information to the passed string
  * buffer.
@@ -0,0 +1,75 @@
+/**
+ * @file lcz_param_store.h
+ * @brief Parameter file with changes journaled to a delta file.
+ *
+ * Setting a parameter appends a single line to the journal instead of
+ * rewriting the parameter file. The journal is merged into the parameter file
+ * (compacted) after a quiet period or when it reaches a size threshold, so a
+ * burst of changes causes a single rewrite. The journal uses the text format
+ * of lcz_param_file and the parameter file keeps its format (text or CBOR);
+ * the last value of a parameter wins. A journal that can't be parsed is
+ * renamed with a ".bad" suffix so that the parameter file can still be loaded.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LCZ_PARAM_STORE_H__
+#define __LCZ_PARAM_STORE_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#include "lcz_param_file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+/**
+ * @brief Append a parameter change to the journal and schedule compaction.
+ *
+ * @param id of parameter
+ * @param type of parameter
+ * @param data pointer
+ * @param dsize size of the data in bytes
+ *
+ * @retval negative error code, 0 on success. -EINVAL if the value can't be
+ * read back from the journal (see lcz_param_file_builder_append).
+ */
+int lcz_param_store_set(param_id_t id, param_t type, const void *data, size_t dsize);
+
+/**
+ * @brief Merge the journal into the parameter file now.
+ * Pending compaction is cancelled. Does nothing if the journal is empty.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int lcz_param_store_flush(void);
+
+/**
+ * @brief Flush and then parse the parameter file.
+ * See lcz_param_file_parse_from_file.
+ *
+ * @param fsize pointer to size of file string (set by this function)
+ * @param fstr pointer to file as a string (allocated by this function)
+ * @param kv pointer to array of key-value pairs (allocated by this function)
+ *
+ * @retval negative error code or number of key-value pairs found.
+ *
+ * @note If the return is non-negative, then it is the responsibility of the
+ * caller to free fstr and kv.
+ */
+int lcz_param_store_parse(size_t *fsize, char **fstr, param_kvp_t **kv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_PARAM_STORE_H__ */
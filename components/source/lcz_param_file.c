@@ -22,15 +22,21 @@ LOG_MODULE_REGISTER(lcz_param_file, CONFIG_LCZ_PARAM_FILE_LOG_LEVEL);
 #include <zephyr.h>
 #include <fs/fs.h>
 #include <sys/util.h>
-#include <stdlib.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+
+#if defined(CONFIG_LCZ_PARAM_FILE_CBOR)
+#include <zcbor_common.h>
+#include <zcbor_decode.h>
+#include <zcbor_encode.h>
+#endif
 
 #include "file_system_utilities.h"
 #if defined(CONFIG_LCZ_PARAM_FILE_ENCRYPTED)
 #include "encrypted_file_storage.h"
 #endif
+#include "lcz_kv_parser.h"
 #include "lcz_param_file.h"
 
 /**************************************************************************************************/
@@ -46,20 +52,55 @@ LOG_MODULE_REGISTER(lcz_param_file, CONFIG_LCZ_PARAM_FILE_LOG_LEVEL);
 
 #define DELIMITER_CHAR '='
 #define EOL_CHAR '\n'
-#define CR_CHAR '\r'
 
 #define PARAMS_MAX_FILE_SIZE (CONFIG_LCZ_PARAM_FILE_MAX_FILE_LENGTH + 1)
 
 #define PARAMS_MAX_ID_BYTES sizeof(param_id_t)
 #define PARAMS_MAX_ID_LENGTH (PARAMS_MAX_ID_BYTES * 2)
 
+#define BUILDER_INITIAL_SIZE CONFIG_LCZ_PARAM_FILE_BUILDER_INITIAL_SIZE
+#define BUILDER_CHUNK_SIZE CONFIG_LCZ_PARAM_FILE_BUILDER_CHUNK_SIZE
+
+/* Self-described CBOR (RFC 8949 3.4.6) is used to detect the format of a file */
+#define CBOR_MAGIC_TAG 55799
+#define CBOR_MAGIC_SIZE 3
+
+/* Worst case encoding of a uint16 id and a value header */
+#define CBOR_PAIR_OVERHEAD (3 + 5)
+
 #define PARAMS_PATH CONFIG_LCZ_PARAM_FILE_MOUNT_POINT "/" CONFIG_LCZ_PARAM_FILE_PATH
 
+/* Context of the streaming parser */
+typedef struct stream {
+	lcz_param_file_callback_t cb;
+	void *context;
+} stream_t;
+
+/* Context of the in-place parser */
+typedef struct table {
+	param_kvp_t *kv;
+	size_t capacity;
+	int pairs;
+} table_t;
+
 /**************************************************************************************************/
 /* Local Data Definitions                                                                         */
 /**************************************************************************************************/
 static bool params_ready;
 
+static const lcz_kv_syntax_t param_syntax = {
+	.key_type = LCZ_KV_KEY_HEX_ID,
+	.delimiter = DELIMITER_CHAR,
+	.delimiter_in_value = false,
+	.require_value = false,
+	.max_key_len = PARAMS_MAX_ID_LENGTH,
+	.max_value_len = CONFIG_LCZ_PARAM_FILE_MAX_VALUE_LENGTH,
+};
+
+#if defined(CONFIG_LCZ_PARAM_FILE_CBOR)
+static const uint8_t CBOR_MAGIC[CBOR_MAGIC_SIZE] = { 0xD9, 0xD9, 0xF7 };
+#endif
+
 BUILD_ASSERT(sizeof(PARAMS_PATH) <= CONFIG_FSU_MAX_PATH_SIZE, "Params path too long");
 
 /**************************************************************************************************/
@@ -67,19 +108,31 @@ BUILD_ASSERT(sizeof(PARAMS_PATH) <= CONFIG_FSU_MAX_PATH_SIZE, "Params path too l
 /**************************************************************************************************/
 static int lcz_param_file_init(const struct device *device);
 
-static int read_text(const char *fname, char **fstr, size_t fsize);
-#if defined(CONFIG_LCZ_PARAM_FILE_ENCRYPTED)
-static int read_text_enc(const char *fname, char **fstr, size_t fsize);
+static const lcz_kv_io_t *get_io(bool encrypted);
+static int parse(bool encrypted, const char *fname, size_t *fsize, char **fstr, param_kvp_t **kv);
+static void token_to_kvp(const lcz_kv_token_t *token, param_kvp_t *kvp);
+static int stream_pair(const lcz_kv_token_t *token, void *context);
+static int table_pair(const lcz_kv_token_t *token, void *context);
+#if defined(CONFIG_LCZ_PARAM_FILE_CBOR)
+static bool is_cbor(const char *str, size_t size);
+static int parse_cbor(const char *str, size_t size, param_kvp_t **kv);
+static int append_cbor(lcz_param_file_builder_t *builder, param_id_t id, param_t type,
+		       const void *data, size_t dsize);
 #endif
-static int read_and_remove_cr(char *str, struct fs_file_t *fptr, size_t fsize, size_t *length);
-static int parse_file(const char *str, int pairs, param_kvp_t *kv);
 
-static int append_parameter(param_id_t id, param_t type, const void *data, size_t dsize, char *str);
-static int append_id(char *str, size_t *length, param_id_t id);
-static int append_value(char *str, size_t *length, param_t type, const void *data, size_t dsize);
+static int append_parameter(char *str, size_t *length, size_t capacity, param_id_t id,
+			    param_t type, const void *data, size_t dsize);
+static int append_id(char *str, size_t *length, size_t capacity, param_id_t id);
+static int append_value(char *str, size_t *length, size_t capacity, param_t type, const void *data,
+			size_t dsize);
+static size_t value_length(param_t type, size_t dsize);
+static bool valid_text_value(const char *data, size_t dsize);
+static int builder_reserve(lcz_param_file_builder_t *builder, size_t size);
+
+static bool index_less(const void *array, uint16_t a, uint16_t b);
 
-static bool room_for_id(size_t current_length);
-static bool room_for_value(size_t current_length, size_t dsize);
+static bool room_for_id(size_t current_length, size_t capacity);
+static bool room_for_value(size_t current_length, size_t capacity, param_t type, size_t dsize);
 
 /**************************************************************************************************/
 /* Global Function Definitions                                                                    */
@@ -142,211 +195,289 @@ int lcz_param_file_delete(char *name)
 
 int lcz_param_file_parse_from_file(const char *fname, size_t *fsize, char **fstr, param_kvp_t **kv)
 {
-	int r = -EPERM;
-	struct fs_dirent *entry = k_malloc(sizeof(struct fs_dirent));
-	*fsize = 0;
-	*fstr = NULL;
-	*kv = NULL;
-	do {
-		if (entry == NULL) {
-			r = -ENOMEM;
-			LOG_ERR("Allocation failure");
-			break;
-		}
+	return parse(false, fname, fsize, fstr, kv);
+}
 
-		r = fs_stat(fname, entry);
-		if (r < 0) {
-			LOG_WRN("%s not found", fname);
-			break;
-		}
+#if defined(CONFIG_LCZ_PARAM_FILE_ENCRYPTED)
+int lcz_param_file_enc_parse_from_file(const char *fname, size_t *fsize, char **fstr,
+				       param_kvp_t **kv)
+{
+	return parse(true, fname, fsize, fstr, kv);
+}
+#endif
 
-		LOG_DBG("'%s' parameter file size bytes: %u ", fname, entry->size);
-		if (entry->size == 0) {
+int lcz_param_file_parse_stream(const char *fname, bool encrypted, lcz_param_file_callback_t cb,
+				void *context)
+{
+	const lcz_kv_io_t *io = get_io(encrypted);
+	stream_t s;
+
+	if (io == NULL) {
+		return -ENOTSUP;
+	}
+
+	if (cb == NULL) {
+		return -EINVAL;
+	}
+
+	s.cb = cb;
+	s.context = context;
+	return lcz_kv_parser_stream(&param_syntax, io, fname, stream_pair, &s);
+}
+
+int lcz_param_file_generate_file(param_id_t id, param_t type, const void *data, size_t dsize,
+				 char **fstr)
+{
+	int r = 0;
+	size_t length;
+
+	do {
+		if (fstr == NULL) {
 			r = -EPERM;
-			LOG_ERR("Unexpected file size");
 			break;
 		}
 
-		r = read_text(fname, fstr, entry->size);
-		BREAK_ON_ERROR(r);
-
-		entry->size = (size_t)r;
-		if (IS_ENABLED(CONFIG_LCZ_PARAM_FILE_LOG_VERBOSE)) {
-			LOG_DBG("stripped size: %u ", entry->size);
+		if (*fstr == NULL) {
+			*fstr = k_calloc(PARAMS_MAX_FILE_SIZE, sizeof(char));
 		}
-		r = lcz_param_file_validate_file(*fstr, entry->size);
-		BREAK_ON_ERROR(r);
 
-		/* allocate key-pointer-to-value pairs */
-		*kv = k_calloc(r, sizeof(param_kvp_t));
-		if (*kv == NULL) {
+		if (*fstr == NULL) {
 			r = -ENOMEM;
 			break;
 		}
 
-		r = parse_file(*fstr, r, *kv);
-		BREAK_ON_ERROR(r);
+		length = strlen(*fstr);
+		r = append_parameter(*fstr, &length, CONFIG_LCZ_PARAM_FILE_MAX_FILE_LENGTH, id, type,
+				     data, dsize);
 
 	} while (0);
 
-	*fsize = entry->size;
-	k_free(entry);
-	if (r < 0) {
-		k_free(*fstr);
-		k_free(*kv);
-		*fstr = NULL;
-		*kv = NULL;
-	}
-
 	return r;
 }
 
-#if defined(CONFIG_LCZ_PARAM_FILE_ENCRYPTED)
-int lcz_param_file_enc_parse_from_file(const char *fname, size_t *fsize, char **fstr,
-				       param_kvp_t **kv)
+int lcz_param_file_builder_init(lcz_param_file_builder_t *builder, const char *fname,
+				bool encrypted, lcz_param_file_format_t format)
 {
-	int r = -EPERM;
-	ssize_t file_size;
+	if (builder == NULL) {
+		return -EINVAL;
+	}
 
-	*fsize = 0;
-	*fstr = NULL;
-	*kv = NULL;
+	if (!IS_ENABLED(CONFIG_LCZ_PARAM_FILE_ENCRYPTED) && encrypted) {
+		return -ENOTSUP;
+	}
 
-	do {
-		file_size = efs_get_file_size(fname);
-		if (file_size < 0) {
-			LOG_ERR("Could not get size of encrypted param file %s: %d",
-				fname, file_size);
-			r = *fsize;
-			break;
-		}
+	if (format != LCZ_PARAM_FILE_FORMAT_TEXT &&
+	    !(IS_ENABLED(CONFIG_LCZ_PARAM_FILE_CBOR) && format == LCZ_PARAM_FILE_FORMAT_CBOR)) {
+		return -ENOTSUP;
+	}
 
-		LOG_DBG("'%s' enc parameter file size bytes: %u ", fname, file_size);
-		if (file_size == 0) {
-			r = -ENOENT;
-			LOG_ERR("Encrypted param file %s is empty", fname);
-			break;
-		}
+	memset(builder, 0, sizeof(*builder));
+	builder->fname = fname;
+	builder->encrypted = encrypted;
+	builder->format = format;
+	builder->capacity = MIN((fname == NULL) ? BUILDER_INITIAL_SIZE : BUILDER_CHUNK_SIZE,
+				PARAMS_MAX_FILE_SIZE);
+	builder->str = k_malloc(builder->capacity);
+	if (builder->str == NULL) {
+		LOG_ERR("Unable to allocate parameter string");
+		return -ENOMEM;
+	}
+	builder->str[0] = '\0';
 
-		r = read_text_enc(fname, fstr, file_size);
-		BREAK_ON_ERROR(r);
-		file_size = r;
+#if defined(CONFIG_LCZ_PARAM_FILE_CBOR)
+	if (format == LCZ_PARAM_FILE_FORMAT_CBOR) {
+		memcpy(builder->str, CBOR_MAGIC, CBOR_MAGIC_SIZE);
+		builder->length = CBOR_MAGIC_SIZE;
+	}
+#endif
 
-		if (IS_ENABLED(CONFIG_LCZ_PARAM_FILE_LOG_VERBOSE)) {
-			LOG_DBG("stripped size: %u ", file_size);
-		}
-		r = lcz_param_file_validate_file(*fstr, file_size);
-		BREAK_ON_ERROR(r);
+	return 0;
+}
 
-		/* allocate key-pointer-to-value pairs */
-		*kv = k_calloc(r, sizeof(param_kvp_t));
-		if (*kv == NULL) {
-			r = -ENOMEM;
-			break;
-		}
+int lcz_param_file_builder_append(lcz_param_file_builder_t *builder, param_id_t id, param_t type,
+				  const void *data, size_t dsize)
+{
+	size_t start;
+	int r;
 
-		r = parse_file(*fstr, r, *kv);
-		BREAK_ON_ERROR(r);
+	if (builder == NULL || builder->str == NULL) {
+		return -EINVAL;
+	}
 
-	} while (0);
+#if defined(CONFIG_LCZ_PARAM_FILE_CBOR)
+	if (builder->format == LCZ_PARAM_FILE_FORMAT_CBOR) {
+		return append_cbor(builder, id, type, data, dsize);
+	}
+#endif
 
-	*fsize = file_size;
+	r = builder_reserve(builder, PARAMS_MAX_ID_LENGTH + SIZE_OF_DELIMITER +
+					     value_length(type, dsize) + SIZE_OF_DELIMITER +
+					     SIZE_OF_NUL);
 	if (r < 0) {
-		if (*fstr != NULL) {
-			memset(*fstr, 0, *fsize);
-			k_free(*fstr);
-		}
-		k_free(*kv);
-		*fstr = NULL;
-		*kv = NULL;
+		LOG_ERR("Unable to append id: %d: %d", id, r);
+		return r;
+	}
+
+	start = builder->length;
+	r = append_parameter(builder->str, &builder->length, builder->capacity, id, type, data,
+			     dsize);
+	if (r < 0) {
+		/* Remove partial parameter */
+		builder->length = start;
+		builder->str[start] = '\0';
 	}
 
 	return r;
 }
-#endif
 
-int lcz_param_file_generate_file(param_id_t id, param_t type, const void *data, size_t dsize,
-				 char **fstr)
+int lcz_param_file_builder_flush(lcz_param_file_builder_t *builder)
 {
 	int r = 0;
-	do {
-		if (fstr == NULL) {
-			r = -EPERM;
-			break;
+
+	if (builder == NULL || builder->str == NULL) {
+		return -EINVAL;
+	}
+
+	if (builder->fname == NULL) {
+		return 0;
+	}
+
+	if (builder->flushed == 0) {
+		/* Replace any existing file */
+#if defined(CONFIG_LCZ_PARAM_FILE_ENCRYPTED)
+		if (builder->encrypted) {
+			r = efs_write(builder->fname, builder->str, builder->length);
+		} else
+#endif
+		{
+			r = fsu_write_abs(builder->fname, builder->str, builder->length);
 		}
+	} else if (builder->length > 0) {
+#if defined(CONFIG_LCZ_PARAM_FILE_ENCRYPTED)
+		if (builder->encrypted) {
+			r = efs_append(builder->fname, builder->str, builder->length);
+		} else
+#endif
+		{
+			r = fsu_append_abs(builder->fname, builder->str, builder->length);
+		}
+	}
 
-		if (*fstr == NULL) {
-			*fstr = k_calloc(PARAMS_MAX_FILE_SIZE, sizeof(char));
+	if (r < 0) {
+		LOG_ERR("Unable to write parameter file %s: %d", builder->fname, r);
+		return r;
+	}
+
+	builder->flushed += builder->length;
+	memset(builder->str, 0, builder->length);
+	builder->length = 0;
+
+	return 0;
+}
+
+void lcz_param_file_builder_free(lcz_param_file_builder_t *builder)
+{
+	if (builder != NULL) {
+		if (builder->str != NULL) {
+			memset(builder->str, 0, builder->capacity);
+			k_free(builder->str);
 		}
+		memset(builder, 0, sizeof(*builder));
+	}
+}
 
-		if (*fstr == NULL) {
-			r = -ENOMEM;
-			break;
+int lcz_param_file_get_bin(const param_kvp_t *kvp, void *data, size_t size)
+{
+	size_t length;
+
+	if (kvp == NULL || data == NULL) {
+		return -EINVAL;
+	}
+
+	if (kvp->binary) {
+		if (kvp->length > size) {
+			return -ENOMEM;
 		}
+		memcpy(data, kvp->keystr, kvp->length);
+		return kvp->length;
+	}
 
-		r = append_parameter(id, type, data, dsize, *fstr);
+	if (kvp->length == 0) {
+		return 0;
+	}
 
-	} while (0);
+	length = hex2bin(kvp->keystr, kvp->length, data, size);
+	return (length == 0) ? -EINVAL : length;
+}
 
-	return r;
+int lcz_param_file_build_index(const param_kvp_t *kv, int pairs, uint16_t **index)
+{
+	return lcz_kv_index_build(kv, pairs, index_less, index);
 }
 
-int lcz_param_file_validate_file(const char *str, size_t length)
+const param_kvp_t *lcz_param_file_find(const param_kvp_t *kv, const uint16_t *index, int pairs,
+				       param_id_t id)
 {
-	int r = 0;
-	int delimiters = 0;
-	int newlines = 0;
-	int distance = 0;
-	size_t i;
-	for (i = 0; i < length; i++) {
-		if (str[i] == DELIMITER_CHAR) {
-			delimiters += 1;
-			if (distance > PARAMS_MAX_ID_LENGTH) {
-				r = -EINVAL;
-				LOG_ERR("Unexpected id size at %u", i);
-				break;
-			} else {
-				if (IS_ENABLED(CONFIG_LCZ_PARAM_FILE_LOG_VERBOSE)) {
-					LOG_DBG("%u %d", i, distance);
-				}
-				distance = 0;
-			}
-		} else if (str[i] == EOL_CHAR) {
-			newlines += 1;
-			if (distance > CONFIG_LCZ_PARAM_FILE_MAX_VALUE_LENGTH) {
-				r = -EINVAL;
-				LOG_ERR("Invalid Size of %d at %u", distance, i);
-				break;
-			}
-			if (IS_ENABLED(CONFIG_LCZ_PARAM_FILE_LOG_VERBOSE)) {
-				LOG_DBG("%u %d", i, distance);
+	int lo = 0;
+	int hi = pairs;
+	int mid;
+	int i;
+
+	if (kv == NULL || pairs <= 0) {
+		return NULL;
+	}
+
+	if (index == NULL) {
+		for (i = pairs - 1; i >= 0; i--) {
+			if (kv[i].id == id) {
+				return &kv[i];
 			}
-			distance = 0;
-		} else if (!isprint((int)str[i])) {
-			r = -EINVAL;
-			LOG_ERR("Non-printable char 0x%x at %u", str[i], i);
-			break;
+		}
+		return NULL;
+	}
+
+	/* Upper bound; duplicates are sorted by position so the last one is found */
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (kv[index[mid]].id <= id) {
+			lo = mid + 1;
 		} else {
-			distance += 1;
+			hi = mid;
 		}
 	}
 
-	if (delimiters != newlines) {
-		r = -EINVAL;
-		LOG_ERR("%d delimiters != %d newlines", delimiters, newlines);
-	} else {
-		LOG_DBG("Found %d pairs", delimiters);
+	if (lo > 0 && kv[index[lo - 1]].id == id) {
+		return &kv[index[lo - 1]];
+	}
+
+	return NULL;
+}
+
+int lcz_param_file_validate_file(const char *str, size_t length)
+{
+	return lcz_kv_parser_validate(&param_syntax, str, length);
+}
+
+lcz_param_file_format_t lcz_param_file_get_format(const char *str, size_t size)
+{
+#if defined(CONFIG_LCZ_PARAM_FILE_CBOR)
+	if (str != NULL && is_cbor(str, size)) {
+		return LCZ_PARAM_FILE_FORMAT_CBOR;
 	}
-	return (r < 0) ? r : delimiters;
+#endif
+	ARG_UNUSED(str);
+	ARG_UNUSED(size);
+	return LCZ_PARAM_FILE_FORMAT_TEXT;
 }
 
 int lcz_param_file_append_feedback(param_id_t id, uint8_t error_code, uint8_t *write_data)
 {
 	int result;
+	size_t length = strlen((char *)write_data);
 
 	/* Parameter feedback error codes are always binary */
-	result = append_parameter(id, PARAM_BIN, (const void *)&error_code, sizeof(uint8_t),
-				  write_data);
+	result = append_parameter((char *)write_data, &length, CONFIG_LCZ_PARAM_FILE_MAX_FILE_LENGTH,
+				  id, PARAM_BIN, (const void *)&error_code, sizeof(uint8_t));
 
 	return result;
 }
@@ -354,184 +485,249 @@ int lcz_param_file_append_feedback(param_id_t id, uint8_t error_code, uint8_t *w
 /**************************************************************************************************/
 /* Local Function Definitions                                                                     */
 /**************************************************************************************************/
-/**
- * @retval negative on error, otherwise number of key-value pairs.
- */
-static int parse_file(const char *str, int pairs, param_kvp_t *kv)
+static const lcz_kv_io_t *get_io(bool encrypted)
 {
-	int r = 0;
-	char *start = (char *)str;
-	char *end;
-	char *delimiter;
-	char *newline;
-	int i;
-	for (i = 0; i < pairs; i++) {
-		delimiter = strchr(start, DELIMITER_CHAR);
-		kv[i].id = strtoul(start, &end, 16);
-		if (delimiter != end) {
-			r = -1;
-			LOG_ERR("Unexpected delimiter position");
-			break;
-		}
-		kv[i].keystr = end + 1;
-		newline = strchr(kv[i].keystr, EOL_CHAR);
-		kv[i].length = newline - kv[i].keystr;
-		if (kv[i].length < 1) {
-			LOG_ZLP("Zero Length Parameter (possible empty string)");
-		}
-		start = newline + 1;
+#if defined(CONFIG_LCZ_PARAM_FILE_ENCRYPTED)
+	if (encrypted) {
+		return &lcz_kv_io_encrypted;
 	}
+#endif
 
-	return i;
+	return encrypted ? NULL : &lcz_kv_io_clear;
 }
 
 /**
- * @brief Read the text file from the filesystem into a buffer in RAM.
+ * @brief The file is read with a single allocation. Text files are parsed in
+ * place and CBOR files are decoded in place.
  *
- * @retval negative on error, otherwise size of string with carriage returns
- * removed.
+ * @retval negative on error, otherwise number of key-value pairs.
  */
-static int read_text(const char *fname, char **fstr, size_t fsize)
+static int parse(bool encrypted, const char *fname, size_t *fsize, char **fstr, param_kvp_t **kv)
 {
-	int r = 0;
-	size_t length = 0;
-	struct fs_file_t file;
-	char *str = NULL;
+	const lcz_kv_io_t *io = get_io(encrypted);
+	table_t table;
+	size_t size;
+	int r;
 
-	do {
-		str = k_malloc(fsize);
-		if (str == NULL) {
-			r = -ENOMEM;
-			LOG_ERR("Unable to allocate parameter string");
-			break;
-		}
-		*fstr = str;
+	*fsize = 0;
+	*fstr = NULL;
+	*kv = NULL;
 
-		fs_file_t_init(&file);
-		r = fs_open(&file, fname, FS_O_READ);
-		BREAK_ON_ERROR(r);
+	if (io == NULL) {
+		return -ENOTSUP;
+	}
+
+	r = lcz_kv_parser_read(io, fname, fsize, fstr);
+	if (r < 0) {
+		return r;
+	}
 
-		r = read_and_remove_cr(str, &file, fsize, &length);
+	memset(&table, 0, sizeof(table));
+	size = *fsize;
 
-		/* The validator checks that the file ends with a '\n' (0x0A). */
-		if (IS_ENABLED(CONFIG_LCZ_PARAM_FILE_LOG_VERBOSE) && length > 1) {
-			LOG_DBG("0x%x 0x%x", str[length - 2], str[length - 1]);
+#if defined(CONFIG_LCZ_PARAM_FILE_CBOR)
+	if (is_cbor(*fstr, *fsize)) {
+		r = parse_cbor(*fstr, *fsize, &table.kv);
+	} else
+#endif
+	{
+		r = lcz_kv_parser_parse(&param_syntax, *fstr, fsize, table_pair, &table);
+		if (r >= 0 && table.kv == NULL) {
+			table.kv = k_calloc(1, sizeof(param_kvp_t));
+			if (table.kv == NULL) {
+				r = -ENOMEM;
+			}
 		}
+		if (IS_ENABLED(CONFIG_LCZ_PARAM_FILE_LOG_VERBOSE)) {
+			LOG_DBG("stripped size: %u ", *fsize);
+		}
+	}
 
-		r = fs_close(&file);
-		BREAK_ON_ERROR(r);
+	if (r < 0) {
+		/* Clear encrypted file data */
+		memset(*fstr, 0, size);
+		k_free(*fstr);
+		k_free(table.kv);
+		*fsize = 0;
+		*fstr = NULL;
+	} else {
+		*kv = table.kv;
+	}
 
-	} while (0);
+	return r;
+}
 
-	return (r < 0) ? r : length;
+static void token_to_kvp(const lcz_kv_token_t *token, param_kvp_t *kvp)
+{
+	kvp->id = token->id;
+	kvp->keystr = (char *)token->value;
+	kvp->length = token->value_len;
+	kvp->binary = false;
+	if (kvp->length < 1) {
+		LOG_ZLP("Zero Length Parameter (possible empty string)");
+	}
 }
 
-/* Removing carriage returns makes parsing easier */
-static int read_and_remove_cr(char *str, struct fs_file_t *fptr, size_t fsize, size_t *length)
+static int stream_pair(const lcz_kv_token_t *token, void *context)
 {
-	int r = 0;
-	size_t i;
-	char c;
-	for (i = 0; i < fsize; i++) {
-		r = fs_read(fptr, &c, 1);
-		if (r == 1) {
-			if (c != CR_CHAR) {
-				str[(*length)++] = c;
-			}
-		} else {
-			r = -EINVAL;
-			LOG_ERR("file read error");
-			break;
-		}
+	stream_t *s = context;
+	param_kvp_t kvp;
+
+	token_to_kvp(token, &kvp);
+	return s->cb(&kvp, s->context);
+}
+
+static int table_pair(const lcz_kv_token_t *token, void *context)
+{
+	table_t *t = context;
+	param_kvp_t *kvp;
+
+	kvp = lcz_kv_parser_array_add((void **)&t->kv, &t->capacity, t->pairs,
+				      sizeof(param_kvp_t));
+	if (kvp == NULL) {
+		return -ENOMEM;
 	}
 
-	return r;
+	token_to_kvp(token, kvp);
+	t->pairs += 1;
+	return 0;
+}
+
+#if defined(CONFIG_LCZ_PARAM_FILE_CBOR)
+static bool is_cbor(const char *str, size_t size)
+{
+	/* A text file can't start with a non-printable character */
+	return (size >= CBOR_MAGIC_SIZE && memcmp(str, CBOR_MAGIC, CBOR_MAGIC_SIZE) == 0);
 }
 
-#if defined(CONFIG_LCZ_PARAM_FILE_ENCRYPTED)
 /**
- * @brief Read the text file from the filesystem into a buffer in RAM.
+ * @brief Values point to locations in str. The file is decoded twice;
+ * once to count the pairs and once to fill in kv.
  *
- * @param[in] fname Absolute file name of the file to read
- * @param[in] fstr Pointer to where the pointer to the data should be stored
- * @param[in] fsize Size of the file on disk
- *
- * @retval negative on error, otherwise size of string with carriage returns
- * removed.
+ * @retval negative on error, otherwise number of key-value pairs.
  */
-static int read_text_enc(const char *fname, char **fstr, size_t fsize)
+static int parse_cbor(const char *str, size_t size, param_kvp_t **kv)
 {
-	int r = 0;
+	zcbor_state_t zs[2];
+	struct zcbor_string value;
+	uint32_t tag;
+	uint32_t id;
+	int pairs = 0;
+	int pass;
 	int i;
-	int j;
+	bool binary;
+	bool ok;
+
+	for (pass = 0; pass < 2; pass++) {
+		/* Every item is at least one byte */
+		zcbor_new_state(zs, ARRAY_SIZE(zs), (const uint8_t *)str, size, size);
+
+		ok = zcbor_tag_decode(zs, &tag) && (tag == CBOR_MAGIC_TAG);
+		for (i = 0; ok && zs->payload < zs->payload_end; i++) {
+			ok = zcbor_uint32_decode(zs, &id) && (id <= UINT16_MAX) &&
+			     (zs->payload < zs->payload_end);
+			if (!ok) {
+				break;
+			}
 
-	/* Validate the input parameters */
-	if (fname == NULL || fstr == NULL) {
-		LOG_ERR("read_text_enc: Invalid parameters");
-		r = -EINVAL;
-	}
+			binary = (ZCBOR_MAJOR_TYPE(*zs->payload) == ZCBOR_MAJOR_TYPE_BSTR);
+			if (binary) {
+				ok = zcbor_bstr_decode(zs, &value);
+			} else {
+				ok = zcbor_tstr_decode(zs, &value);
+			}
 
-	/* Allocate memory for the file contents */
-	if (r == 0) {
-		*fstr = k_malloc(fsize + 1);
-		if (*fstr == NULL) {
-			LOG_ERR("read_text_enc: Could not allocate %d bytes for %s", fsize + 1,
-				fname);
-			r = -ENOMEM;
-		}
-	}
+			/* Values must also fit in a text file */
+			ok = ok && (value_length(binary ? PARAM_BIN : PARAM_STR, value.len) <=
+				    CONFIG_LCZ_PARAM_FILE_MAX_VALUE_LENGTH);
 
-	/* Read the entire file into memory */
-	if (r == 0) {
-		r = efs_read(fname, *fstr, fsize);
-		if (r != fsize) {
-			LOG_ERR("read_text_enc: Could not read file %s: %d", fname, r);
-			if (r >= 0) {
-				r = -EPERM;
+			if (ok && pass == 1) {
+				(*kv)[i].id = id;
+				(*kv)[i].keystr = (char *)value.value;
+				(*kv)[i].length = value.len;
+				(*kv)[i].binary = binary;
 			}
-		} else {
-			r = 0;
 		}
-	}
 
-	/* Strip the CRs from the file */
-	if (r == 0) {
-		i = 0;
-		j = 0;
-		while (i < fsize) {
-			if ((*fstr)[i] != CR_CHAR) {
-				(*fstr)[j] = (*fstr)[i];
-				j++;
+		if (!ok) {
+			LOG_ERR("Invalid CBOR parameter file at %u",
+				(const char *)zs->payload - str);
+			return -EINVAL;
+		}
+
+		if (pass == 0) {
+			pairs = i;
+			LOG_DBG("Found %d pairs", pairs);
+			*kv = k_calloc(MAX(pairs, 1), sizeof(param_kvp_t));
+			if (*kv == NULL) {
+				return -ENOMEM;
 			}
-			i++;
 		}
-		/* Clear the remainder of the input string */
-		memset((*fstr) + j, 0, i - j);
 	}
 
-	/* Return the stripped length or the error code */
-	if (r == 0) {
-		return j;
-	} else {
+	return pairs;
+}
+
+static int append_cbor(lcz_param_file_builder_t *builder, param_id_t id, param_t type,
+		       const void *data, size_t dsize)
+{
+	zcbor_state_t zs[2];
+	uint8_t *start;
+	bool ok;
+	int r;
+
+	if (type != PARAM_BIN && type != PARAM_STR) {
+		LOG_ERR("Unknown parameter type");
+		return -EINVAL;
+	}
+
+	if (value_length(type, dsize) > CONFIG_LCZ_PARAM_FILE_MAX_VALUE_LENGTH) {
+		LOG_ERR("Unable to append id: %d data size: %d max string: %d", id, dsize,
+			CONFIG_LCZ_PARAM_FILE_MAX_VALUE_LENGTH);
+		return -EINVAL;
+	}
+
+	r = builder_reserve(builder, CBOR_PAIR_OVERHEAD + dsize + SIZE_OF_NUL);
+	if (r < 0) {
+		LOG_ERR("Unable to append id: %d: %d", id, r);
 		return r;
 	}
+
+	start = (uint8_t *)&builder->str[builder->length];
+	zcbor_new_state(zs, ARRAY_SIZE(zs), start, builder->capacity - builder->length, 0);
+
+	ok = zcbor_uint32_put(zs, id);
+	if (ok && type == PARAM_BIN) {
+		ok = zcbor_bstr_encode_ptr(zs, (const char *)data, dsize);
+	} else if (ok) {
+		ok = zcbor_tstr_encode_ptr(zs, (const char *)data, dsize);
+	}
+
+	if (!ok) {
+		LOG_ERR("Unable to encode id: %d", id);
+		return -EINVAL;
+	}
+
+	r = zs->payload - start;
+	builder->length += r;
+	return r;
 }
 #endif
 
-static int append_parameter(param_id_t id, param_t type, const void *data, size_t dsize, char *str)
+static int append_parameter(char *str, size_t *length, size_t capacity, param_id_t id,
+			    param_t type, const void *data, size_t dsize)
 {
 	int r = -EPERM;
-	size_t length = strlen(str);
-	size_t starting_length = length;
+	size_t starting_length = *length;
 
 	do {
-		r = append_id(str, &length, id);
+		r = append_id(str, length, capacity, id);
 		BREAK_ON_ERROR(r);
 
-		r = append_value(str, &length, type, data, dsize);
+		r = append_value(str, length, capacity, type, data, dsize);
 		BREAK_ON_ERROR(r);
 
-		r = length - starting_length;
+		r = *length - starting_length;
 
 		if (IS_ENABLED(CONFIG_LCZ_PARAM_FILE_LOG_VERBOSE)) {
 			LOG_HEXDUMP_DBG(&str[starting_length], r, "append parameter");
@@ -542,32 +738,40 @@ static int append_parameter(param_id_t id, param_t type, const void *data, size_
 	if (r < 0) {
 		LOG_ERR("Unable to append id: %d "
 			"string size: %d data size: %d max string: %d max data: %d",
-			id, length, dsize, CONFIG_LCZ_PARAM_FILE_MAX_FILE_LENGTH,
-			CONFIG_LCZ_PARAM_FILE_MAX_VALUE_LENGTH);
+			id, *length, dsize, capacity, CONFIG_LCZ_PARAM_FILE_MAX_VALUE_LENGTH);
 	}
 
 	return r;
 }
 
-/* The bin2hex function returns a null terminated string.  The
+/* Position is the tie breaker so that the (unstable) heap sort is stable */
+static bool index_less(const void *array, uint16_t a, uint16_t b)
+{
+	const param_kvp_t *kv = array;
+
+	return (kv[a].id < kv[b].id) || (kv[a].id == kv[b].id && a < b);
+}
+
+/* The snprintf function returns a null terminated string.  The
  * size check for the delimiter character ensures room for the terminator.
  */
-static bool room_for_id(size_t current_length)
+static bool room_for_id(size_t current_length, size_t capacity)
 {
-	return ((current_length + PARAMS_MAX_ID_LENGTH + SIZE_OF_DELIMITER) <
-		CONFIG_LCZ_PARAM_FILE_MAX_FILE_LENGTH);
+	return ((current_length + PARAMS_MAX_ID_LENGTH + SIZE_OF_DELIMITER) < capacity);
 }
 
-static int append_id(char *str, size_t *length, param_id_t id)
+static int append_id(char *str, size_t *length, size_t capacity, param_id_t id)
 {
 	int r = -EPERM;
 	int id_len;
 	/* id is big endian hex */
-	if (room_for_id(*length)) {
+	if (room_for_id(*length, capacity)) {
 		if (IS_ENABLED(CONFIG_LCZ_PARAM_FILE_4_DIGIT_ID)) {
-			id_len = snprintf(&str[*length], PARAMS_MAX_ID_LENGTH, "%04x", id);
+			id_len = snprintf(&str[*length], PARAMS_MAX_ID_LENGTH + SIZE_OF_NUL, "%04x",
+					  id);
 		} else {
-			id_len = snprintf(&str[*length], PARAMS_MAX_ID_LENGTH, "%x", id);
+			id_len = snprintf(&str[*length], PARAMS_MAX_ID_LENGTH + SIZE_OF_NUL, "%x",
+					  id);
 		}
 		if (id_len <= 0) {
 			r = -EINVAL;
@@ -585,19 +789,41 @@ static int append_id(char *str, size_t *length, param_id_t id)
 /*
  * The file is built as a string and must be null teminated until
  * it is written to the filesystem (or sent over a transport).
+ * The limit matches the parser so that any file that is read can be written again.
  */
-static bool room_for_value(size_t current_length, size_t dsize)
+static bool room_for_value(size_t current_length, size_t capacity, param_t type, size_t dsize)
+{
+	return ((value_length(type, dsize) <= CONFIG_LCZ_PARAM_FILE_MAX_VALUE_LENGTH) &&
+		((current_length + value_length(type, dsize) + SIZE_OF_DELIMITER + SIZE_OF_NUL) <=
+		 capacity));
+}
+
+/* Binary values are written as hex */
+static size_t value_length(param_t type, size_t dsize)
 {
-	return ((dsize < CONFIG_LCZ_PARAM_FILE_MAX_VALUE_LENGTH) &&
-		((current_length + dsize + SIZE_OF_DELIMITER + SIZE_OF_NUL) <
-		 CONFIG_LCZ_PARAM_FILE_MAX_FILE_LENGTH));
+	return (type == PARAM_BIN) ? (dsize * 2) : dsize;
 }
 
-static int append_value(char *str, size_t *length, param_t type, const void *data, size_t dsize)
+/* The parser only accepts printable characters and a single delimiter per line */
+static bool valid_text_value(const char *data, size_t dsize)
+{
+	size_t i;
+
+	for (i = 0; i < dsize; i++) {
+		if (!isprint((int)data[i]) || data[i] == DELIMITER_CHAR) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static int append_value(char *str, size_t *length, size_t capacity, param_t type, const void *data,
+			size_t dsize)
 {
 	int r = -EPERM;
 	size_t val_len = 0;
-	if (room_for_value(*length, dsize)) {
+	if (room_for_value(*length, capacity, type, dsize)) {
 		switch (type) {
 		case PARAM_BIN:
 			val_len = bin2hex(data, dsize, &str[*length],
@@ -611,6 +837,11 @@ static int append_value(char *str, size_t *length, param_t type, const void *dat
 			break;
 
 		case PARAM_STR:
+			if (!valid_text_value(data, dsize)) {
+				r = -EINVAL;
+				LOG_ERR("String can't be read back from a text file");
+				break;
+			}
 			r = 0;
 			val_len = dsize;
 			memcpy(&str[*length], data, dsize);
@@ -633,6 +864,55 @@ static int append_value(char *str, size_t *length, param_t type, const void *dat
 	return r;
 }
 
+/**
+ * @brief Make room for size bytes. When writing to a file, the buffer is
+ * flushed first. The buffer only grows when that isn't enough.
+ */
+static int builder_reserve(lcz_param_file_builder_t *builder, size_t size)
+{
+	size_t required;
+	size_t capacity;
+	char *str;
+	int r;
+
+	if ((builder->length + size) <= builder->capacity) {
+		return 0;
+	}
+
+	if (builder->fname != NULL) {
+		r = lcz_param_file_builder_flush(builder);
+		if (r < 0) {
+			return r;
+		} else if (size <= builder->capacity) {
+			return 0;
+		}
+	}
+
+	required = builder->length + size;
+	if (required > PARAMS_MAX_FILE_SIZE) {
+		return -ENOMEM;
+	}
+
+	capacity = builder->capacity;
+	while (capacity < required) {
+		capacity *= 2;
+	}
+	capacity = MIN(capacity, PARAMS_MAX_FILE_SIZE);
+
+	str = k_malloc(capacity);
+	if (str == NULL) {
+		return -ENOMEM;
+	}
+
+	memcpy(str, builder->str, builder->length + SIZE_OF_NUL);
+	memset(builder->str, 0, builder->capacity);
+	k_free(builder->str);
+	builder->str = str;
+	builder->capacity = capacity;
+
+	return 0;
+}
+
 static int lcz_param_file_init(const struct device *device)
 {
 	ARG_UNUSED(device);
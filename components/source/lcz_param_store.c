@@ -0,0 +1,463 @@
+/**
+ * @file lcz_param_store.c
+ * @brief Parameter file with changes journaled to a delta file.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(lcz_param_store, CONFIG_LCZ_PARAM_STORE_LOG_LEVEL);
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <init.h>
+#include <zephyr.h>
+#include <fs/fs.h>
+#include <string.h>
+
+#include "file_system_utilities.h"
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+#include "encrypted_file_storage.h"
+#endif
+#include "lcz_param_store.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define BREAK_ON_ERROR(x)                                                                          \
+	if (x < 0) {                                                                               \
+		break;                                                                             \
+	}
+
+#define STORE_PATH CONFIG_LCZ_PARAM_FILE_MOUNT_POINT "/" CONFIG_LCZ_PARAM_FILE_PATH "/"
+
+#define BASE_PATH STORE_PATH CONFIG_LCZ_PARAM_STORE_FILE
+#define JOURNAL_PATH STORE_PATH CONFIG_LCZ_PARAM_STORE_JOURNAL_FILE
+#define TEMP_PATH STORE_PATH CONFIG_LCZ_PARAM_STORE_FILE ".tmp"
+#define QUARANTINE_PATH STORE_PATH CONFIG_LCZ_PARAM_STORE_JOURNAL_FILE ".bad"
+
+#define ENCRYPTED IS_ENABLED(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+
+BUILD_ASSERT(sizeof(TEMP_PATH) <= FSU_MAX_ABS_PATH_SIZE, "Param store path too long");
+BUILD_ASSERT(sizeof(QUARANTINE_PATH) <= FSU_MAX_ABS_PATH_SIZE, "Param store path too long");
+
+typedef struct parsed_file {
+	size_t size;
+	char *str;
+	param_kvp_t *kv;
+	int pairs;
+	uint16_t *index;
+} parsed_file_t;
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static int lcz_param_store_init(const struct device *device);
+static void compact_work_handler(struct k_work *work);
+
+static int compact(void);
+static int parse(const char *fname, parsed_file_t *file);
+static void free_parsed(parsed_file_t *file);
+static int append_kvp(lcz_param_file_builder_t *builder, const param_kvp_t *kvp);
+static int append_journal(void *data, size_t size);
+static ssize_t trim_journal(void);
+static void quarantine_journal(void);
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+static int write_temp(const char *str, size_t length);
+#endif
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+static K_MUTEX_DEFINE(store_mutex);
+
+static K_WORK_DELAYABLE_DEFINE(compact_work, compact_work_handler);
+
+/* Bytes appended to the journal since it was last compacted */
+static size_t journal_size;
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+/* Initialize after the parameter file module */
+SYS_INIT(lcz_param_store_init, APPLICATION, CONFIG_LCZ_PARAM_STORE_INIT_PRIORITY);
+
+int lcz_param_store_set(param_id_t id, param_t type, const void *data, size_t dsize)
+{
+	lcz_param_file_builder_t builder;
+	int r;
+
+	r = lcz_param_file_builder_init(&builder, NULL, false, LCZ_PARAM_FILE_FORMAT_TEXT);
+	if (r < 0) {
+		return r;
+	}
+
+	do {
+		r = lcz_param_file_builder_append(&builder, id, type, data, dsize);
+		BREAK_ON_ERROR(r);
+
+		k_mutex_lock(&store_mutex, K_FOREVER);
+		r = append_journal(builder.str, builder.length);
+		if (r >= 0) {
+			journal_size += builder.length;
+			/* Each change restarts the quiet period */
+			if (journal_size >= CONFIG_LCZ_PARAM_STORE_COMPACT_THRESHOLD) {
+				k_work_reschedule(&compact_work, K_NO_WAIT);
+			} else {
+				k_work_reschedule(&compact_work,
+						  K_MSEC(CONFIG_LCZ_PARAM_STORE_QUIET_PERIOD_MS));
+			}
+		}
+		k_mutex_unlock(&store_mutex);
+
+	} while (0);
+
+	lcz_param_file_builder_free(&builder);
+
+	if (r < 0) {
+		LOG_ERR("Unable to journal id: %d: %d", id, r);
+	}
+
+	return (r < 0) ? r : 0;
+}
+
+int lcz_param_store_flush(void)
+{
+	int r;
+
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	(void)k_work_cancel_delayable(&compact_work);
+	r = compact();
+	k_mutex_unlock(&store_mutex);
+
+	return r;
+}
+
+int lcz_param_store_parse(size_t *fsize, char **fstr, param_kvp_t **kv)
+{
+	int r;
+
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	(void)k_work_cancel_delayable(&compact_work);
+	r = compact();
+	if (r >= 0) {
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+		r = lcz_param_file_enc_parse_from_file(BASE_PATH, fsize, fstr, kv);
+#else
+		r = lcz_param_file_parse_from_file(BASE_PATH, fsize, fstr, kv);
+#endif
+	}
+	k_mutex_unlock(&store_mutex);
+
+	return r;
+}
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static int lcz_param_store_init(const struct device *device)
+{
+	ARG_UNUSED(device);
+	ssize_t size;
+
+	/* Merge changes that weren't compacted before a reset */
+	size = fsu_get_file_size_abs(JOURNAL_PATH);
+	if (size > 0) {
+		journal_size = size;
+		k_work_schedule(&compact_work, K_NO_WAIT);
+	}
+
+	return 0;
+}
+
+static void compact_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&store_mutex, K_FOREVER);
+	(void)compact();
+	k_mutex_unlock(&store_mutex);
+}
+
+/**
+ * @brief Write the parameter file with the journal applied to a temporary
+ * file and then replace the parameter file. Parameters keep their position in
+ * the parameter file; new parameters are added to the end. If a reset occurs
+ * before the journal is deleted, then it is applied again (which is harmless).
+ *
+ * Mutex must be held.
+ */
+static int compact(void)
+{
+	parsed_file_t base = { 0 };
+	parsed_file_t journal = { 0 };
+	lcz_param_file_builder_t builder = { 0 };
+	lcz_param_file_format_t format = LCZ_PARAM_FILE_FORMAT_TEXT;
+	const param_kvp_t *kvp;
+	bool discard = false;
+	int r;
+	int i;
+
+	if (fsu_get_file_size_abs(JOURNAL_PATH) <= 0) {
+		journal_size = 0;
+		return 0;
+	}
+
+	do {
+		r = parse(JOURNAL_PATH, &journal);
+		if (r == -EINVAL) {
+			/* The last line may be incomplete if a reset occurred during a write.
+			 * Complete lines have been acknowledged, so only that line is removed.
+			 */
+			r = trim_journal();
+			if (r == 0) {
+				discard = true;
+				break;
+			} else if (r > 0) {
+				r = parse(JOURNAL_PATH, &journal);
+			}
+			/* A journal that still can't be parsed would block every later
+			 * compaction (and parse), so it is moved aside.
+			 */
+			if (r == -EINVAL) {
+				quarantine_journal();
+				discard = true;
+				r = 0;
+				break;
+			}
+		}
+		BREAK_ON_ERROR(r);
+
+		if (fsu_get_file_size_abs(BASE_PATH) > 0) {
+			r = parse(BASE_PATH, &base);
+			BREAK_ON_ERROR(r);
+			/* The parameter file keeps its format (the journal is always text) */
+			format = lcz_param_file_get_format(base.str, base.size);
+		}
+
+		/* An encrypted file is built in RAM and then written by write_temp */
+		r = lcz_param_file_builder_init(&builder, ENCRYPTED ? NULL : TEMP_PATH, false,
+						format);
+		BREAK_ON_ERROR(r);
+
+		for (i = 0; i < base.pairs && r >= 0; i++) {
+			kvp = lcz_param_file_find(journal.kv, journal.index, journal.pairs,
+						  base.kv[i].id);
+			r = append_kvp(&builder, (kvp != NULL) ? kvp : &base.kv[i]);
+		}
+		BREAK_ON_ERROR(r);
+
+		for (i = 0; i < journal.pairs && r >= 0; i++) {
+			/* Only the last value of a new parameter is added */
+			kvp = lcz_param_file_find(journal.kv, journal.index, journal.pairs,
+						  journal.kv[i].id);
+			if (kvp == &journal.kv[i] &&
+			    lcz_param_file_find(base.kv, base.index, base.pairs, kvp->id) == NULL) {
+				r = append_kvp(&builder, kvp);
+			}
+		}
+		BREAK_ON_ERROR(r);
+
+		r = lcz_param_file_builder_flush(&builder);
+		BREAK_ON_ERROR(r);
+
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+		r = write_temp(builder.str, builder.length);
+		BREAK_ON_ERROR(r);
+#endif
+
+		/* Either file may be kept open by the file system utilities */
+		(void)fsu_close_cached(TEMP_PATH);
+		(void)fsu_close_cached(BASE_PATH);
+		r = fs_rename(TEMP_PATH, BASE_PATH);
+		if (r < 0) {
+			LOG_ERR("Unable to replace parameter file: %d", r);
+			break;
+		}
+
+		LOG_DBG("Compacted %d changes into %d parameters", journal.pairs, base.pairs);
+
+	} while (0);
+
+	lcz_param_file_builder_free(&builder);
+	free_parsed(&base);
+	free_parsed(&journal);
+
+	/* The journal is kept when the parameter file couldn't be written */
+	if (r >= 0 || discard) {
+		(void)fsu_delete_abs(JOURNAL_PATH);
+		journal_size = 0;
+	}
+
+	return r;
+}
+
+static int parse(const char *fname, parsed_file_t *file)
+{
+	int r;
+
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+	r = lcz_param_file_enc_parse_from_file(fname, &file->size, &file->str, &file->kv);
+#else
+	r = lcz_param_file_parse_from_file(fname, &file->size, &file->str, &file->kv);
+#endif
+	if (r < 0) {
+		return r;
+	}
+
+	file->pairs = r;
+	return lcz_param_file_build_index(file->kv, file->pairs, &file->index);
+}
+
+static void free_parsed(parsed_file_t *file)
+{
+	if (file->str != NULL) {
+		memset(file->str, 0, file->size);
+	}
+	k_free(file->str);
+	k_free(file->kv);
+	k_free(file->index);
+}
+
+/* Values are copied as is (text) unless they are from a CBOR file.
+ * In a CBOR file, a binary value from the journal is stored as its hex text.
+ */
+static int append_kvp(lcz_param_file_builder_t *builder, const param_kvp_t *kvp)
+{
+	return lcz_param_file_builder_append(builder, kvp->id, kvp->binary ? PARAM_BIN : PARAM_STR,
+					     kvp->keystr, kvp->length);
+}
+
+static int append_journal(void *data, size_t size)
+{
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+	return efs_append(JOURNAL_PATH, data, size);
+#else
+	return fsu_append_abs(JOURNAL_PATH, data, size);
+#endif
+}
+
+/**
+ * @brief Remove an incomplete last line from the journal. A journal that
+ * ends with a complete line is left as is.
+ *
+ * @retval negative on error, otherwise the size of the journal.
+ */
+static ssize_t trim_journal(void)
+{
+	ssize_t size;
+	ssize_t length;
+	ssize_t r;
+	char *str;
+
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+	size = efs_get_file_size(JOURNAL_PATH);
+#else
+	size = fsu_get_file_size_abs(JOURNAL_PATH);
+#endif
+	if (size <= 0) {
+		return size;
+	}
+
+	str = k_malloc(size);
+	if (str == NULL) {
+		return -ENOMEM;
+	}
+
+	do {
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+		r = efs_read(JOURNAL_PATH, str, size);
+#else
+		r = fsu_read_abs(JOURNAL_PATH, str, size);
+#endif
+		if (r != size) {
+			r = (r < 0) ? r : -EIO;
+			break;
+		}
+
+		length = size;
+		while (length > 0 && str[length - 1] != '\n') {
+			length--;
+		}
+
+		if (length == size) {
+			LOG_ERR("Invalid parameter journal");
+			r = -EINVAL;
+			break;
+		}
+
+		LOG_WRN("Incomplete parameter journal entry discarded (%d bytes)", size - length);
+		if (length == 0) {
+			r = 0;
+			break;
+		}
+
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+		r = efs_write(JOURNAL_PATH, str, length);
+#else
+		r = fsu_write_abs(JOURNAL_PATH, str, length);
+#endif
+		if (r >= 0) {
+			r = length;
+		}
+
+	} while (0);
+
+	memset(str, 0, size);
+	k_free(str);
+
+	if (r < 0) {
+		LOG_ERR("Unable to trim parameter journal: %d", r);
+	}
+
+	return r;
+}
+
+/* The journal is kept for inspection; a previous one is replaced */
+static void quarantine_journal(void)
+{
+	int r;
+
+	/* Either file may be kept open by the file system utilities */
+	(void)fsu_close_cached(JOURNAL_PATH);
+	(void)fsu_close_cached(QUARANTINE_PATH);
+	r = fs_rename(JOURNAL_PATH, QUARANTINE_PATH);
+	if (r < 0) {
+		LOG_ERR("Unable to quarantine parameter journal: %d", r);
+	} else {
+		LOG_ERR("Invalid parameter journal moved to %s", QUARANTINE_PATH);
+	}
+}
+
+#if defined(CONFIG_LCZ_PARAM_STORE_ENCRYPTED)
+/* Encrypted blocks are bound to a file name, so the temporary file is written
+ * as the parameter file. Otherwise, it couldn't be read after it is renamed.
+ */
+static int write_temp(const char *str, size_t length)
+{
+	struct efs_file file;
+	ssize_t written;
+	int r;
+
+	r = efs_file_open_as(&file, TEMP_PATH, BASE_PATH, FS_O_RDWR | FS_O_CREATE | EFS_O_TRUNC);
+	if (r < 0) {
+		LOG_ERR("Unable to open temporary parameter file: %d", r);
+		return r;
+	}
+
+	written = efs_file_write(&file, str, length);
+	r = efs_file_close(&file);
+	if (written < 0) {
+		r = written;
+	}
+
+	if (r < 0) {
+		LOG_ERR("Unable to write temporary parameter file: %d", r);
+	}
+
+	return r;
+}
+#endif
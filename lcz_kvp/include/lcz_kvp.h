@@ -35,6 +35,32 @@ typedef struct lcz_kvp {
 	int val_len;
 } lcz_kvp_t;
 
+/**
+ * @brief Called by the streaming parser for each key-value pair.
+ * The key and value are only valid until the callback returns.
+ *
+ * @param kvp key-value pair (not null terminated)
+ * @param context from lcz_kvp_parse_stream
+ *
+ * @retval negative value to stop parsing, otherwise 0.
+ */
+typedef int (*lcz_kvp_callback_t)(const lcz_kvp_t *kvp, void *context);
+
+/* Builds a key-value pair file in RAM or writes it to a file in chunks.
+ * Members are managed by the lcz_kvp_builder functions.
+ */
+typedef struct lcz_kvp_builder {
+	lcz_kvp_cfg_t cfg;
+	/* Absolute path of output file; NULL when the file is built in RAM */
+	const char *fname;
+	/* Null terminated */
+	char *str;
+	size_t length;
+	size_t capacity;
+	/* Bytes written to the file */
+	size_t flushed;
+} lcz_kvp_builder_t;
+
 /* Using quotes "" for empty string makes it easier to validate file because
  * an empty value can be treated as invalid.
  */
@@ -96,6 +122,55 @@ int lcz_kvp_delete(char *name);
 int lcz_kvp_parse_from_file(const lcz_kvp_cfg_t *cfg, const char *fname, size_t *fsize, char **fstr,
 			    lcz_kvp_t **kv);
 
+/**
+ * @brief Parses a text file in a single pass without reading the entire file
+ * into RAM. The file is read in chunks of CONFIG_LCZ_KV_PARSER_CHUNK_SIZE and
+ * lines are limited to CONFIG_LCZ_KV_PARSER_MAX_LINE_SIZE.
+ *
+ * @note Because the file is not validated before the first callback,
+ * the callback may be called for pairs preceding an error in the file.
+ *
+ * @param cfg file configuration
+ * @param fname absolute path name of file
+ * @param cb called for each key-value pair in file order
+ * @param context passed to callback
+ *
+ * @retval negative error code (or callback error) or number of key-value
+ * pairs found.
+ */
+int lcz_kvp_parse_stream(const lcz_kvp_cfg_t *cfg, const char *fname, lcz_kvp_callback_t cb,
+			 void *context);
+
+/**
+ * @brief Build an index of key-value pairs sorted by key.
+ * The key-value pairs are not modified (file order is preserved).
+ *
+ * @param kv array of key-value pairs (from lcz_kvp_parse_from_file)
+ * @param pairs number of key-value pairs
+ * @param index array of positions in kv (allocated by this function)
+ *
+ * @retval negative error code, 0 on success.
+ *
+ * @note Caller is responsible for freeing index.
+ */
+int lcz_kvp_build_index(const lcz_kvp_t *kv, int pairs, uint16_t **index);
+
+/**
+ * @brief Find a key. If a key occurs more than once, then the last
+ * occurrence in the file is returned (matching the result of applying the
+ * file in order).
+ *
+ * @param kv array of key-value pairs
+ * @param index from lcz_kvp_build_index (O(log N)) or NULL (O(N))
+ * @param pairs number of key-value pairs
+ * @param key to find (doesn't need to be null terminated)
+ * @param key_len length of key
+ *
+ * @retval key-value pair or NULL if not found.
+ */
+const lcz_kvp_t *lcz_kvp_find(const lcz_kvp_t *kv, const uint16_t *index, int pairs,
+			      const char *key, int key_len);
+
 /**
  * @brief Validate a file.
  *
@@ -117,11 +192,58 @@ int lcz_kvp_validate_file(const lcz_kvp_cfg_t *cfg, const char *str, size_t size
  * to NULL.
  *
  * @note Caller is responsible for freeing fstr.
+ * @note Each call is O(N) in the length of fstr; lcz_kvp_builder is O(1).
  *
  * @retval negative on error, otherwise number of bytes added to file string.
  */
 int lcz_kvp_generate_file(const lcz_kvp_cfg_t *cfg, const lcz_kvp_t *kvp, char **fstr);
 
+/**
+ * @brief Initialize a file builder. Unlike lcz_kvp_generate_file, the length
+ * of the file is tracked so that appending is O(1) (not O(N)).
+ *
+ * @param builder to initialize
+ * @param cfg file configuration. When building in RAM, the buffer grows
+ * geometrically to a maximum of cfg->max_file_out_size.
+ * @param fname When NULL, the file is built in RAM (builder->str).
+ * Otherwise, the absolute path of the file to write. The buffer is written to
+ * the file when it is full and when lcz_kvp_builder_flush is called. The
+ * size of the file is not limited by cfg->max_file_out_size.
+ *
+ * @retval negative error code, 0 on success.
+ *
+ * @note Caller is responsible for calling lcz_kvp_builder_free.
+ */
+int lcz_kvp_builder_init(lcz_kvp_builder_t *builder, const lcz_kvp_cfg_t *cfg, const char *fname);
+
+/**
+ * @brief Append a key-value pair.
+ *
+ * @param builder file builder
+ * @param kvp key-value pair
+ *
+ * @retval negative on error, otherwise number of bytes added to file.
+ */
+int lcz_kvp_builder_append(lcz_kvp_builder_t *builder, const lcz_kvp_t *kvp);
+
+/**
+ * @brief Write the contents of the buffer to the file.
+ * The first write replaces the file; subsequent writes append to it.
+ * Does nothing when building in RAM.
+ *
+ * @param builder file builder
+ *
+ * @retval negative error code, 0 on success.
+ */
+int lcz_kvp_builder_flush(lcz_kvp_builder_t *builder);
+
+/**
+ * @brief Clear and free the buffer. Data that hasn't been flushed is discarded.
+ *
+ * @param builder file builder
+ */
+void lcz_kvp_builder_free(lcz_kvp_builder_t *builder);
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,7 +15,6 @@ LOG_MODULE_REGISTER(lcz_kvp, CONFIG_LCZ_KVP_LOG_LEVEL);
 /**************************************************************************************************/
 #include <init.h>
 #include <zephyr.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -23,6 +22,7 @@ LOG_MODULE_REGISTER(lcz_kvp, CONFIG_LCZ_KVP_LOG_LEVEL);
 #include "encrypted_file_storage.h"
 #endif
 #include "file_system_utilities.h"
+#include "lcz_kv_parser.h"
 #include "lcz_kvp.h"
 
 /**************************************************************************************************/
@@ -41,7 +41,7 @@ LOG_MODULE_REGISTER(lcz_kvp, CONFIG_LCZ_KVP_LOG_LEVEL);
 #endif
 
 typedef struct func_context {
-	ssize_t (*get_size)(const char *abs_path);
+	const lcz_kv_io_t *io;
 	ssize_t (*read)(const char *abs_path, void *data, size_t size);
 	ssize_t (*write)(const char *abs_path, void *data, size_t size);
 	ssize_t (*append)(const char *abs_path, void *data, size_t size);
@@ -51,9 +51,27 @@ typedef struct func_context {
 #define TERMINATOR '\0'
 #define DELIMITER '='
 #define COMMENT_CHAR '#'
-#define CR_CHAR '\r'
 #define EOL_CHAR '\n'
 
+/* Context of the streaming parser */
+typedef struct stream {
+	lcz_kvp_callback_t cb;
+	void *context;
+} stream_t;
+
+/* Context of the in-place parser */
+typedef struct table {
+	lcz_kvp_t *kv;
+	size_t capacity;
+	int pairs;
+} table_t;
+
+#define BUILDER_INITIAL_SIZE CONFIG_LCZ_KVP_BUILDER_INITIAL_SIZE
+#define BUILDER_CHUNK_SIZE CONFIG_LCZ_KVP_BUILDER_CHUNK_SIZE
+
+/* Delimiter, EOL, and terminator */
+#define LINE_OVERHEAD 3
+
 #define APPEND(k, l)                                                                               \
 	memcpy(&str[length], (k), (l));                                                            \
 	length += (l)
@@ -65,17 +83,29 @@ typedef struct func_context {
 /**************************************************************************************************/
 static bool kvp_ready;
 
+static const lcz_kv_syntax_t kvp_syntax = {
+	.key_type = LCZ_KV_KEY_STRING,
+	.delimiter = DELIMITER,
+	.comment = COMMENT_CHAR,
+	.delimiter_in_value = true,
+	.require_value = true,
+};
+
 /**************************************************************************************************/
 /* Local Function Prototypes                                                                      */
 /**************************************************************************************************/
 static func_context_t get_func_context(bool encrypted);
 
-static int read_text(const func_context_t *ctx, const char *fname, char **fstr, size_t fsize);
-
-static char *parse_kvp(char *start, lcz_kvp_t *kvp);
-static int parse_kvp_file(const char *str, size_t length, int pairs, lcz_kvp_t *kv);
+static void token_to_kvp(const lcz_kv_token_t *token, lcz_kvp_t *kvp);
+static int stream_pair(const lcz_kv_token_t *token, void *context);
+static int table_pair(const lcz_kv_token_t *token, void *context);
 
 static int append_kvp_line(const lcz_kvp_cfg_t *cfg, const lcz_kvp_t *kvp, char *str);
+static size_t write_kvp_line(char *str, size_t length, const lcz_kvp_t *kvp);
+static int builder_reserve(lcz_kvp_builder_t *builder, size_t size);
+
+static int compare_key(const lcz_kvp_t *kvp, const char *key, int key_len);
+static bool index_less(const void *array, uint16_t a, uint16_t b);
 
 static bool valid_cfg(const lcz_kvp_cfg_t *cfg);
 static bool valid_kvp(const lcz_kvp_t *kvp);
@@ -164,9 +194,9 @@ int lcz_kvp_delete(char *name)
 int lcz_kvp_parse_from_file(const lcz_kvp_cfg_t *cfg, const char *fname, size_t *fsize, char **fstr,
 			    lcz_kvp_t **kv)
 {
-	int r = -EPERM;
-	ssize_t file_size;
 	func_context_t ctx;
+	table_t table;
+	int r;
 
 	*fsize = 0;
 	*fstr = NULL;
@@ -178,62 +208,59 @@ int lcz_kvp_parse_from_file(const lcz_kvp_cfg_t *cfg, const char *fname, size_t
 	}
 
 	ctx = get_func_context(cfg->encrypted);
-	if (ctx.get_size == NULL) {
+	if (ctx.io == NULL) {
 		return -ENOTSUP;
 	}
 
-	do {
-		r = file_size = ctx.get_size(fname);
-		LOG_DBG("'%s' %s kvp file size bytes: %d", fname, ctx.msg, file_size);
-		if (file_size < 0) {
-			break;
-		} else if (file_size == 0) {
-			r = -ENOENT;
-			LOG_ERR("%s kvp file %s is empty", ctx.msg, fname);
-			break;
-		}
-
-		r = file_size = read_text(&ctx, fname, fstr, file_size);
-		if (r < 0) {
-			break;
-		}
-		LOG_VRB("stripped size: %u ", file_size);
-
-		r = lcz_kvp_validate_file(cfg, *fstr, file_size);
-		if (r < 0) {
-			break;
-		}
-
-		/* allocate key-pointer-to-value pairs */
-		*kv = k_calloc(r, sizeof(lcz_kvp_t));
-		if (*kv == NULL) {
+	/* Key-value pairs point to locations in the file */
+	memset(&table, 0, sizeof(table));
+	r = lcz_kv_parser_load(&kvp_syntax, ctx.io, fname, fsize, fstr, table_pair, &table);
+	if (r >= 0 && table.kv == NULL) {
+		/* A file of comments has no pairs */
+		table.kv = k_calloc(1, sizeof(lcz_kvp_t));
+		if (table.kv == NULL) {
 			r = -ENOMEM;
-			break;
 		}
+	}
 
-		/* Point to locations in the file. Compute key and value lengths. */
-		r = parse_kvp_file(*fstr, file_size, r, *kv);
-		if (r < 0) {
-			break;
-		}
-
-	} while (0);
-
-	*fsize = file_size;
 	if (r < 0) {
 		/* Clear encrypted file data */
 		if (*fstr != NULL) {
 			memset(*fstr, 0, *fsize);
 			k_free(*fstr);
 		}
-		k_free(*kv);
+		k_free(table.kv);
+		*fsize = 0;
 		*fstr = NULL;
-		*kv = NULL;
+	} else {
+		*kv = table.kv;
+		KVP_HEXDUMP(*fstr, *fsize, "kvp str");
 	}
 
 	return r;
 }
 
+int lcz_kvp_parse_stream(const lcz_kvp_cfg_t *cfg, const char *fname, lcz_kvp_callback_t cb,
+			 void *context)
+{
+	func_context_t ctx;
+	stream_t s;
+
+	if (!valid_cfg(cfg) || fname == NULL || cb == NULL) {
+		LOG_ERR("Invalid kvp stream parameters");
+		return -EINVAL;
+	}
+
+	ctx = get_func_context(cfg->encrypted);
+	if (ctx.io == NULL) {
+		return -ENOTSUP;
+	}
+
+	s.cb = cb;
+	s.context = context;
+	return lcz_kv_parser_stream(&kvp_syntax, ctx.io, fname, stream_pair, &s);
+}
+
 int lcz_kvp_generate_file(const lcz_kvp_cfg_t *cfg, const lcz_kvp_t *kvp, char **fstr)
 {
 	int r = 0;
@@ -268,256 +295,214 @@ int lcz_kvp_generate_file(const lcz_kvp_cfg_t *cfg, const lcz_kvp_t *kvp, char *
 	return r;
 }
 
-int lcz_kvp_validate_file(const lcz_kvp_cfg_t *cfg, const char *str, size_t size)
+int lcz_kvp_builder_init(lcz_kvp_builder_t *builder, const lcz_kvp_cfg_t *cfg, const char *fname)
 {
-	int r = 0;
-	size_t delimiters = 0;
-	size_t lines = 0;
-	size_t pairs = 0;
-	bool comment = false;
-	bool in_value = false;
-	size_t distance = 0;
-	size_t i;
-
-	for (i = 0; i < size; i++) {
-		if (str[i] == DELIMITER && !in_value) {
-			delimiters += 1;
-			in_value = true;
-			if (distance <= 0) {
-				r = -EINVAL;
-				LOG_ERR("Invalid key length: %u line: %u", distance, lines);
-				break;
-			}
-			distance = 0;
-		} else if (str[i] == EOL_CHAR) {
-			lines += 1;
-			in_value = false;
-			if (!comment) {
-				pairs += 1;
-				if (distance <= 0) {
-					r = -EINVAL;
-					LOG_ERR("Invalid value length: %u line: %u", distance,
-						lines);
-					break;
-				}
-			}
-			comment = false;
-			distance = 0;
-		} else if (str[i] == COMMENT_CHAR) {
-			if (!comment) {
-				comment = true;
-				if (distance != 0) {
-					r = -EINVAL;
-					LOG_ERR("Comment character must start line: %u pos: %u abs pos: %u",
-						lines + 1, distance, i);
-					break;
-				}
-			}
-		} else if (!isprint((int)str[i])) {
-			r = -EINVAL;
-			LOG_ERR("Non-printable char 0x%x at line: %u pos: %u absolute pos: %u",
-				str[i], lines + 1, distance, i);
-			break;
-		} else {
-			distance += 1;
-		}
+	func_context_t ctx;
+
+	if (builder == NULL || !valid_cfg(cfg)) {
+		return -EINVAL;
 	}
 
-	KVP_HEXDUMP(str, size, "kvp str");
+	memset(builder, 0, sizeof(*builder));
 
-	if (delimiters != pairs) {
-		r = -EINVAL;
+	if (fname != NULL) {
+		ctx = get_func_context(cfg->encrypted);
+		if (ctx.write == NULL) {
+			return -ENOTSUP;
+		}
 	}
-	LOG_DBG("Found %u pairs status: %d", pairs, r);
 
-	return (r < 0) ? r : pairs;
+	builder->cfg = *cfg;
+	builder->fname = fname;
+	builder->capacity = MIN((fname == NULL) ? BUILDER_INITIAL_SIZE : BUILDER_CHUNK_SIZE,
+				cfg->max_file_out_size);
+	builder->str = k_malloc(builder->capacity);
+	if (builder->str == NULL) {
+		LOG_ERR("Unable to allocate kvp file");
+		return -ENOMEM;
+	}
+	builder->str[0] = TERMINATOR;
+
+	return 0;
 }
 
-/**************************************************************************************************/
-/* Local Function Definitions                                                                     */
-/**************************************************************************************************/
-static char *parse_kvp(char *start, lcz_kvp_t *kvp)
+int lcz_kvp_builder_append(lcz_kvp_builder_t *builder, const lcz_kvp_t *kvp)
 {
-	char *next = NULL;
-	char *delimiter;
-	char *newline;
+	size_t start;
+	int r;
 
-	delimiter = strchr(start, DELIMITER);
-	newline = strchr(delimiter, EOL_CHAR);
+	if (builder == NULL || builder->str == NULL || !valid_kvp(kvp)) {
+		return -EINVAL;
+	}
 
-	do {
-		if (delimiter == NULL) {
-			LOG_ERR("Delimiter not found");
-			break;
-		}
+	r = builder_reserve(builder, kvp->key_len + kvp->val_len + LINE_OVERHEAD);
+	if (r < 0) {
+		LOG_ERR("Unable to append kvp: %d", r);
+		return r;
+	}
 
-		/* Strings cannot contain eol or newlines */
-		if (newline == NULL) {
-			LOG_ERR("Newline not found");
-			break;
-		}
+	start = builder->length;
+	builder->length = write_kvp_line(builder->str, builder->length, kvp);
 
-		kvp->key = start;
-		kvp->key_len = delimiter - start;
-		kvp->val = delimiter + 1;
-		kvp->val_len = newline - kvp->val;
+	return builder->length - start;
+}
 
-		/* If the value matches "", then this is any empty string */
-		if (kvp->val_len == strlen(LCZ_KVP_EMPTY_VALUE_STR)) {
-			if (memcmp(LCZ_KVP_EMPTY_VALUE_STR, kvp->val, kvp->val_len) == 0) {
-				kvp->val_len = 0;
-			}
-		}
+int lcz_kvp_builder_flush(lcz_kvp_builder_t *builder)
+{
+	func_context_t ctx;
+	int r;
 
-		next = newline + 1;
-	} while (0);
+	if (builder == NULL || builder->str == NULL) {
+		return -EINVAL;
+	}
 
-	return next;
-}
+	if (builder->fname == NULL) {
+		return 0;
+	}
 
-/**
- * @retval negative on error, otherwise number of key-value pairs.
- */
-static int parse_kvp_file(const char *str, size_t length, int pairs, lcz_kvp_t *kv)
-{
-	char *next = (char *)str; /* start */
-	char *end = next + length;
-	int i;
+	ctx = get_func_context(builder->cfg.encrypted);
+	if (builder->flushed == 0) {
+		/* Replace any existing file */
+		r = ctx.write(builder->fname, builder->str, builder->length);
+	} else if (builder->length > 0) {
+		r = ctx.append(builder->fname, builder->str, builder->length);
+	} else {
+		r = 0;
+	}
 
-	for (i = 0; i < pairs; i++) {
-		if (next >= end) {
-			LOG_ERR("Unexpected end of kvp file");
-			pairs = -EPERM;
-			break;
-		}
+	if (r < 0) {
+		LOG_ERR("Unable to write %s kvp file %s: %d", ctx.msg, builder->fname, r);
+		return r;
+	}
 
-		next = parse_kvp(next, &kv[i]);
-		if (next == NULL) {
-			pairs = -EINVAL;
-			break;
+	builder->flushed += builder->length;
+	memset(builder->str, 0, builder->length);
+	builder->length = 0;
+
+	return 0;
+}
+
+void lcz_kvp_builder_free(lcz_kvp_builder_t *builder)
+{
+	if (builder != NULL) {
+		if (builder->str != NULL) {
+			memset(builder->str, 0, builder->capacity);
+			k_free(builder->str);
 		}
+		memset(builder, 0, sizeof(*builder));
 	}
+}
 
-	return pairs;
+int lcz_kvp_build_index(const lcz_kvp_t *kv, int pairs, uint16_t **index)
+{
+	return lcz_kv_index_build(kv, pairs, index_less, index);
 }
 
-/**
- * @brief Read the text file from the filesystem into a buffer in RAM.
- *
- * @param[in] ctx File context (clear or encrypted)
- * @param[in] fname Absolute file name of the file to read
- * @param[in] fstr Pointer to where the pointer to the data should be stored
- * @param[in] fsize Size of the file on disk
- *
- * @retval negative on error, otherwise size of string with carriage returns
- * removed.
- */
-static int read_text(const func_context_t *ctx, const char *fname, char **fstr, size_t fsize)
+const lcz_kvp_t *lcz_kvp_find(const lcz_kvp_t *kv, const uint16_t *index, int pairs,
+			      const char *key, int key_len)
 {
-	int r = 0;
-	int stripped_len = 0;
-	bool comment;
-	bool was_eol;
+	int lo = 0;
+	int hi = pairs;
+	int mid;
 	int i;
-	int j;
 
-	/* Validate the input parameters */
-	if (fname == NULL || fstr == NULL) {
-		LOG_ERR("read text %s: Invalid parameters", ctx->msg);
-		r = -EINVAL;
+	if (kv == NULL || key == NULL || pairs <= 0) {
+		return NULL;
 	}
 
-	/* Allocate memory for the file contents */
-	if (r == 0) {
-		*fstr = k_malloc(fsize + 1);
-		if (*fstr == NULL) {
-			LOG_ERR("read_text %s: Could not allocate %d bytes for %s", ctx->msg,
-				fsize + 1, fname);
-			r = -ENOMEM;
+	if (index == NULL) {
+		for (i = pairs - 1; i >= 0; i--) {
+			if (compare_key(&kv[i], key, key_len) == 0) {
+				return &kv[i];
+			}
 		}
+		return NULL;
 	}
 
-	/* Read the entire file into memory */
-	if (r == 0) {
-		r = ctx->read(fname, *fstr, fsize);
-		if (r != fsize) {
-			LOG_ERR("read_text %s: Could not read file %s: %d", ctx->msg, fname, r);
-			if (r >= 0) {
-				r = -EPERM;
-			}
+	/* Upper bound; duplicates are sorted by position so the last one is found */
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (compare_key(&kv[index[mid]], key, key_len) <= 0) {
+			lo = mid + 1;
 		} else {
-			r = 0;
+			hi = mid;
 		}
 	}
 
-	/* Strip the CRs from the file */
-	if (r == 0) {
-		i = 0;
-		j = 0;
-		while (i < fsize) {
-			if ((*fstr)[i] != CR_CHAR) {
-				(*fstr)[j] = (*fstr)[i];
-				j++;
-			}
-			i++;
-		}
-		/* Clear the remainder of the input string */
-		memset((*fstr) + j, 0, i - j);
-		stripped_len = j;
-	}
-
-	/* Strip the comments */
-	if (r == 0) {
-		i = 0;
-		j = 0;
-		comment = false;
-		while (i < stripped_len) {
-			if ((*fstr)[i] == COMMENT_CHAR) {
-				comment = true;
-			}
+	if (lo > 0 && compare_key(&kv[index[lo - 1]], key, key_len) == 0) {
+		return &kv[index[lo - 1]];
+	}
 
-			if (!comment) {
-				(*fstr)[j] = (*fstr)[i];
-				j++;
-			}
+	return NULL;
+}
 
-			/* Remove entire comment line */
-			if ((*fstr)[i] == EOL_CHAR) {
-				comment = false;
-			}
+int lcz_kvp_validate_file(const lcz_kvp_cfg_t *cfg, const char *str, size_t size)
+{
+	ARG_UNUSED(cfg);
 
-			i++;
-		}
-		/* Clear the remainder of the input string */
-		memset((*fstr) + j, 0, i - j);
-		stripped_len = j;
-	}
-
-	/* Strip blank lines */
-	if (r == 0) {
-		i = 0;
-		j = 0;
-		was_eol = true;
-		while (i < stripped_len) {
-			if (((*fstr)[i] != EOL_CHAR) || (((*fstr)[i] == EOL_CHAR) && !was_eol)) {
-				(*fstr)[j] = (*fstr)[i];
-				j++;
-			}
-			was_eol = ((*fstr)[i] == EOL_CHAR);
-			i++;
-		}
+	KVP_HEXDUMP(str, size, "kvp str");
+
+	return lcz_kv_parser_validate(&kvp_syntax, str, size);
+}
 
-		/* Clear the remainder of the input string */
-		memset((*fstr) + j, 0, i - j);
-		stripped_len = j;
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static void token_to_kvp(const lcz_kv_token_t *token, lcz_kvp_t *kvp)
+{
+	kvp->key = (char *)token->key;
+	kvp->key_len = token->key_len;
+	kvp->val = (char *)token->value;
+	kvp->val_len = token->value_len;
+
+	/* If the value matches "", then this is any empty string */
+	if (kvp->val_len == strlen(LCZ_KVP_EMPTY_VALUE_STR)) {
+		if (memcmp(LCZ_KVP_EMPTY_VALUE_STR, kvp->val, kvp->val_len) == 0) {
+			kvp->val_len = 0;
+		}
 	}
+}
 
-	/* Return the stripped length or the error code */
-	if (r == 0) {
-		return stripped_len;
-	} else {
-		return r;
+static int stream_pair(const lcz_kv_token_t *token, void *context)
+{
+	stream_t *s = context;
+	lcz_kvp_t kvp;
+
+	token_to_kvp(token, &kvp);
+	KVP_HEXDUMP(token->key, token->key_len + token->value_len + 1, "kvp line");
+
+	return s->cb(&kvp, s->context);
+}
+
+static int table_pair(const lcz_kv_token_t *token, void *context)
+{
+	table_t *t = context;
+	lcz_kvp_t *kvp;
+
+	kvp = lcz_kv_parser_array_add((void **)&t->kv, &t->capacity, t->pairs, sizeof(lcz_kvp_t));
+	if (kvp == NULL) {
+		return -ENOMEM;
 	}
+
+	token_to_kvp(token, kvp);
+	t->pairs += 1;
+	return 0;
+}
+
+static int compare_key(const lcz_kvp_t *kvp, const char *key, int key_len)
+{
+	int r = memcmp(kvp->key, key, MIN(kvp->key_len, key_len));
+
+	return (r != 0) ? r : (kvp->key_len - key_len);
+}
+
+/* Position is the tie breaker so that the (unstable) heap sort is stable */
+static bool index_less(const void *array, uint16_t a, uint16_t b)
+{
+	const lcz_kvp_t *kv = array;
+	int r = compare_key(&kv[a], kv[b].key, kv[b].key_len);
+
+	return (r < 0) || (r == 0 && a < b);
 }
 
 static bool valid_cfg(const lcz_kvp_cfg_t *cfg)
@@ -581,12 +566,7 @@ static int append_kvp_line(const lcz_kvp_cfg_t *cfg, const lcz_kvp_t *kvp, char
 			break;
 		}
 
-		APPEND(kvp->key, kvp->key_len);
-		APPEND_CHAR(DELIMITER);
-		APPEND(kvp->val, kvp->val_len);
-		APPEND_CHAR(EOL_CHAR);
-		str[length] = TERMINATOR;
-		/* Don't add terminator to length or strlen won't match */
+		length = write_kvp_line(str, length, kvp);
 
 	} while (0);
 
@@ -595,19 +575,84 @@ static int append_kvp_line(const lcz_kvp_cfg_t *cfg, const lcz_kvp_t *kvp, char
 	return line_len;
 }
 
+/**
+ * @retval new length of string
+ */
+static size_t write_kvp_line(char *str, size_t length, const lcz_kvp_t *kvp)
+{
+	APPEND(kvp->key, kvp->key_len);
+	APPEND_CHAR(DELIMITER);
+	APPEND(kvp->val, kvp->val_len);
+	APPEND_CHAR(EOL_CHAR);
+	str[length] = TERMINATOR;
+	/* Don't add terminator to length or strlen won't match */
+
+	return length;
+}
+
+/**
+ * @brief Make room for size bytes. When writing to a file, the buffer is
+ * flushed first. The buffer only grows when that isn't enough.
+ */
+static int builder_reserve(lcz_kvp_builder_t *builder, size_t size)
+{
+	size_t required;
+	size_t capacity;
+	char *str;
+	int r;
+
+	if ((builder->length + size) <= builder->capacity) {
+		return 0;
+	}
+
+	if (builder->fname != NULL) {
+		r = lcz_kvp_builder_flush(builder);
+		if (r < 0) {
+			return r;
+		} else if (size <= builder->capacity) {
+			return 0;
+		}
+	}
+
+	required = builder->length + size;
+	if (required > builder->cfg.max_file_out_size) {
+		return -ENOMEM;
+	}
+
+	capacity = builder->capacity;
+	while (capacity < required) {
+		capacity *= 2;
+	}
+	capacity = MIN(capacity, builder->cfg.max_file_out_size);
+
+	str = k_malloc(capacity);
+	if (str == NULL) {
+		return -ENOMEM;
+	}
+
+	memcpy(str, builder->str, builder->length + 1);
+	memset(builder->str, 0, builder->capacity);
+	k_free(builder->str);
+	builder->str = str;
+	builder->capacity = capacity;
+	LOG_VRB("builder capacity: %u", capacity);
+
+	return 0;
+}
+
 static func_context_t get_func_context(bool encrypted)
 {
 	func_context_t ctx;
 
 	if (encrypted) {
 #if defined(CONFIG_FSU_ENCRYPTED_FILES)
-		ctx.get_size = efs_get_file_size;
+		ctx.io = &lcz_kv_io_encrypted;
 		ctx.read = efs_read;
 		ctx.write = efs_write;
 		ctx.append = efs_append;
 		ctx.msg = "encrypted";
 #else
-		ctx.get_size = NULL;
+		ctx.io = NULL;
 		ctx.read = NULL;
 		ctx.write = NULL;
 		ctx.append = NULL;
@@ -615,7 +660,7 @@ static func_context_t get_func_context(bool encrypted)
 		LOG_ERR("%s", ctx.msg);
 #endif
 	} else {
-		ctx.get_size = fsu_get_file_size_abs;
+		ctx.io = &lcz_kv_io_clear;
 		ctx.read = fsu_read_abs;
 		ctx.write = fsu_write_abs;
 		ctx.append = fsu_append_abs;
@@ -52,6 +52,17 @@ void lcz_fs_mgmt_register_group(void);
  * @param cb Callback function or NULL to disable.
  */
 void lcz_fs_mgmt_register_evt_cb(fs_mgmt_on_evt_cb cb);
+
+/**
+ * @brief Check file access with the registered callback.
+ * Allows other transports to apply the same policy as mcumgr.
+ *
+ * @param path		The path of the file to query.
+ * @param write		True if write access is requested, false for read access
+ *
+ * @return true if access is allowed (or there isn't a callback)
+ */
+bool lcz_fs_mgmt_access_allowed(const char *path, bool write);
 #endif
 
 #ifdef __cplusplus
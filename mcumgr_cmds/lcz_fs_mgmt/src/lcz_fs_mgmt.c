@@ -25,6 +25,9 @@ LOG_MODULE_REGISTER(fs_mgmt);
 #include <fs/fs.h>
 #include "mgmt/mgmt.h"
 #include "file_system_utilities.h"
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+#include "encrypted_file_storage.h"
+#endif
 #include "lcz_fs_mgmt/lcz_fs_mgmt.h"
 #include "lcz_fs_mgmt/lcz_fs_mgmt_impl.h"
 #include "lcz_fs_mgmt/lcz_fs_mgmt_config.h"
@@ -43,6 +46,17 @@ static struct {
 
 	/** Total length of file currently being uploaded. */
 	size_t len;
+
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+	/** Whether an encrypted file is open for the upload. */
+	bool session;
+
+	/** Name of the encrypted file being uploaded. */
+	char session_name[CONFIG_LCZ_FS_MGMT_PATH_SIZE + 1];
+
+	/** Encrypted file being uploaded. */
+	struct efs_file efs;
+#endif
 } fs_mgmt_ctxt;
 
 /**************************************************************************************************/
@@ -57,6 +71,15 @@ static int fs_mgmt_file_status(struct mgmt_ctxt *ctxt);
 #if defined(CONFIG_LCZ_FS_MGMT_CHECKSUM_HASH)
 static int fs_mgmt_file_hash_checksum(struct mgmt_ctxt *ctxt);
 #endif
+static int upload_write(const char *path, size_t off, const void *data, size_t len);
+static int upload_finish(void);
+static void upload_sync(const char *path);
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+static int upload_session_write(const char *path, size_t off, const void *data, size_t len);
+static int upload_session_open(const char *path, fs_mode_t flags);
+static int upload_session_close(void);
+static void upload_session_timeout(struct k_work *work);
+#endif
 
 /**************************************************************************************************/
 /* Local Data Definitions                                                                         */
@@ -92,6 +115,12 @@ static struct mgmt_group fs_mgmt_group = {
 static fs_mgmt_on_evt_cb fs_evt_cb;
 #endif
 
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+/* The session is closed by the system work queue when an upload is abandoned */
+static K_MUTEX_DEFINE(session_mutex);
+static K_WORK_DELAYABLE_DEFINE(session_timeout_work, upload_session_timeout);
+#endif
+
 /**************************************************************************************************/
 /* Local Function Definitions                                                                     */
 /**************************************************************************************************/
@@ -149,6 +178,9 @@ static int fs_mgmt_file_download(struct mgmt_ctxt *ctxt)
 	}
 #endif
 
+	/* Data of an upload in progress must be in the file */
+	upload_sync(path);
+
 	/* Only the response to the first download request contains the total file
 	 * length.
 	 */
@@ -244,7 +276,7 @@ static int fs_mgmt_file_upload(struct mgmt_ctxt *ctxt)
 
 	if (file_data.len > 0) {
 		/* Write the data chunk to the file. */
-		rc = lcz_fs_mgmt_impl_write(file_name, off, file_data.value, file_data.len);
+		rc = upload_write(file_name, off, file_data.value, file_data.len);
 		if (rc != 0) {
 			return rc;
 		}
@@ -254,6 +286,10 @@ static int fs_mgmt_file_upload(struct mgmt_ctxt *ctxt)
 	if (fs_mgmt_ctxt.off == fs_mgmt_ctxt.len) {
 		/* Upload complete. */
 		fs_mgmt_ctxt.uploading = false;
+		rc = upload_finish();
+		if (rc != 0) {
+			return rc;
+		}
 	}
 
 	/* Send the response. */
@@ -292,6 +328,7 @@ static int fs_mgmt_file_status(struct mgmt_ctxt *ctxt)
 	path[name.len] = '\0';
 
 	/* Retrieve file size */
+	upload_sync(path);
 	rc = lcz_fs_mgmt_impl_filelen(path, &file_len);
 
 	/* Encode the response. */
@@ -353,6 +390,7 @@ static int fs_mgmt_file_hash_checksum(struct mgmt_ctxt *ctxt)
 	}
 
 	/* Check provided length is valid */
+	upload_sync(path);
 	rc = lcz_fs_mgmt_impl_filelen(path, &file_len);
 	if (rc != 0) {
 		return MGMT_ERR_ENOENT;
@@ -395,6 +433,146 @@ static int fs_mgmt_file_hash_checksum(struct mgmt_ctxt *ctxt)
 }
 #endif
 
+/**
+ * Writes an upload chunk. Encrypted files are written using an upload session
+ * so that each block is only encrypted once.
+ */
+static int upload_write(const char *path, size_t off, const void *data, size_t len)
+{
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+	if (efs_is_encrypted_path(path)) {
+		return upload_session_write(path, off, data, len);
+	}
+#endif
+	return lcz_fs_mgmt_impl_write(path, off, data, len);
+}
+
+/**
+ * Writes any buffered data of the last chunk.
+ */
+static int upload_finish(void)
+{
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+	int rc;
+
+	k_mutex_lock(&session_mutex, K_FOREVER);
+	rc = upload_session_close();
+	k_mutex_unlock(&session_mutex);
+
+	return rc;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Writes any buffered data of an upload in progress to path.
+ */
+static void upload_sync(const char *path)
+{
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+	k_mutex_lock(&session_mutex, K_FOREVER);
+	if (fs_mgmt_ctxt.session && strcmp(path, fs_mgmt_ctxt.session_name) == 0) {
+		if (efs_file_sync(&fs_mgmt_ctxt.efs) != 0) {
+			(void)upload_session_close();
+		}
+	}
+	k_mutex_unlock(&session_mutex);
+#else
+	ARG_UNUSED(path);
+#endif
+}
+
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+static int upload_session_write(const char *path, size_t off, const void *data, size_t len)
+{
+	ssize_t written;
+	int rc = 0;
+
+	k_mutex_lock(&session_mutex, K_FOREVER);
+
+	if (off == 0) {
+		/* Finish any previous upload and replace the file */
+		rc = upload_session_open(path, FS_O_RDWR | FS_O_CREATE | EFS_O_TRUNC);
+	} else if (!fs_mgmt_ctxt.session || strcmp(path, fs_mgmt_ctxt.session_name) != 0) {
+		/* The session timed out or was closed by a sync; continue the upload */
+		rc = upload_session_open(path, FS_O_RDWR);
+	}
+
+	if (rc == 0) {
+		/* A chunk can replace data that is already in the file (for example, after a
+		 * failed write). Only the blocks that contain the chunk are re-encrypted.
+		 */
+		if (efs_file_seek(&fs_mgmt_ctxt.efs, off, FS_SEEK_SET) != 0) {
+			/* Can't write past the end of the file */
+			rc = MGMT_ERR_EINVAL;
+		}
+	}
+
+	if (rc == 0) {
+		written = efs_file_write(&fs_mgmt_ctxt.efs, data, len);
+		if (written < 0) {
+			(void)upload_session_close();
+			rc = MGMT_ERR_EUNKNOWN;
+		} else {
+			k_work_reschedule(&session_timeout_work,
+					  K_SECONDS(CONFIG_LCZ_FS_MGMT_UPLOAD_SESSION_TIMEOUT));
+		}
+	} else if (rc < 0) {
+		rc = MGMT_ERR_EUNKNOWN;
+	}
+
+	k_mutex_unlock(&session_mutex);
+
+	return rc;
+}
+
+/* Mutex must be held */
+static int upload_session_open(const char *path, fs_mode_t flags)
+{
+	int rc;
+
+	(void)upload_session_close();
+
+	rc = efs_file_open(&fs_mgmt_ctxt.efs, path, flags);
+	if (rc == 0) {
+		fs_mgmt_ctxt.session = true;
+		strncpy(fs_mgmt_ctxt.session_name, path, sizeof(fs_mgmt_ctxt.session_name) - 1);
+	}
+
+	return rc;
+}
+
+/* Mutex must be held */
+static int upload_session_close(void)
+{
+	int rc = 0;
+
+	(void)k_work_cancel_delayable(&session_timeout_work);
+
+	if (fs_mgmt_ctxt.session) {
+		fs_mgmt_ctxt.session = false;
+		memset(fs_mgmt_ctxt.session_name, 0, sizeof(fs_mgmt_ctxt.session_name));
+		if (efs_file_close(&fs_mgmt_ctxt.efs) != 0) {
+			rc = MGMT_ERR_EUNKNOWN;
+		}
+	}
+
+	return rc;
+}
+
+static void upload_session_timeout(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&session_mutex, K_FOREVER);
+	if (fs_mgmt_ctxt.session) {
+		LOG_WRN("Upload of %s abandoned", fs_mgmt_ctxt.session_name);
+		(void)upload_session_close();
+	}
+	k_mutex_unlock(&session_mutex);
+}
+#endif
 
 /**************************************************************************************************/
 /* Global Function Definitions                                                                    */
@@ -409,4 +587,12 @@ void lcz_fs_mgmt_register_evt_cb(fs_mgmt_on_evt_cb cb)
 {
 	fs_evt_cb = cb;
 }
+
+bool lcz_fs_mgmt_access_allowed(const char *path, bool write)
+{
+	if (fs_evt_cb != NULL) {
+		return fs_evt_cb(path, write);
+	}
+	return true;
+}
 #endif
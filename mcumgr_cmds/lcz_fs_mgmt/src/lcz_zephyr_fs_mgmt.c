@@ -68,6 +68,8 @@ int lcz_fs_mgmt_impl_read(const char *path, size_t offset, size_t len, void *out
 	} else
 #endif
 	{
+		/* Commit data of a file that is kept open by fsu_append_abs */
+		(void)fsu_flush(path);
 		fs_file_t_init(&file);
 		rc = fs_open(&file, path, FS_O_READ);
 		if (rc != 0) {
@@ -100,7 +102,6 @@ int lcz_fs_mgmt_impl_read(const char *path, size_t offset, size_t len, void *out
 int lcz_fs_mgmt_impl_write(const char *path, size_t offset, const void *data, size_t len)
 {
 	struct fs_file_t file;
-	ssize_t file_size;
 	int rc;
 
 #if defined(CONFIG_FSU_ENCRYPTED_FILES)
@@ -108,17 +109,15 @@ int lcz_fs_mgmt_impl_write(const char *path, size_t offset, const void *data, si
 		if (offset == 0) {
 			rc = efs_write(path, (uint8_t *)data, len);
 		} else {
-			file_size = efs_get_file_size(path);
-			if (offset == file_size) {
-				rc = efs_append(path, (uint8_t *)data, len);
-			} else {
-				/* Can't write to middle of the file, only append to the end */
-				rc = MGMT_ERR_EINVAL;
-			}
+			/* Only the blocks that contain the data are re-encrypted */
+			rc = efs_write_block(path, offset, (uint8_t *)data, len);
 		}
 	} else
 #endif
 	{
+		/* Writes to a file that is kept open by fsu_append_abs would be lost */
+		(void)fsu_close_cached(path);
+
 		/* Truncate the file before writing the first chunk.  This is done to
 		 * properly handle an overwrite of an existing file
 		 */
@@ -0,0 +1,32 @@
+/**
+ * @file main.c
+ * @brief
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include "test_lcz_kv_parser.h"
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void test_main(void)
+{
+	ztest_test_suite(lcz_kv_parser_basic_api_test,
+			 ztest_unit_test(test_lcz_kv_parser_modes_agree),
+			 ztest_unit_test(test_lcz_kv_parser_cr_comment_blank),
+			 ztest_unit_test(test_lcz_kv_parser_comment_position),
+			 ztest_unit_test(test_lcz_kv_parser_unterminated),
+			 ztest_unit_test(test_lcz_kv_parser_delimiter_in_value),
+			 ztest_unit_test(test_lcz_kv_parser_missing_delimiter),
+			 ztest_unit_test(test_lcz_kv_parser_key_length),
+			 ztest_unit_test(test_lcz_kv_parser_value_length),
+			 ztest_unit_test(test_lcz_kv_parser_hex_id),
+			 ztest_unit_test(test_lcz_kv_parser_stream_chunks));
+	ztest_run_test_suite(lcz_kv_parser_basic_api_test);
+}
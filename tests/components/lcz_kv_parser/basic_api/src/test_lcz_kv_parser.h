@@ -0,0 +1,33 @@
+/**
+ * @file test_lcz_kv_parser.h
+ * @brief
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __TEST_KV_PARSER_H__
+#define __TEST_KV_PARSER_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <sys/util.h>
+#include <ztest.h>
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+void test_lcz_kv_parser_modes_agree(void);
+void test_lcz_kv_parser_cr_comment_blank(void);
+void test_lcz_kv_parser_comment_position(void);
+void test_lcz_kv_parser_unterminated(void);
+void test_lcz_kv_parser_delimiter_in_value(void);
+void test_lcz_kv_parser_missing_delimiter(void);
+void test_lcz_kv_parser_key_length(void);
+void test_lcz_kv_parser_value_length(void);
+void test_lcz_kv_parser_hex_id(void);
+void test_lcz_kv_parser_stream_chunks(void);
+
+#endif /* __TEST_KV_PARSER_H__ */
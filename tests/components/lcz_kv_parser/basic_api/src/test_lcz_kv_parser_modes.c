@@ -0,0 +1,395 @@
+/**
+ * @file test_lcz_kv_parser_modes.c
+ * @brief
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <ztest.h>
+#include <string.h>
+#include <stdio.h>
+#include "test_lcz_kv_parser.h"
+#include "lcz_kv_parser.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#define TEST_FILE "/test/kv.txt"
+
+#define MAX_PAIRS 48
+#define MAX_TEXT 64
+#define MAX_FILE_SIZE 2048
+
+#define CHUNK_SIZE CONFIG_LCZ_KV_PARSER_CHUNK_SIZE
+
+struct pair {
+	char key[MAX_TEXT];
+	char value[MAX_TEXT];
+	uint32_t id;
+};
+
+struct result {
+	int count;
+	struct pair pairs[MAX_PAIRS];
+};
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static ssize_t ram_get_size(const char *abs_path);
+static ssize_t ram_read_block(const char *abs_path, uint32_t offset, void *data, size_t size);
+static int collect(const lcz_kv_token_t *token, void *context);
+static int parse_all(const lcz_kv_syntax_t *syntax, const char *str);
+static void check_pair(int i, const char *key, const char *value);
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+/* The stream mode reads the file from RAM */
+static const lcz_kv_io_t ram_io = {
+	.get_size = ram_get_size,
+	.read_block = ram_read_block,
+	.msg = "ram",
+};
+
+static const char *file_data;
+static size_t file_size;
+static int file_reads;
+
+static struct result in_place;
+static struct result stream;
+static char compacted[MAX_FILE_SIZE];
+static char file[MAX_FILE_SIZE];
+
+static const lcz_kv_syntax_t kvp_syntax = {
+	.key_type = LCZ_KV_KEY_STRING,
+	.delimiter = '=',
+	.comment = '#',
+	.delimiter_in_value = true,
+	.require_value = false,
+	.max_key_len = 0,
+	.max_value_len = 0,
+};
+
+static const lcz_kv_syntax_t param_syntax = {
+	.key_type = LCZ_KV_KEY_HEX_ID,
+	.delimiter = '=',
+	.comment = '#',
+	.delimiter_in_value = false,
+	.require_value = true,
+	.max_key_len = 4,
+	.max_value_len = 8,
+};
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void test_lcz_kv_parser_modes_agree(void)
+{
+	static const char expected[] = "name=value\nsecond=2\nempty=\nlast=end of file\n";
+	int r;
+
+	r = parse_all(&kvp_syntax, expected);
+	zassert_equal(r, 4, "Unexpected number of pairs");
+	check_pair(0, "name", "value");
+	check_pair(1, "second", "2");
+	check_pair(2, "empty", "");
+	check_pair(3, "last", "end of file");
+	zassert_mem_equal(compacted, expected, sizeof(expected), "Compacted file doesn't match");
+
+	r = parse_all(&kvp_syntax, "");
+	zassert_equal(r, 0, "Empty file should have no pairs");
+}
+
+void test_lcz_kv_parser_cr_comment_blank(void)
+{
+	static const char expected[] = "key=value\nk2=v2\nk3=v3\n";
+	int r;
+
+	r = parse_all(&kvp_syntax,
+		      "\r\n# comment\r\nkey=value\r\n\r\n\n#x=y\nk2=v2\n#\nk3=v\r3\r\n# end\n");
+	zassert_equal(r, 3, "Unexpected number of pairs");
+	check_pair(0, "key", "value");
+	check_pair(1, "k2", "v2");
+	check_pair(2, "k3", "v3");
+	zassert_mem_equal(compacted, expected, sizeof(expected),
+			  "CRs, comments, and blank lines should be removed");
+
+	/* A file of only comments and blank lines */
+	r = parse_all(&kvp_syntax, "# one\r\n\r\n# two\n");
+	zassert_equal(r, 0, "Comment file should have no pairs");
+	zassert_equal(compacted[0], '\0', "Compacted file should be empty");
+}
+
+void test_lcz_kv_parser_comment_position(void)
+{
+	int r;
+
+	r = parse_all(&kvp_syntax, "key=value # trailing\n");
+	zassert_true(r < 0, "Comment must start a line");
+
+	r = parse_all(&param_syntax, "01=a#b\n");
+	zassert_true(r < 0, "Comment must start a line");
+}
+
+void test_lcz_kv_parser_unterminated(void)
+{
+	int r;
+
+	r = parse_all(&kvp_syntax, "a=1\nb=2");
+	zassert_true(r < 0, "Last pair must be terminated");
+
+	r = parse_all(&kvp_syntax, "a=1\nb=2\r");
+	zassert_true(r < 0, "CR doesn't terminate a line");
+
+	/* The last line can be a comment without an EOL */
+	r = parse_all(&kvp_syntax, "a=1\n# no newline");
+	zassert_equal(r, 1, "Unterminated comment should be ignored");
+	check_pair(0, "a", "1");
+}
+
+void test_lcz_kv_parser_delimiter_in_value(void)
+{
+	int r;
+
+	r = parse_all(&kvp_syntax, "url=http://host/?a=b&c=d\n");
+	zassert_equal(r, 1, "Delimiter should be allowed in value");
+	check_pair(0, "url", "http://host/?a=b&c=d");
+
+	r = parse_all(&kvp_syntax, "k==\n");
+	zassert_equal(r, 1, "Delimiter should be allowed as value");
+	check_pair(0, "k", "=");
+
+	r = parse_all(&param_syntax, "01=a=b\n");
+	zassert_true(r < 0, "Second delimiter should be an error");
+}
+
+void test_lcz_kv_parser_missing_delimiter(void)
+{
+	int r;
+
+	r = parse_all(&kvp_syntax, "a=1\nnodelimiter\n");
+	zassert_true(r < 0, "Pair requires a delimiter");
+
+	r = parse_all(&kvp_syntax, "=value\n");
+	zassert_true(r < 0, "Pair requires a key");
+
+	r = parse_all(&param_syntax, "01=\n");
+	zassert_true(r < 0, "Pair requires a value");
+}
+
+void test_lcz_kv_parser_key_length(void)
+{
+	int r;
+
+	r = parse_all(&param_syntax, "ABCD=1\n");
+	zassert_equal(r, 1, "Key at limit should be accepted");
+	zassert_equal(in_place.pairs[0].id, 0xABCD, "Unexpected id");
+
+	r = parse_all(&param_syntax, "0ABCD=1\n");
+	zassert_true(r < 0, "Key over limit should be rejected");
+}
+
+void test_lcz_kv_parser_value_length(void)
+{
+	int r;
+
+	r = parse_all(&param_syntax, "1=12345678\n");
+	zassert_equal(r, 1, "Value at limit should be accepted");
+	check_pair(0, "1", "12345678");
+
+	r = parse_all(&param_syntax, "1=123456789\n");
+	zassert_true(r < 0, "Value over limit should be rejected");
+
+	/* Longer than the line buffer of the stream mode */
+	r = parse_all(&param_syntax, "1=12345678901234567890\n");
+	zassert_true(r < 0, "Value over limit should be rejected");
+}
+
+void test_lcz_kv_parser_hex_id(void)
+{
+	int r;
+
+	r = parse_all(&param_syntax, "0=a\n1f=b\nFFFF=c\n");
+	zassert_equal(r, 3, "Unexpected number of pairs");
+	zassert_equal(in_place.pairs[0].id, 0, "Unexpected id");
+	zassert_equal(in_place.pairs[1].id, 0x1f, "Unexpected id");
+	zassert_equal(in_place.pairs[2].id, 0xffff, "Unexpected id");
+	zassert_equal(stream.pairs[1].id, 0x1f, "Unexpected stream id");
+
+	r = parse_all(&param_syntax, "1g=b\n");
+	zassert_true(r < 0, "Id must be hexadecimal");
+}
+
+void test_lcz_kv_parser_stream_chunks(void)
+{
+	char key[MAX_TEXT];
+	char value[MAX_TEXT];
+	size_t length = 0;
+	size_t start;
+	int spans = 0;
+	int i;
+	int r;
+
+	/* Lines of increasing length start at every offset in a chunk.
+	 * Some lines are longer than a chunk; a few end with CRLF or are
+	 * followed by a comment.
+	 */
+	for (i = 0; i < MAX_PAIRS; i++) {
+		start = length;
+		memset(value, 'a' + (i % 26), i);
+		value[i] = '\0';
+		length += snprintf(&file[length], sizeof(file) - length, "k%02d=%s%s", i, value,
+				   (i % 3) == 0 ? "\r\n" : "\n");
+		if ((start / CHUNK_SIZE) != ((length - 1) / CHUNK_SIZE)) {
+			spans += 1;
+		}
+		if ((i % 7) == 0) {
+			length += snprintf(&file[length], sizeof(file) - length, "# c%d\n", i);
+		}
+		zassert_true(length < sizeof(file), "Test file is too large");
+	}
+
+	file_reads = 0;
+	r = parse_all(&kvp_syntax, file);
+	zassert_equal(r, MAX_PAIRS, "Unexpected number of pairs");
+	zassert_true(spans > MAX_PAIRS / 2, "Lines should span chunks");
+	zassert_true(file_reads > 1, "File should be read in chunks");
+	zassert_equal(file_reads, ceiling_fraction(strlen(file), CHUNK_SIZE),
+		      "Unexpected number of reads");
+
+	for (i = 0; i < MAX_PAIRS; i++) {
+		snprintf(key, sizeof(key), "k%02d", i);
+		memset(value, 'a' + (i % 26), i);
+		value[i] = '\0';
+		check_pair(i, key, value);
+	}
+
+	/* An error after a chunk boundary */
+	strcpy(&file[length - 1], "x");
+	r = parse_all(&kvp_syntax, file);
+	zassert_true(r < 0, "Last pair must be terminated");
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+static ssize_t ram_get_size(const char *abs_path)
+{
+	ARG_UNUSED(abs_path);
+	return file_size;
+}
+
+static ssize_t ram_read_block(const char *abs_path, uint32_t offset, void *data, size_t size)
+{
+	ARG_UNUSED(abs_path);
+
+	if (offset >= file_size) {
+		return 0;
+	}
+
+	size = MIN(size, file_size - offset);
+	memcpy(data, &file_data[offset], size);
+	file_reads += 1;
+	return size;
+}
+
+/* Tokens aren't null terminated and are only valid during the callback */
+static int collect(const lcz_kv_token_t *token, void *context)
+{
+	struct result *res = context;
+	struct pair *pair;
+
+	if (res->count >= MAX_PAIRS || token->key_len >= MAX_TEXT ||
+	    token->value_len >= MAX_TEXT) {
+		return -ENOMEM;
+	}
+
+	pair = &res->pairs[res->count];
+	memcpy(pair->key, token->key, token->key_len);
+	pair->key[token->key_len] = '\0';
+	memcpy(pair->value, token->value, token->value_len);
+	pair->value[token->value_len] = '\0';
+	pair->id = token->id;
+	res->count += 1;
+	return 0;
+}
+
+/**
+ * @brief Parse str in all three modes and check that they agree.
+ * The stream mode can report a different error (line too long).
+ *
+ * @retval result of the in place parse
+ */
+static int parse_all(const lcz_kv_syntax_t *syntax, const char *str)
+{
+	size_t size = strlen(str);
+	int validated;
+	int parsed;
+	int streamed;
+	char *buf;
+	int i;
+
+	memset(&in_place, 0, sizeof(in_place));
+	memset(&stream, 0, sizeof(stream));
+	memset(compacted, 0, sizeof(compacted));
+
+	validated = lcz_kv_parser_validate(syntax, str, size);
+
+	/* The buffer must be one byte larger than the file */
+	buf = k_malloc(size + 1);
+	zassert_not_null(buf, "Unable to allocate buffer");
+	memcpy(buf, str, size + 1);
+	parsed = lcz_kv_parser_parse(syntax, buf, &size, collect, &in_place);
+	if (parsed >= 0) {
+		zassert_true(size < sizeof(compacted), "Compacted file is too large");
+		zassert_equal(strlen(buf), size, "Compacted size doesn't match");
+		memcpy(compacted, buf, size + 1);
+	}
+	k_free(buf);
+
+	file_data = str;
+	file_size = strlen(str);
+	streamed = lcz_kv_parser_stream(syntax, &ram_io, TEST_FILE, collect, &stream);
+	if (file_size == 0) {
+		/* A file that doesn't have any data isn't streamed */
+		zassert_equal(streamed, -ENOENT, "Empty file should not be streamed");
+		streamed = parsed;
+	}
+
+	zassert_equal(validated, parsed, "Validate (%d) and parse (%d) disagree", validated,
+		      parsed);
+	zassert_equal(streamed < 0, parsed < 0, "Stream (%d) and parse (%d) disagree", streamed,
+		      parsed);
+
+	if (parsed >= 0) {
+		zassert_equal(streamed, parsed, "Stream and parse pair counts disagree");
+		zassert_equal(in_place.count, parsed, "Unexpected number of parse callbacks");
+		zassert_equal(stream.count, parsed, "Unexpected number of stream callbacks");
+		for (i = 0; i < parsed; i++) {
+			zassert_equal(strcmp(in_place.pairs[i].key, stream.pairs[i].key), 0,
+				      "Key %d doesn't match", i);
+			zassert_equal(strcmp(in_place.pairs[i].value, stream.pairs[i].value), 0,
+				      "Value %d doesn't match", i);
+			zassert_equal(in_place.pairs[i].id, stream.pairs[i].id,
+				      "Id %d doesn't match", i);
+		}
+	}
+
+	return parsed;
+}
+
+static void check_pair(int i, const char *key, const char *value)
+{
+	zassert_true(i < in_place.count, "Pair %d not found", i);
+	zassert_equal(strcmp(in_place.pairs[i].key, key), 0, "Key %d is %s not %s", i,
+		      in_place.pairs[i].key, key);
+	zassert_equal(strcmp(in_place.pairs[i].value, value), 0, "Value %d is %s not %s", i,
+		      in_place.pairs[i].value, value);
+}
@@ -0,0 +1,24 @@
+/**
+ * @file main.c
+ * @brief
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include "test_lcz_kv_parser.h"
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void test_main(void)
+{
+	ztest_test_suite(lcz_kv_parser_benchmark_test,
+			 ztest_unit_test(test_lcz_kv_parser_bench_string_keys),
+			 ztest_unit_test(test_lcz_kv_parser_bench_hex_ids));
+	ztest_run_test_suite(lcz_kv_parser_benchmark_test);
+}
@@ -0,0 +1,25 @@
+/**
+ * @file test_lcz_kv_parser.h
+ * @brief
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __TEST_KV_PARSER_H__
+#define __TEST_KV_PARSER_H__
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <sys/util.h>
+#include <ztest.h>
+
+/******************************************************************************/
+/* Global Function Prototypes                                                 */
+/******************************************************************************/
+void test_lcz_kv_parser_bench_string_keys(void);
+void test_lcz_kv_parser_bench_hex_ids(void);
+
+#endif /* __TEST_KV_PARSER_H__ */
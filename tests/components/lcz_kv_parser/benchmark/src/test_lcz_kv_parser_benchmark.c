@@ -0,0 +1,139 @@
+/**
+ * @file test_lcz_kv_parser_benchmark.c
+ * @brief
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/******************************************************************************/
+/* Includes                                                                   */
+/******************************************************************************/
+#include <zephyr.h>
+#include <ztest.h>
+#include <string.h>
+#include <stdio.h>
+#include "test_lcz_kv_parser.h"
+#include "lcz_kv_parser.h"
+
+/******************************************************************************/
+/* Local Constant, Macro and Type Definitions                                 */
+/******************************************************************************/
+#define FILE_SIZE (16 * 1024)
+#define MAX_LINE_SIZE 80
+#define ITERATIONS 64
+
+/* A comment line is added after this many pairs */
+#define PAIRS_PER_COMMENT 16
+
+/******************************************************************************/
+/* Local Function Prototypes                                                  */
+/******************************************************************************/
+static size_t build_file(const lcz_kv_syntax_t *syntax, int *pairs);
+static void bench(const char *name, const lcz_kv_syntax_t *syntax);
+
+/******************************************************************************/
+/* Local Data Definitions                                                     */
+/******************************************************************************/
+static char file[FILE_SIZE];
+
+static const lcz_kv_syntax_t kvp_syntax = {
+	.key_type = LCZ_KV_KEY_STRING,
+	.delimiter = '=',
+	.comment = '#',
+	.delimiter_in_value = true,
+	.require_value = false,
+	.max_key_len = 0,
+	.max_value_len = 0,
+};
+
+static const lcz_kv_syntax_t param_syntax = {
+	.key_type = LCZ_KV_KEY_HEX_ID,
+	.delimiter = '=',
+	.comment = 0,
+	.delimiter_in_value = false,
+	.require_value = true,
+	.max_key_len = 4,
+	.max_value_len = 64,
+};
+
+/******************************************************************************/
+/* Global Function Definitions                                                */
+/******************************************************************************/
+void test_lcz_kv_parser_bench_string_keys(void)
+{
+	bench("String keys", &kvp_syntax);
+}
+
+void test_lcz_kv_parser_bench_hex_ids(void)
+{
+	bench("Hex ids", &param_syntax);
+}
+
+/******************************************************************************/
+/* Local Function Definitions                                                 */
+/******************************************************************************/
+/* Fill the file with lines of a typical length */
+static size_t build_file(const lcz_kv_syntax_t *syntax, int *pairs)
+{
+	size_t length = 0;
+	int n;
+
+	*pairs = 0;
+	while ((length + MAX_LINE_SIZE) < sizeof(file)) {
+		if (syntax->comment != 0 && (*pairs % PAIRS_PER_COMMENT) == 0) {
+			n = snprintk(&file[length], MAX_LINE_SIZE,
+				     "%c Settings group %d\n", syntax->comment,
+				     *pairs / PAIRS_PER_COMMENT);
+			length += n;
+		}
+
+		if (syntax->key_type == LCZ_KV_KEY_HEX_ID) {
+			n = snprintk(&file[length], MAX_LINE_SIZE,
+				     "%04x=value of parameter %d (unit)\n",
+				     *pairs, *pairs);
+		} else {
+			n = snprintk(&file[length], MAX_LINE_SIZE,
+				     "setting_%d=value of setting %d (unit)\n",
+				     *pairs, *pairs);
+		}
+		length += n;
+		*pairs += 1;
+	}
+
+	return length;
+}
+
+static void bench(const char *name, const lcz_kv_syntax_t *syntax)
+{
+	uint32_t start;
+	uint32_t cycles;
+	uint64_t ns;
+	uint32_t rate;
+	size_t length;
+	int pairs;
+	int r = 0;
+	int i;
+
+	length = build_file(syntax, &pairs);
+
+	start = k_cycle_get_32();
+	for (i = 0; i < ITERATIONS; i++) {
+		r = lcz_kv_parser_validate(syntax, file, length);
+		if (r != pairs) {
+			break;
+		}
+	}
+	cycles = k_cycle_get_32() - start;
+
+	zassert_equal(r, pairs, "Unexpected number of pairs");
+
+	/* Hundredths of a MB/s */
+	ns = MAX(k_cyc_to_ns_floor64(cycles), 1);
+	rate = (uint32_t)((length * ITERATIONS * 100000ULL) / ns);
+
+	TC_PRINT("%s (word scan %s): %u bytes x %u took %u us (%u.%02u MB/s)\n", name,
+		 IS_ENABLED(CONFIG_LCZ_KV_PARSER_WORD_SCAN) ? "on" : "off", (uint32_t)length,
+		 ITERATIONS, (uint32_t)(ns / 1000), rate / 100, rate % 100);
+}
@@ -14,6 +14,10 @@
 #include <zephyr/types.h>
 #include <stddef.h>
 #include <fs/fs.h>
+#include <sys/util.h>
+#if defined(CONFIG_FSU_ENCRYPTED_READ_AHEAD)
+#include <kernel.h>
+#endif
 
 #include "file_system_utilities.h"
 
@@ -24,6 +28,51 @@ extern "C" {
 /**************************************************************************************************/
 /* Global Constants, Macros and Type Definitions                                                  */
 /**************************************************************************************************/
+/* Size of the file name hash that is stored in each block */
+#define EFS_NAME_HASH_SIZE FSU_HASH_SIZE
+
+/* Open flag that empties the file (in addition to the fs_open flags) */
+#define EFS_O_TRUNC BIT(7)
+
+struct efs_buffer_stats {
+	/* Pooled buffers in use and the most that have been in use at once */
+	uint32_t used;
+	uint32_t peak;
+	/* Opens that failed because no pooled buffer was returned in time */
+	uint32_t timeouts;
+	/* Buffers allocated from the system heap */
+	uint32_t heap;
+};
+
+/* Handle of an open encrypted file. Members are private. */
+struct efs_file {
+	struct fs_file_t f;
+	fs_mode_t flags;
+	char path[FSU_MAX_ABS_PATH_SIZE + 1];
+	uint8_t name_hash[EFS_NAME_HASH_SIZE];
+	/* Plaintext size and position */
+	size_t size;
+	size_t offset;
+	/* Encrypted block buffer */
+	uint8_t *file_block;
+	/* Decrypted working block */
+	uint8_t *user_block;
+	/* Size of the encrypted blocks and the data they hold */
+	uint16_t file_block_size;
+	uint16_t user_block_size;
+	int block_number;
+	/* Data bytes in the working block */
+	uint16_t block_size;
+	bool dirty;
+#if defined(CONFIG_FSU_ENCRYPTED_READ_AHEAD)
+	/* Encrypted block that is read by the read-ahead work queue */
+	uint8_t *ahead_block;
+	int ahead_block_number;
+	int ahead_ret;
+	bool ahead_pending;
+	struct k_work ahead_work;
+#endif
+};
 
 /**************************************************************************************************/
 /* Global Function Prototypes                                                                     */
@@ -77,7 +126,24 @@ ssize_t efs_read(const char *abs_path, void *vdata, size_t size);
  */
 ssize_t efs_read_block(const char *abs_path, int offset, void *vdata, size_t size);
 
+/** @brief Write block of encrypted file
+ *
+ * Only the blocks that contain the data are re-encrypted.
+ *
+ * @param abs_path directory path and name
+ * @param offset Byte offset into file to start writing. It can't be larger
+ * than the size of the file; writing past the end appends to the file.
+ * @param vdata to be written
+ * @param size in bytes
+ *
+ * @retval negative error code, number of bytes written on success.
+ */
+ssize_t efs_write_block(const char *abs_path, int offset, void *vdata, size_t size);
+
 /** @brief Get size of encrypted file
+ *
+ * Only the headers of the first and last blocks are read; nothing is
+ * decrypted. The size is authenticated when the last block is read.
  *
  * @param abs_path directory path and name
  *
@@ -87,7 +153,8 @@ ssize_t efs_get_file_size(const char *abs_path);
 
 /** @brief Compute SHA256 of an encrypted file.
  *
- * Hash is zeroed on start.
+ * Hash is zeroed on start. With CONFIG_FSU_ENCRYPTED_READ_AHEAD, the next
+ * block is read while the current block is decrypted.
  *
  * @param hash result
  * @param abs_path absolute file name
@@ -97,6 +164,128 @@ ssize_t efs_get_file_size(const char *abs_path);
  */
 int efs_sha256(uint8_t hash[FSU_HASH_SIZE], const char *abs_path, size_t size);
 
+/** @brief Set the block size of new files in a directory
+ *
+ * Applies to files that are created (or opened with EFS_O_TRUNC) in the
+ * directory and its subdirectories. The most specific directory is used;
+ * otherwise, new files use CONFIG_FSU_ENCRYPTED_BLOCK_SIZE. Existing files
+ * keep the block size that they were written with.
+ *
+ * @param abs_dir directory path
+ * @param block_size 256, 512, 1024, 2048 or 4096 bytes. 0 removes the
+ * directory setting.
+ *
+ * @retval negative error code, 0 on success.
+ */
+int efs_set_block_size(const char *abs_dir, size_t block_size);
+
+/** @brief Get statistics of the block buffers of open files
+ *
+ * @param stats set by this function
+ */
+void efs_get_buffer_stats(struct efs_buffer_stats *stats);
+
+/** @brief Open an encrypted file
+ *
+ * The simplified path, the file name hash, the plaintext size, and the
+ * decrypted working block are kept in the handle until it is closed.
+ * The path-based functions open and close a handle on each call.
+ *
+ * @param file handle
+ * @param abs_path directory path and name
+ * @param flags FS_O_READ, FS_O_WRITE, FS_O_RDWR, FS_O_CREATE, FS_O_APPEND, EFS_O_TRUNC
+ *
+ * @retval negative error code, 0 on success.
+ */
+int efs_file_open(struct efs_file *file, const char *abs_path, fs_mode_t flags);
+
+/** @brief Open an encrypted file whose blocks are bound to another name
+ *
+ * Blocks are authenticated with the hash of the file name, so a file can't be
+ * read after it is renamed. A file that is written using this function can
+ * only be read after it is renamed to name (for example, a temporary file
+ * that atomically replaces name with fs_rename).
+ *
+ * @param file handle
+ * @param abs_path directory path and name of the file to open
+ * @param name directory path and name that blocks are bound to
+ * @param flags see efs_file_open
+ *
+ * @retval negative error code, 0 on success.
+ */
+int efs_file_open_as(struct efs_file *file, const char *abs_path, const char *name,
+		     fs_mode_t flags);
+
+/** @brief Write any buffered data and close an encrypted file
+ *
+ * @param file handle
+ *
+ * @retval negative error code, 0 on success.
+ */
+int efs_file_close(struct efs_file *file);
+
+/** @brief Write any buffered data of an encrypted file
+ *
+ * The modified block is buffered until another block is accessed or the
+ * file is synced or closed.
+ *
+ * @param file handle
+ *
+ * @retval negative error code, 0 on success.
+ */
+int efs_file_sync(struct efs_file *file);
+
+/** @brief Read from the current position of an encrypted file
+ *
+ * @param file handle
+ * @param vdata pointer to data
+ * @param size maximum number of bytes to read
+ *
+ * @retval negative error code, number of bytes read on success.
+ */
+ssize_t efs_file_read(struct efs_file *file, void *vdata, size_t size);
+
+/** @brief Write to the current position of an encrypted file
+ *
+ * A modified block is encrypted when another block is accessed or when the
+ * file is synced or closed.
+ *
+ * @param file handle
+ * @param vdata to be written
+ * @param size in bytes
+ *
+ * @retval negative error code, number of bytes written on success.
+ */
+ssize_t efs_file_write(struct efs_file *file, const void *vdata, size_t size);
+
+/** @brief Set the position of an encrypted file
+ *
+ * The position can't be past the end of the file.
+ *
+ * @param file handle
+ * @param offset in plaintext bytes relative to whence
+ * @param whence FS_SEEK_SET, FS_SEEK_CUR, or FS_SEEK_END
+ *
+ * @retval negative error code, 0 on success.
+ */
+int efs_file_seek(struct efs_file *file, off_t offset, int whence);
+
+/** @brief Get plaintext size of an open encrypted file
+ *
+ * @param file handle
+ *
+ * @retval negative error code, size of file on success
+ */
+ssize_t efs_file_size(struct efs_file *file);
+
+/** @brief Empty an open encrypted file
+ *
+ * @param file handle
+ *
+ * @retval negative error code, 0 on success.
+ */
+int efs_file_truncate(struct efs_file *file);
+
 #ifdef __cplusplus
 }
 #endif
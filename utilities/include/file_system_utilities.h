@@ -15,6 +15,7 @@
 #include <zephyr/types.h>
 #include <stddef.h>
 #include <fs/fs.h>
+#include <sys/util.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,6 +26,15 @@ extern "C" {
 /******************************************************************************/
 #define FSU_HASH_SIZE 32
 
+/* Algorithms computed by fsu_digest_abs */
+#define FSU_DIGEST_SHA256 BIT(0)
+#define FSU_DIGEST_CRC32 BIT(1)
+
+struct fsu_digest {
+	uint8_t sha256[FSU_HASH_SIZE];
+	uint32_t crc32;
+};
+
 #define FSU_MAX_PATH_STR_LEN (CONFIG_FSU_MAX_PATH_SIZE - 1)
 #define FSU_MAX_FILE_NAME_LEN (CONFIG_FSU_MAX_FILE_NAME_SIZE - 1)
 
@@ -58,6 +68,14 @@ BUILD_ASSERT(CONFIG_FSU_MAX_FILE_NAME_SIZE < MAX_FILE_NAME,
  */
 int fsu_lfs_mount(void);
 
+/**
+ * @brief Close files that are cached by fsu_append and fsu_write and
+ * unmount LittleFS from /lfs
+ *
+ * @retval 0 on success, otherwise negative system error code.
+ */
+int fsu_lfs_unmount(void);
+
 /**
  * @brief print all files in a directory to the debug log.
  */
@@ -143,6 +161,23 @@ int fsu_crc32(uint32_t *checksum, const char *path, const char *name,
  */
 int fsu_crc32_abs(uint32_t *checksum, const char *abs_path, size_t size);
 
+/**
+ * @brief Compute several digests of a file while reading it once.
+ * Digests are zeroed on start.
+ *
+ * @note SHA256 requires CONFIG_FSU_HASH and CRC32 requires
+ * CONFIG_FSU_CHECKSUM.
+ *
+ * @param digest result
+ * @param algorithms bitmask of FSU_DIGEST_SHA256 and FSU_DIGEST_CRC32
+ * @param abs_path absolute file name
+ * @param size of file in bytes
+ *
+ * @retval 0 on success, otherwise negative system error code.
+ */
+int fsu_digest_abs(struct fsu_digest *digest, uint32_t algorithms,
+		   const char *abs_path, size_t size);
+
 /**
  * @brief Build name with path "%s/%s" using snprintk.
  * Result is zeroed on entry.
@@ -204,6 +239,9 @@ int fsu_write(const char *path, const char *name, void *data, size_t size);
 /**
  * @brief Opens file, appends data, and closes file.
  *
+ * @note With CONFIG_FSU_FILE_CACHE_SIZE, the file is kept open; see
+ * fsu_flush.
+ *
  * @param abs_path directory path and name
  * @param data to be written
  * @param size in bytes
@@ -215,6 +253,9 @@ int fsu_append_abs(const char *abs_path, void *data, size_t size);
 /**
  * @brief Opens file, writes data, and closes file.
  *
+ * @note With CONFIG_FSU_FILE_CACHE_SIZE, the file is kept open; see
+ * fsu_flush.
+ *
  * @param abs_path directory path and name
  * @param data to be written
  * @param size in bytes
@@ -223,6 +264,28 @@ int fsu_append_abs(const char *abs_path, void *data, size_t size);
  */
 int fsu_write_abs(const char *abs_path, void *data, size_t size);
 
+/**
+ * @brief Commit data of files that are kept open by the append and write
+ * functions (CONFIG_FSU_FILE_CACHE_SIZE). The files stay open.
+ *
+ * @param abs_path absolute file name, NULL for all cached files. The name is
+ * matched after fsu_simplify_path, so "/lfs//a" and "/lfs/a" are the same file.
+ *
+ * @retval 0 on success, otherwise negative system error code.
+ */
+int fsu_flush(const char *abs_path);
+
+/**
+ * @brief Close files that are kept open by the append and write functions
+ * (CONFIG_FSU_FILE_CACHE_SIZE).
+ *
+ * @param abs_path absolute file name, NULL for all cached files. The name is
+ * matched after fsu_simplify_path, so "/lfs//a" and "/lfs/a" are the same file.
+ *
+ * @retval 0 on success, otherwise negative system error code.
+ */
+int fsu_close_cached(const char *abs_path);
+
 /**
  * @brief Delete one file
  *
@@ -0,0 +1,192 @@
+/**
+ * @file lcz_kv_parser.h
+ * @brief Parser for text files of key=value lines that is shared by the
+ * key-value pair and parameter file modules.
+ *
+ * The syntax of the key and the file backend (cleartext or encrypted) are
+ * selected by the caller. A file is processed in a single pass with one state
+ * machine in one of three modes:
+ * - validate: nothing is stored
+ * - in place: the file is read into a single buffer and compacted as it is
+ * parsed (CRs, comments, and blank lines are removed). Pairs point into the
+ * buffer.
+ * - stream: the file is read in chunks and only the current line is stored.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __LCZ_KV_PARSER_H__
+#define __LCZ_KV_PARSER_H__
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************************************************************************************/
+/* Global Constants, Macros and Type Definitions                                                  */
+/**************************************************************************************************/
+typedef enum lcz_kv_key_type {
+	/* Any printable characters (except the delimiter and comment) */
+	LCZ_KV_KEY_STRING = 0,
+	/* Hexadecimal number that is converted to an id */
+	LCZ_KV_KEY_HEX_ID,
+} lcz_kv_key_type_t;
+
+typedef struct lcz_kv_syntax {
+	lcz_kv_key_type_t key_type;
+	char delimiter;
+	/* Lines that start with this character are ignored; 0 if not supported */
+	char comment;
+	/* When false, a second delimiter on a line is an error */
+	bool delimiter_in_value;
+	/* When true, an empty value is an error */
+	bool require_value;
+	/* Maximum lengths; 0 for no limit */
+	size_t max_key_len;
+	size_t max_value_len;
+} lcz_kv_syntax_t;
+
+/* File backend */
+typedef struct lcz_kv_io {
+	ssize_t (*get_size)(const char *abs_path);
+	ssize_t (*read_block)(const char *abs_path, uint32_t offset, void *data, size_t size);
+	const char *msg;
+} lcz_kv_io_t;
+
+/* Key and value aren't null terminated. They are NULL when validating. */
+typedef struct lcz_kv_token {
+	const char *key;
+	size_t key_len;
+	/* Set when the key type is LCZ_KV_KEY_HEX_ID */
+	uint32_t id;
+	const char *value;
+	size_t value_len;
+} lcz_kv_token_t;
+
+/**
+ * @brief Called for each key-value pair.
+ *
+ * @retval negative value to stop parsing, otherwise 0.
+ */
+typedef int (*lcz_kv_parser_callback_t)(const lcz_kv_token_t *token, void *context);
+
+/* Compares two items of an array by position */
+typedef bool (*lcz_kv_index_less_t)(const void *array, uint16_t a, uint16_t b);
+
+extern const lcz_kv_io_t lcz_kv_io_clear;
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+extern const lcz_kv_io_t lcz_kv_io_encrypted;
+#endif
+
+/**************************************************************************************************/
+/* Global Function Prototypes                                                                     */
+/**************************************************************************************************/
+/**
+ * @brief Validate a file in RAM.
+ *
+ * @param syntax of file
+ * @param str file contents. Doesn't need to be null terminated.
+ * @param size of str
+ *
+ * @retval negative on error, otherwise number of key-value pairs.
+ */
+int lcz_kv_parser_validate(const lcz_kv_syntax_t *syntax, const char *str, size_t size);
+
+/**
+ * @brief Read an entire file into a buffer that is allocated by this function.
+ * The buffer is one byte larger than the file.
+ *
+ * @param io file backend
+ * @param fname absolute path of file
+ * @param fsize size of file (set by this function)
+ * @param fstr file contents (allocated by this function)
+ *
+ * @retval negative error code, 0 on success.
+ *
+ * @note On success, it is the responsibility of the caller to free fstr.
+ */
+int lcz_kv_parser_read(const lcz_kv_io_t *io, const char *fname, size_t *fsize, char **fstr);
+
+/**
+ * @brief Parse a file in RAM. The file is compacted in place so that it only
+ * contains 'key=value\n' lines (and is null terminated). Tokens point into
+ * str and remain valid until str is freed.
+ *
+ * @param syntax of file
+ * @param str file contents. Must be at least size + 1 bytes.
+ * @param size of file (updated to the compacted size)
+ * @param cb called for each key-value pair
+ * @param context passed to cb
+ *
+ * @retval negative on error, otherwise number of key-value pairs.
+ */
+int lcz_kv_parser_parse(const lcz_kv_syntax_t *syntax, char *str, size_t *size,
+			lcz_kv_parser_callback_t cb, void *context);
+
+/**
+ * @brief Read a file into RAM (lcz_kv_parser_read) and then parse it in place
+ * (lcz_kv_parser_parse).
+ *
+ * @note If the return is non-negative, then it is the responsibility of the
+ * caller to free fstr. On error, fstr is cleared and freed.
+ */
+int lcz_kv_parser_load(const lcz_kv_syntax_t *syntax, const lcz_kv_io_t *io, const char *fname,
+		       size_t *fsize, char **fstr, lcz_kv_parser_callback_t cb, void *context);
+
+/**
+ * @brief Parse a file without reading it into RAM. The file is read in chunks
+ * of CONFIG_LCZ_KV_PARSER_CHUNK_SIZE. A line can't be longer than the
+ * maximum key and value lengths of the syntax (or
+ * CONFIG_LCZ_KV_PARSER_MAX_LINE_SIZE when either is unlimited).
+ * Tokens are only valid until the callback returns.
+ *
+ * @note Because the file is processed in a single pass, the callback may be
+ * called for pairs that precede an error in the file.
+ *
+ * @retval negative on error, otherwise number of key-value pairs.
+ */
+int lcz_kv_parser_stream(const lcz_kv_syntax_t *syntax, const lcz_kv_io_t *io, const char *fname,
+			 lcz_kv_parser_callback_t cb, void *context);
+
+/**
+ * @brief Add an item to an array that grows geometrically.
+ *
+ * @param array pointer to array (allocated/reallocated by this function)
+ * @param capacity in items (updated by this function)
+ * @param count number of items in the array
+ * @param item_size size of an item
+ *
+ * @retval pointer to the new (zeroed) item at position count, NULL if out of memory.
+ * The array isn't modified when out of memory.
+ */
+void *lcz_kv_parser_array_add(void **array, size_t *capacity, size_t count, size_t item_size);
+
+/**
+ * @brief Build an index of an array sorted using less.
+ * The array is not modified.
+ *
+ * @param array to be indexed
+ * @param count number of items in array
+ * @param less comparison function. Position should be the tie-breaker so
+ * that the order of equal items is preserved.
+ * @param index array of positions (allocated by this function)
+ *
+ * @retval negative error code, 0 on success.
+ *
+ * @note Caller is responsible for freeing index.
+ */
+int lcz_kv_index_build(const void *array, int count, lcz_kv_index_less_t less, uint16_t **index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCZ_KV_PARSER_H__ */
@@ -5,19 +5,28 @@
  *
  * SPDX-License-Identifier: LicenseRef-LairdConnectivity-Clause
  *
- * Encrypted files are stored using a block size of 1024 bytes (EFS_FILE_BLOCK_SIZE). Of this
- * 1024 bytes, 960 bytes are used to store encrypted "user" data (EFS_USER_BLOCK_SIZE). The
- * remaining 64 bytes are divided up into a block header of 48 bytes and a MAC of 16 bytes.
- * The header contains the initialization vector, the block number in the file, the number of
- * user bytes of data held by the block, and a SHA256 hash of the file name.
+ * Encrypted files are stored in blocks of 256, 512, 1024, 2048 or 4096 bytes. Each block has a
+ * header of 48 bytes and a MAC of 16 bytes; the rest is used to store encrypted "user" data (960
+ * bytes of a 1024 byte block). The header contains the initialization vector, the block number
+ * in the file, the number of user bytes of data held by the block, and a SHA256 hash of the file
+ * name.
+ *
+ * The upper bits of the user data size in the header encode the block size of the file. Files
+ * that were written before the block size was configurable always have 1024 byte blocks, and
+ * these bits are zero. A 1024 byte block is still written with zero so that older firmware can
+ * read it. The block size of a new file is CONFIG_FSU_ENCRYPTED_BLOCK_SIZE unless it is set for
+ * the directory by efs_set_block_size.
  *
  * A portion of the block header (defined in struct auth_data) is authenticated along with the
  * encrypted user data using the 16 byte MAC. This is done in order to prevent a block from
  * one file from being substituted into another file.
  *
- * File blocks are always full size. Plaintext user data is padded up to the 960 byte size to
+ * File blocks are always full size. Plaintext user data is padded up to the user data size to
  * ensure this. The data size in the header is always the actual number of real user bytes, not
  * including padding.
+ *
+ * The header is stored in the clear, so the size of a file is read from the header of the last
+ * block without decrypting it.
  */
 
 /**************************************************************************************************/
@@ -43,8 +52,8 @@ LOG_MODULE_REGISTER(lcz_efs, CONFIG_FSU_LOG_LEVEL);
 #define FSE_FILE_NAME_HASH_ALG PSA_ALG_SHA_256
 
 struct auth_data {
-	uint16_t block_number; /* 960 bytes per block = maximum file size of 60 Mbytes */
-	uint16_t block_size; /* values between 1 and 960 bytes */
+	uint16_t block_number; /* 960 bytes per 1024 byte block = maximum file size of 60 Mbytes */
+	uint16_t block_size; /* user bytes in the lower 12 bits, block size code in the upper 4 */
 	uint8_t file_name_hash[PSA_HASH_LENGTH(FSE_FILE_NAME_HASH_ALG)];
 };
 
@@ -53,22 +62,119 @@ struct efs_block_header {
 	struct auth_data auth_data;
 };
 
-#define EFS_FILE_BLOCK_SIZE 1024
-#define EFS_USER_BLOCK_SIZE                                                                        \
-	(EFS_FILE_BLOCK_SIZE - (sizeof(struct efs_block_header) + LCZ_HW_KEY_MAC_LEN))
+/* Upper bits of auth_data.block_size that hold the block size code of the file */
+#define EFS_BLOCK_SIZE_CODE_SHIFT 12
+#define EFS_BLOCK_DATA_MASK (BIT(EFS_BLOCK_SIZE_CODE_SHIFT) - 1)
+
+#define EFS_BLOCK_OVERHEAD (sizeof(struct efs_block_header) + LCZ_HW_KEY_MAC_LEN)
+#define EFS_USER_SIZE(file_block_size) ((file_block_size) - EFS_BLOCK_OVERHEAD)
+
+#define EFS_MAX_BLOCK_SIZE 4096
 
 #define EFS_FILE_BLOCK_ENC_OFFSET (sizeof(struct efs_block_header))
 
+/* A pooled buffer holds an encrypted block and a decrypted block of the Kconfig block size */
+#define EFS_POOL_BUFFER_SIZE                                                                       \
+	(CONFIG_FSU_ENCRYPTED_BLOCK_SIZE + EFS_USER_SIZE(CONFIG_FSU_ENCRYPTED_BLOCK_SIZE))
+
+/* Block number of a handle without a cached block */
+#define EFS_NO_BLOCK -1
+
+BUILD_ASSERT(PSA_HASH_LENGTH(FSE_FILE_NAME_HASH_ALG) == EFS_NAME_HASH_SIZE,
+	     "Invalid file name hash size");
+BUILD_ASSERT(EFS_USER_SIZE(EFS_MAX_BLOCK_SIZE) <= EFS_BLOCK_DATA_MASK,
+	     "Block size code overlaps user data size");
+
 /**************************************************************************************************/
 /* Local Function Prototypes                                                                      */
 /**************************************************************************************************/
 static int file_name_hash_gen(const char *abs_path, uint8_t *hash, uint8_t hash_len);
-static int file_name_hash_comp(const char *abs_path, uint8_t *hash, uint8_t hash_len);
 static int encrypt_block(struct efs_block_header *hdr, uint8_t *user_data, ssize_t user_data_len,
 			 uint8_t *out);
-static int decrypt_block(const char *abs_path, int block_number, struct efs_block_header *hdr,
+static int decrypt_block(const uint8_t *name_hash, int block_number, struct efs_block_header *hdr,
 			 uint8_t *in_data, int in_data_len, uint8_t *out_data, int out_data_len);
+static int read_size(struct fs_file_t *f, size_t *size, uint16_t *file_block_size);
+static int read_header(struct fs_file_t *f, off_t position, struct efs_block_header *hdr);
+static int block_size_code(size_t file_block_size);
+static uint16_t block_size_of(const struct efs_block_header *hdr);
+static uint16_t new_file_block_size(const char *abs_path);
+static int read_exact(struct fs_file_t *f, void *data, size_t size, int block_number);
+static int load_block(struct efs_file *file, int block_number);
+static int store_block(struct efs_file *file);
+static void release(struct efs_file *file);
+static uint8_t *buffer_alloc(size_t size, k_timeout_t timeout);
+static void buffer_free(uint8_t *buffer, size_t size);
+static int write_file(const char *abs_path, void *vdata, size_t size, fs_mode_t flags);
 static int lcz_enc_fs_init(const struct device *device);
+#if CONFIG_FSU_ENCRYPTED_BLOCK_CACHE_SIZE > 0
+static bool cache_get(struct efs_file *file, int block_number);
+static void cache_put(const struct efs_block_header *hdr, const uint8_t *data, size_t size);
+static void cache_invalidate(const uint8_t *name_hash, int block_number);
+#else
+#define cache_get(file, block_number) false
+#define cache_put(hdr, data, size)
+#define cache_invalidate(name_hash, block_number)
+#endif
+#if defined(CONFIG_FSU_ENCRYPTED_READ_AHEAD)
+static void read_ahead_init(struct efs_file *file);
+static void read_ahead_start(struct efs_file *file, int block_number);
+static bool read_ahead_take(struct efs_file *file, int block_number);
+static void read_ahead_stop(struct efs_file *file);
+static void read_ahead_handler(struct k_work *work);
+#else
+#define read_ahead_init(file)
+#define read_ahead_start(file, block_number)
+#define read_ahead_take(file, block_number) false
+#define read_ahead_stop(file)
+#endif
+
+/**************************************************************************************************/
+/* Local Data Definitions                                                                         */
+/**************************************************************************************************/
+/* Index is the block size code. 0 is used for 1024 byte blocks; 3 is never written. */
+static const uint16_t block_sizes[] = { 1024, 256, 512, 1024, 2048, EFS_MAX_BLOCK_SIZE };
+
+#if CONFIG_FSU_ENCRYPTED_BLOCK_SIZE_DIRS > 0
+/* Block size of new files in a directory */
+static struct block_size_dir {
+	char path[FSU_MAX_ABS_PATH_SIZE + 1];
+	uint16_t block_size;
+} block_size_dirs[CONFIG_FSU_ENCRYPTED_BLOCK_SIZE_DIRS];
+
+static K_MUTEX_DEFINE(block_size_mutex);
+#endif
+
+#if CONFIG_FSU_ENCRYPTED_BUFFER_POOL_SIZE > 0
+K_MEM_SLAB_DEFINE(efs_buffer_pool, EFS_POOL_BUFFER_SIZE, CONFIG_FSU_ENCRYPTED_BUFFER_POOL_SIZE, 4);
+#endif
+
+static struct efs_buffer_stats buffer_stats;
+
+static struct k_spinlock buffer_stats_lock;
+
+#if defined(CONFIG_FSU_ENCRYPTED_READ_AHEAD)
+K_MEM_SLAB_DEFINE(efs_read_ahead_pool, CONFIG_FSU_ENCRYPTED_BLOCK_SIZE,
+		  CONFIG_FSU_ENCRYPTED_READ_AHEAD_BUFFERS, 4);
+
+static struct k_work_q read_ahead_queue;
+
+static K_THREAD_STACK_DEFINE(read_ahead_stack, CONFIG_FSU_ENCRYPTED_READ_AHEAD_STACK_SIZE);
+#endif
+
+#if CONFIG_FSU_ENCRYPTED_BLOCK_CACHE_SIZE > 0
+/* Decrypted blocks of recently read files */
+static struct block_cache_entry {
+	bool valid;
+	uint32_t last_used;
+	/* The header identifies a block: the IV is new each time a block is written */
+	struct efs_block_header hdr;
+	uint8_t data[EFS_USER_SIZE(CONFIG_FSU_ENCRYPTED_BLOCK_SIZE)];
+} block_cache[CONFIG_FSU_ENCRYPTED_BLOCK_CACHE_SIZE];
+
+static uint32_t block_cache_time;
+
+static K_MUTEX_DEFINE(block_cache_mutex);
+#endif
 
 /**************************************************************************************************/
 /* Global Function Definitions                                                                    */
@@ -95,72 +201,95 @@ bool efs_is_encrypted_path(const char *abs_path)
 
 int efs_write(const char *abs_path, void *vdata, size_t size)
 {
-	char *data = (char *)vdata;
-	int ret = 0;
+	/* Existing contents are discarded without being decrypted */
+	return write_file(abs_path, vdata, size, FS_O_RDWR | FS_O_CREATE | EFS_O_TRUNC);
+}
+
+int efs_append(const char *abs_path, void *vdata, size_t size)
+{
+	return write_file(abs_path, vdata, size, FS_O_RDWR | FS_O_CREATE | FS_O_APPEND);
+}
+
+ssize_t efs_read(const char *abs_path, void *vdata, size_t size)
+{
+	return efs_read_block(abs_path, 0, vdata, size);
+}
+
+ssize_t efs_read_block(const char *abs_path, int offset, void *vdata, size_t size)
+{
+	struct efs_file file;
+	ssize_t ret;
 	int ret2;
-	struct fs_file_t f;
 
 	/* Validate the input parameters */
-	if (abs_path == NULL) {
-		LOG_ERR("efs_write: invalid path");
-		ret = -EINVAL;
+	if (abs_path == NULL || vdata == NULL || size == 0 || offset < 0) {
+		return -EINVAL;
 	}
 
-	/* Open the file for writing */
-	fs_file_t_init(&f);
+	ret = efs_file_open(&file, abs_path, FS_O_READ);
 	if (ret == 0) {
-		ret = fs_open(&f, abs_path, FS_O_WRITE | FS_O_CREATE);
+		ret = efs_file_seek(&file, offset, FS_SEEK_SET);
 		if (ret < 0) {
-			LOG_ERR("efs_write: fs_open failed %d", ret);
+			LOG_ERR("efs_read_block: File is not large enough (%d) for offset (%d)",
+				file.size, offset);
+		}
+
+		if (ret == 0) {
+			ret = efs_file_read(&file, vdata, size);
+		}
+
+		ret2 = efs_file_close(&file);
+		if (ret >= 0 && ret2 < 0) {
+			ret = ret2;
 		}
 	}
 
-	/* Empty the file */
+	return ret;
+}
+
+ssize_t efs_write_block(const char *abs_path, int offset, void *vdata, size_t size)
+{
+	struct efs_file file;
+	ssize_t ret;
+	int ret2;
+
+	/* Validate the input parameters */
+	if (abs_path == NULL || (size != 0 && vdata == NULL) || offset < 0) {
+		return -EINVAL;
+	}
+
+	ret = efs_file_open(&file, abs_path, FS_O_RDWR | FS_O_CREATE);
 	if (ret == 0) {
-		ret = fs_truncate(&f, 0);
+		ret = efs_file_seek(&file, offset, FS_SEEK_SET);
 		if (ret < 0) {
-			LOG_ERR("efs_write: Could not truncate file: %d", ret);
+			LOG_ERR("efs_write_block: File is not large enough (%d) for offset (%d)",
+				file.size, offset);
 		}
-	}
 
-	/* Close the file */
-	ret2 = fs_close(&f);
-	if (ret2 < 0) {
-		LOG_ERR("efs_write: Could not close file: %d", ret2);
 		if (ret == 0) {
-			ret = ret2;
+			ret = efs_file_write(&file, vdata, size);
 		}
-	}
 
-	/* Now append the new data */
-	if (ret == 0) {
-		ret = efs_append(abs_path, data, size);
+		ret2 = efs_file_close(&file);
+		if (ret >= 0 && ret2 < 0) {
+			ret = ret2;
+		}
 	}
 
 	return ret;
 }
 
-int efs_append(const char *abs_path, void *vdata, size_t size)
+ssize_t efs_get_file_size(const char *abs_path)
 {
-	char *data = (char *)vdata;
 	char simple_path[FSU_MAX_ABS_PATH_SIZE + 1];
+	struct fs_file_t f;
+	uint16_t file_block_size;
+	size_t size = 0;
 	int ret = 0;
 	int ret2;
-	ssize_t file_size = 0;
-	int this_size;
-	struct fs_file_t f;
-	uint8_t *file_block = NULL;
-	uint8_t *user_block = NULL;
-	int block_offset = 0;
-	int copied = 0;
-	struct efs_block_header *hdr = NULL;
 
-	/* Validate input parameters */
+	/* Validate the input parameters */
 	if (abs_path == NULL) {
-		LOG_ERR("efs_append: invalid path");
-		ret = -EINVAL;
-	} else if (size != 0 && data == NULL) {
-		LOG_ERR("efs_append: null data pointer for size %d", size);
 		ret = -EINVAL;
 	}
 
@@ -168,522 +297,691 @@ int efs_append(const char *abs_path, void *vdata, size_t size)
 	if (ret == 0) {
 		ret = fsu_simplify_path(abs_path, simple_path);
 		if (ret < 0) {
-			LOG_ERR("efs_append: Invalid input path: %s", abs_path);
+			LOG_ERR("efs_get_file_size: Invalid input path: %s", abs_path);
 		} else {
 			ret = 0;
 		}
 	}
 
-	/* Check current file size */
+	/* Open the file */
+	fs_file_t_init(&f);
 	if (ret == 0) {
-		file_size = fsu_get_file_size_abs(simple_path);
-		if (file_size < 0) {
-			/* Assume file doesn't exist */
-			file_size = 0;
+		ret = fs_open(&f, simple_path, FS_O_READ);
+		if (ret < 0) {
+			LOG_ERR("efs_get_file_size: fs_open failed %d", ret);
 		}
 	}
 
-	/* Encrypted files must be a multiple of the block size */
+	/* Only the headers of the first and last blocks are read */
 	if (ret == 0) {
-		if ((file_size % EFS_FILE_BLOCK_SIZE) != 0) {
-			LOG_ERR("efs_append: File is not multiple of block size");
-			ret = -EINVAL;
-		}
+		ret = read_size(&f, &size, &file_block_size);
 	}
 
-	/* Allocate memory for the file block */
-	if (ret == 0) {
-		file_block = (uint8_t *)k_malloc(EFS_FILE_BLOCK_SIZE);
-		if (file_block == NULL) {
-			LOG_ERR("efs_append: Could not allocate memory for the file block");
-			ret = -ENOMEM;
+	/* Close the file */
+	ret2 = fs_close(&f);
+	if (ret2 < 0) {
+		LOG_ERR("efs_get_file_size: Could not close file: %d", ret2);
+		if (ret == 0) {
+			ret = ret2;
 		}
-		hdr = (struct efs_block_header *)file_block;
 	}
 
-	/* Allocate memory for the output block */
+	return (ret == 0) ? size : ret;
+}
+
+int efs_sha256(uint8_t hash[FSU_HASH_SIZE], const char *abs_path, size_t size)
+{
+	struct efs_file file;
+	bool opened = false;
+	int this_size;
+	int ret = 0;
+	int ret2;
+	psa_hash_operation_t operation = PSA_HASH_OPERATION_INIT;
+	psa_status_t psa_ret;
+	size_t hash_out_len = 0;
+
+	/* Start the hash operation */
+	psa_ret = psa_hash_setup(&operation, PSA_ALG_SHA_256);
+	if (psa_ret != PSA_SUCCESS) {
+		LOG_ERR("efs_sha256: Failed to setup hash operation: %d", psa_ret);
+		ret = psa_ret;
+	}
+
+	/* Validate the input parameters */
 	if (ret == 0) {
-		user_block = (uint8_t *)k_malloc(EFS_USER_BLOCK_SIZE);
-		if (user_block == NULL) {
-			LOG_ERR("efs_append: Could not allocate memory for the user block");
-			ret = -ENOMEM;
+		if (abs_path == NULL || hash == NULL || size == 0) {
+			LOG_ERR("efs_sha256: Invalid input parameters");
+			ret = -EINVAL;
 		}
 	}
 
-	/* Open the file for read and write */
-	fs_file_t_init(&f);
+	/* Open the file */
 	if (ret == 0) {
-		ret = fs_open(&f, simple_path, FS_O_RDWR | FS_O_CREATE);
-		if (ret < 0) {
-			LOG_ERR("efs_append: fs_open failed %d", ret);
-		}
+		ret = efs_file_open(&file, abs_path, FS_O_READ);
+		opened = (ret == 0);
 	}
 
-	/* If the file is not empty, try to fill up the last block first */
-	if (ret == 0 && size > 0 && file_size > 0) {
-		/* Seek to the start of the last encrypted block */
-		block_offset = (file_size / EFS_FILE_BLOCK_SIZE) - 1;
-		ret = fs_seek(&f, block_offset * EFS_FILE_BLOCK_SIZE, FS_SEEK_SET);
-		if (ret < 0) {
-			LOG_ERR("efs_append: seek failed to block %d: %d", block_offset, ret);
-		}
+	/* Hash the decrypted block(s) of the file without copying them */
+	while (ret == 0 && size > 0 && file.offset < file.size) {
+		ret = load_block(&file, file.offset / file.user_block_size);
 
-		/* Read the encrypted block */
 		if (ret == 0) {
-			ret = fs_read(&f, file_block, EFS_FILE_BLOCK_SIZE);
-			if (ret < 0) {
-				LOG_ERR("efs_append: read failed for block %d: %d", block_offset,
-					ret);
-			} else if (ret != EFS_FILE_BLOCK_SIZE) {
-				LOG_ERR("efs_append: Read only returned %d bytes", ret);
-				ret = -EIO;
-			} else {
-				/* Good read */
-				ret = 0;
+			/* Limit the data size to what is in this block */
+			this_size = MIN(size, file.block_size);
+
+			/* Update the hash with this data */
+			psa_ret = psa_hash_update(&operation, file.user_block, this_size);
+			if (psa_ret != PSA_SUCCESS) {
+				LOG_ERR("efa_sha256: Hash update failed: %d", psa_ret);
+				ret = -EFAULT;
 			}
+
+			/* Update counters */
+			size -= this_size;
+			file.offset += this_size;
 		}
 
-		/* Decrypt the block */
-		if (ret == 0) {
-			ret = decrypt_block(simple_path, block_offset, hdr,
-					    file_block + EFS_FILE_BLOCK_ENC_OFFSET,
-					    EFS_FILE_BLOCK_SIZE - EFS_FILE_BLOCK_ENC_OFFSET,
-					    user_block, EFS_USER_BLOCK_SIZE);
-			if (ret < 0) {
-				LOG_ERR("efs_append: decrypt failed for block %d: %d", block_offset,
-					ret);
-			}
+		/* Don't try the next block if the current block is not full */
+		if (ret == 0 && file.block_size != file.user_block_size) {
+			break;
 		}
+	}
 
-		if (ret == 0) {
-			/* If there is space, add all or part of the new data to the end of the block */
-			if (hdr->auth_data.block_size < EFS_USER_BLOCK_SIZE) {
-				/* Figure out how much data can fit */
-				this_size = size;
-				if (this_size > (EFS_USER_BLOCK_SIZE - hdr->auth_data.block_size)) {
-					this_size = EFS_USER_BLOCK_SIZE - hdr->auth_data.block_size;
-				}
-
-				/* Copy what we can */
-				memcpy(user_block + hdr->auth_data.block_size, data, this_size);
-
-				/* Update pointers and lengths */
-				data += this_size;
-				size -= this_size;
-				copied += this_size;
-				hdr->auth_data.block_size += this_size;
-
-				/* Zero out the rest */
-				if (hdr->auth_data.block_size != EFS_USER_BLOCK_SIZE) {
-					memset(user_block + hdr->auth_data.block_size, 0,
-					       EFS_USER_BLOCK_SIZE - hdr->auth_data.block_size);
-				}
-
-				/* Re-encrypt the block */
-				ret = encrypt_block(hdr, user_block, EFS_USER_BLOCK_SIZE,
-						    file_block + EFS_FILE_BLOCK_ENC_OFFSET);
-				if (ret < 0) {
-					LOG_ERR("efs_append: encrypt failed for block %d: %d",
-						block_offset, ret);
-				}
-
-				/* Reset the file pointer */
-				if (ret == 0) {
-					ret = fs_seek(&f, block_offset * EFS_FILE_BLOCK_SIZE,
-						      FS_SEEK_SET);
-					if (ret < 0) {
-						LOG_ERR("efs_append: seek failed to block %d: %d",
-							block_offset, ret);
-					}
-				}
-
-				/* Write the block back to the file */
-				if (ret == 0) {
-					ret = fs_write(&f, file_block, EFS_FILE_BLOCK_SIZE);
-					if (ret < 0) {
-						LOG_ERR("efs_append: write failed to block %d: %d",
-							block_offset, ret);
-					} else if (ret != EFS_FILE_BLOCK_SIZE) {
-						LOG_ERR("efs_append: write only wrote %d bytes",
-							ret);
-						ret = -EIO;
-					} else {
-						/* Good write */
-						ret = 0;
-					}
-				}
-				/* File pointer should now be at the end of the file */
-
-				/* Update block offset */
-				block_offset++;
-			}
+	/* Close the file */
+	if (opened) {
+		ret2 = efs_file_close(&file);
+		if (ret >= 0 && ret2 < 0) {
+			ret = ret2;
 		}
 	}
 
-	/* Start to fill in the block header */
+	/* Finish the hash operation */
 	if (ret == 0) {
-		ret = file_name_hash_gen(simple_path, hdr->auth_data.file_name_hash,
-					 sizeof(hdr->auth_data.file_name_hash));
-		if (ret < 0) {
-			LOG_ERR("efs_append: Couldn't hash filename: %d", ret);
+		psa_ret = psa_hash_finish(&operation, hash, FSU_HASH_SIZE, &hash_out_len);
+		if (psa_ret != PSA_SUCCESS) {
+			LOG_ERR("efs_sha256: Hash finish failed: %d", psa_ret);
+			ret = psa_ret;
+		} else if (hash_out_len != FSU_HASH_SIZE) {
+			LOG_ERR("efs_sha256: Hash output not expected length (%d)", hash_out_len);
+			ret = -EFAULT;
+		}
+	} else {
+		psa_ret = psa_hash_abort(&operation);
+		if (psa_ret != PSA_SUCCESS) {
+			LOG_ERR("efa_sha256: Hash abort failed: %d", psa_ret);
 		}
 	}
 
-	/* Chunk the data into EFS_USER_BLOCK_SIZE bytes to write into the file */
-	while (ret == 0 && size > 0) {
-		this_size = size;
-		if (this_size > EFS_USER_BLOCK_SIZE) {
-			this_size = EFS_USER_BLOCK_SIZE;
-		}
+	/* Return any error */
+	return ret;
+}
 
-		/* Populate the header for this block */
-		hdr->auth_data.block_number = block_offset;
-		hdr->auth_data.block_size = this_size;
+int efs_set_block_size(const char *abs_dir, size_t block_size)
+{
+#if CONFIG_FSU_ENCRYPTED_BLOCK_SIZE_DIRS > 0
+	char simple_path[FSU_MAX_ABS_PATH_SIZE + 1];
+	struct block_size_dir *dir = NULL;
+	int ret = 0;
+	int i;
 
-		/* Encrypt the block */
-		if (this_size == EFS_USER_BLOCK_SIZE) {
-			/* For a full block, don't make a copy of the user data first */
-			ret = encrypt_block(hdr, data, this_size,
-					    file_block + EFS_FILE_BLOCK_ENC_OFFSET);
-		} else {
-			/* For a block needing padding, copy the user data and then pad */
-			memcpy(user_block, data, this_size);
-			memset(user_block + this_size, 0, EFS_USER_BLOCK_SIZE - this_size);
-			ret = encrypt_block(hdr, user_block, EFS_USER_BLOCK_SIZE,
-					    file_block + EFS_FILE_BLOCK_ENC_OFFSET);
-		}
-		if (ret < 0) {
-			LOG_ERR("efs_append: encrypt failed for new block %d: %d", block_offset,
-				ret);
-		}
+	/* Validate the input parameters */
+	if (abs_dir == NULL || (block_size != 0 && block_size_code(block_size) < 0)) {
+		LOG_ERR("efs_set_block_size: Invalid input parameters");
+		return -EINVAL;
+	}
 
-		/* Write the block back to the file */
-		if (ret == 0) {
-			ret = fs_write(&f, file_block, EFS_FILE_BLOCK_SIZE);
-			if (ret < 0) {
-				LOG_ERR("efs_append: write failed to new block %d: %d",
-					block_offset, ret);
-			} else if (ret != EFS_FILE_BLOCK_SIZE) {
-				LOG_ERR("efs_append: new write only wrote %d bytes", ret);
-				ret = -EIO;
-			} else {
-				/* Good write */
-				ret = 0;
-			}
-		}
+	ret = fsu_simplify_path(abs_dir, simple_path);
+	if (ret < 0) {
+		LOG_ERR("efs_set_block_size: Invalid input path: %s", abs_dir);
+		return ret;
+	}
 
-		/* Update pointers/counters */
-		if (ret == 0) {
-			block_offset++;
-			data += this_size;
-			size -= this_size;
-			copied += this_size;
-		}
+	/* Paths of files are matched against the directory followed by a slash */
+	while (ret > 0 && simple_path[ret - 1] == '/') {
+		simple_path[--ret] = '\0';
 	}
+	ret = 0;
 
-	/* Close the file */
-	ret2 = fs_close(&f);
-	if (ret2 < 0) {
-		LOG_ERR("efs_append: Could not close file: %d", ret2);
-		if (ret >= 0) {
-			ret = ret2;
+	k_mutex_lock(&block_size_mutex, K_FOREVER);
+
+	/* Use the entry of the directory or else an empty one */
+	for (i = 0; i < ARRAY_SIZE(block_size_dirs); i++) {
+		if (block_size_dirs[i].block_size != 0 &&
+		    strcmp(block_size_dirs[i].path, simple_path) == 0) {
+			dir = &block_size_dirs[i];
+			break;
+		} else if (block_size_dirs[i].block_size == 0 && dir == NULL) {
+			dir = &block_size_dirs[i];
 		}
 	}
 
-	/* Free any memory that we allocated */
-	if (file_block != NULL) {
-		memset(file_block, 0, EFS_FILE_BLOCK_SIZE);
-		k_free(file_block);
-	}
-	if (user_block != NULL) {
-		memset(user_block, 0, EFS_USER_BLOCK_SIZE);
-		k_free(user_block);
+	if (dir == NULL) {
+		if (block_size != 0) {
+			LOG_ERR("efs_set_block_size: No room for directory %s", simple_path);
+			ret = -ENOMEM;
+		}
+	} else if (block_size != 0) {
+		strcpy(dir->path, simple_path);
+		dir->block_size = block_size;
+	} else {
+		/* Removes the entry of the directory (an empty entry is unchanged) */
+		memset(dir, 0, sizeof(*dir));
 	}
 
-	/* Return the error or the number of bytes written */
-	if (ret == 0) {
-		ret = copied;
-	}
+	k_mutex_unlock(&block_size_mutex);
+
 	return ret;
+#else
+	ARG_UNUSED(abs_dir);
+	ARG_UNUSED(block_size);
+	return -ENOTSUP;
+#endif
 }
 
-ssize_t efs_read(const char *abs_path, void *vdata, size_t size)
+void efs_get_buffer_stats(struct efs_buffer_stats *stats)
 {
-	return efs_read_block(abs_path, 0, vdata, size);
+	k_spinlock_key_t key;
+
+	if (stats != NULL) {
+		key = k_spin_lock(&buffer_stats_lock);
+		*stats = buffer_stats;
+		k_spin_unlock(&buffer_stats_lock, key);
+	}
 }
 
-ssize_t efs_read_block(const char *abs_path, int offset, void *vdata, size_t size)
+int efs_file_open(struct efs_file *file, const char *abs_path, fs_mode_t flags)
+{
+	return efs_file_open_as(file, abs_path, abs_path, flags);
+}
+
+int efs_file_open_as(struct efs_file *file, const char *abs_path, const char *name,
+		     fs_mode_t flags)
 {
-	char *data = (char *)vdata;
-	char simple_path[FSU_MAX_ABS_PATH_SIZE + 1];
-	int block_num;
-	int block_offset;
-	int this_size;
-	int copied = 0;
-	ssize_t file_size = 0;
-	uint8_t *file_block = NULL;
-	uint8_t *user_block = NULL;
-	struct efs_block_header *hdr;
-	struct fs_file_t f;
 	int ret = 0;
-	int ret2;
 
 	/* Validate the input parameters */
-	if (abs_path == NULL || data == NULL || size == 0) {
-		ret = -EINVAL;
+	if (file == NULL || abs_path == NULL || name == NULL) {
+		LOG_ERR("efs_file_open: invalid parameters");
+		return -EINVAL;
+	}
+
+	memset(file, 0, sizeof(*file));
+	fs_file_t_init(&file->f);
+	file->flags = flags;
+	file->block_number = EFS_NO_BLOCK;
+
+	/* The name hash is the same for every block of the file */
+	ret = fsu_simplify_path(name, file->path);
+	if (ret < 0) {
+		LOG_ERR("efs_file_open: Invalid input path: %s", name);
+	} else {
+		ret = file_name_hash_gen(file->path, file->name_hash, sizeof(file->name_hash));
+		if (ret < 0) {
+			LOG_ERR("efs_file_open: Couldn't hash filename: %d", ret);
+		}
 	}
 
 	/* Remove any extra slashes in the path */
 	if (ret == 0) {
-		ret = fsu_simplify_path(abs_path, simple_path);
+		ret = fsu_simplify_path(abs_path, file->path);
 		if (ret < 0) {
-			LOG_ERR("efs_read_block: Invalid input path: %s", abs_path);
+			LOG_ERR("efs_file_open: Invalid input path: %s", abs_path);
 		} else {
 			ret = 0;
 		}
 	}
 
-	/* Compute which encrypted block the offset should be in */
-	block_num = offset / EFS_USER_BLOCK_SIZE;
-	block_offset = offset % EFS_USER_BLOCK_SIZE;
-
-	/* Read the file size */
+	/* Open the file. A partial block must be read before it can be appended to.
+	 * Appending is handled here because blocks are rewritten in place.
+	 */
 	if (ret == 0) {
-		file_size = fsu_get_file_size_abs(simple_path);
-		if (file_size < 0) {
-			ret = file_size;
+		ret = fs_open(&file->f, file->path,
+			      ((flags & FS_O_WRITE) ? (flags | FS_O_READ) : flags) &
+				      ~(FS_O_APPEND | EFS_O_TRUNC));
+		if (ret < 0) {
+			LOG_ERR("efs_file_open: fs_open failed %d", ret);
 		}
 	}
 
-	/* Make sure that the file is a mulitple of the encrypted block size */
-	if (ret == 0) {
-		if ((file_size % EFS_FILE_BLOCK_SIZE) != 0) {
-			LOG_ERR("efs_read_block: File is not multiple of block size (%d)",
-				file_size);
-			ret = -EINVAL;
+	/* Empty the file */
+	if (ret == 0 && (flags & EFS_O_TRUNC)) {
+		cache_invalidate(file->name_hash, EFS_NO_BLOCK);
+		ret = fs_truncate(&file->f, 0);
+		if (ret < 0) {
+			LOG_ERR("efs_file_open: Could not truncate file: %d", ret);
 		}
 	}
 
-	/* Make sure that the file is large enough to contain the requested block */
+	/* Get the plaintext size. An empty file uses the block size of new files. */
 	if (ret == 0) {
-		if (((block_num * EFS_FILE_BLOCK_SIZE) + EFS_FILE_BLOCK_SIZE) > file_size) {
-			LOG_ERR("efs_read_block: File is not large enough (%d) for requested offset (%d)",
-				file_size, offset);
-			ret = -EINVAL;
-		}
+		file->file_block_size = new_file_block_size(file->path);
+		ret = read_size(&file->f, &file->size, &file->file_block_size);
+		file->user_block_size = EFS_USER_SIZE(file->file_block_size);
 	}
 
-	/* Open the file */
-	fs_file_t_init(&f);
+	/* Allocate memory for the file block and the user block */
 	if (ret == 0) {
-		ret = fs_open(&f, simple_path, FS_O_READ);
-		if (ret < 0) {
-			LOG_ERR("efs_read_block: fs_open failed %d", ret);
+		file->file_block = buffer_alloc(file->file_block_size + file->user_block_size,
+						K_MSEC(CONFIG_FSU_ENCRYPTED_BUFFER_POOL_TIMEOUT_MS));
+		if (file->file_block == NULL) {
+			LOG_ERR("efs_file_open: Could not allocate memory for the file block");
+			ret = -ENOMEM;
+		} else {
+			file->user_block = file->file_block + file->file_block_size;
 		}
 	}
 
-	/* Allocate memory for the file block */
-	file_block = (uint8_t *)k_malloc(EFS_FILE_BLOCK_SIZE);
-	if (file_block == NULL) {
-		LOG_ERR("efs_read_block: Could not allocate memory for the file block");
-		ret = -ENOMEM;
+	if (ret == 0) {
+		read_ahead_init(file);
 	}
 
-	/* Allocate memory for the output block */
-	user_block = (uint8_t *)k_malloc(EFS_USER_BLOCK_SIZE);
-	if (user_block == NULL) {
-		LOG_ERR("efs_read_block: Could not allocate memory for the user block");
-		ret = -ENOMEM;
+	if (ret == 0) {
+		if (flags & FS_O_APPEND) {
+			file->offset = file->size;
+		}
+	} else {
+		(void)fs_close(&file->f);
+		release(file);
 	}
 
-	/* Seek to the first block */
-	ret = fs_seek(&f, block_num * EFS_FILE_BLOCK_SIZE, FS_SEEK_SET);
-	if (ret < 0) {
-		LOG_ERR("efs_read_block: seek failed to block %d", block_num);
+	return ret;
+}
+
+int efs_file_close(struct efs_file *file)
+{
+	int ret;
+	int ret2;
+
+	if (file == NULL || file->file_block == NULL) {
+		return -EINVAL;
 	}
 
-	/* Read the block(s) of the file */
-	while (ret == 0 && size > 0 &&
-	       ((block_num * EFS_FILE_BLOCK_SIZE) + EFS_FILE_BLOCK_SIZE) <= file_size) {
-		/* Seek to the start of the encrypted block */
+	/* Write any modified data */
+	ret = store_block(file);
 
-		/* Read the encrypted block */
+	/* Close the file */
+	read_ahead_stop(file);
+	ret2 = fs_close(&file->f);
+	if (ret2 < 0) {
+		LOG_ERR("efs_file_close: Could not close file: %d", ret2);
 		if (ret == 0) {
-			ret = fs_read(&f, file_block, EFS_FILE_BLOCK_SIZE);
-			if (ret < 0) {
-				LOG_ERR("efs_read_block: read failed for block %d", block_num);
-			} else if (ret != EFS_FILE_BLOCK_SIZE) {
-				LOG_ERR("efs_read_block: Read only returned %d bytes", ret);
-				ret = -EIO;
-			} else {
-				/* Good read */
-				ret = 0;
-			}
+			ret = ret2;
 		}
+	}
 
-		/* Decrypt the block */
-		if (ret == 0) {
-			hdr = (struct efs_block_header *)file_block;
-			ret = decrypt_block(simple_path, block_num, hdr,
-					    file_block + EFS_FILE_BLOCK_ENC_OFFSET,
-					    EFS_FILE_BLOCK_SIZE - EFS_FILE_BLOCK_ENC_OFFSET,
-					    user_block, EFS_USER_BLOCK_SIZE);
-			if (ret < 0) {
-				LOG_ERR("efs_read_block: decrypt failed for block %d", block_num);
-			}
-		}
+	release(file);
 
-		/* Copy the decrypted data to the user's buffer */
-		if (ret == 0) {
-			/* Limit the data size to what is in this block */
-			this_size = size;
-			if (this_size > hdr->auth_data.block_size) {
-				this_size = hdr->auth_data.block_size;
-			}
+	return ret;
+}
 
-			/* Adjust size taking the offset into account */
-			this_size -= block_offset;
+int efs_file_sync(struct efs_file *file)
+{
+	int ret;
 
-			/* Copy the data into the caller's buffer */
-			memcpy(data, user_block + block_offset, this_size);
+	if (file == NULL || file->file_block == NULL) {
+		return -EINVAL;
+	}
 
-			/* Update pointers/counters */
-			block_offset = 0;
+	ret = store_block(file);
+	if (ret == 0) {
+		ret = fs_sync(&file->f);
+	}
+
+	return ret;
+}
+
+ssize_t efs_file_read(struct efs_file *file, void *vdata, size_t size)
+{
+	uint8_t *data = (uint8_t *)vdata;
+	size_t block_offset;
+	size_t this_size;
+	ssize_t copied = 0;
+	int ret = 0;
+
+	/* Validate the input parameters */
+	if (file == NULL || file->file_block == NULL || (size != 0 && data == NULL)) {
+		return -EINVAL;
+	}
+
+	while (ret == 0 && size > 0 && file->offset < file->size) {
+		ret = load_block(file, file->offset / file->user_block_size);
+
+		/* Only the last block may be partially filled */
+		if (ret == 0) {
+			block_offset = file->offset % file->user_block_size;
+			if (block_offset >= file->block_size) {
+				LOG_ERR("efs_file_read: Block %d is not full", file->block_number);
+				ret = -EINVAL;
+			}
+		}
+
+		/* Copy the decrypted data to the user's buffer */
+		if (ret == 0) {
+			this_size = MIN(size, file->block_size - block_offset);
+			memcpy(data, file->user_block + block_offset, this_size);
+
+			/* Update pointers/counters */
 			data += this_size;
 			size -= this_size;
 			copied += this_size;
+			file->offset += this_size;
 		}
+	}
 
-		/* Move to the next block */
-		if (ret == 0 && size > 0) {
-			if (hdr->auth_data.block_size == EFS_USER_BLOCK_SIZE) {
-				/* Try the next block only if the current block was "full" */
-				block_num++;
-			} else {
-				/* There shouldn't be another block after this one */
-				break;
+	/* Return error or the number of bytes copied */
+	return (ret == 0) ? copied : ret;
+}
+
+ssize_t efs_file_write(struct efs_file *file, const void *vdata, size_t size)
+{
+	const uint8_t *data = (const uint8_t *)vdata;
+	size_t block_offset;
+	size_t this_size;
+	ssize_t copied = 0;
+	int block_number;
+	int ret = 0;
+
+	/* Validate the input parameters */
+	if (file == NULL || file->file_block == NULL || (size != 0 && data == NULL)) {
+		return -EINVAL;
+	}
+
+	if ((file->flags & FS_O_WRITE) == 0) {
+		return -EACCES;
+	}
+
+	while (ret == 0 && size > 0) {
+		block_number = file->offset / file->user_block_size;
+		block_offset = file->offset % file->user_block_size;
+		this_size = MIN(size, file->user_block_size - block_offset);
+
+		if (block_number == file->block_number) {
+			/* The block is already in the user block */
+		} else if (block_offset == 0 &&
+			   (file->offset == file->size || this_size == file->user_block_size)) {
+			/* Start a new block or replace a whole block without reading it */
+			ret = store_block(file);
+			if (ret == 0) {
+				file->block_number = block_number;
+				file->block_size = 0;
 			}
+		} else {
+			/* Modify part of a block */
+			ret = load_block(file, block_number);
 		}
-	}
 
-	/* Close the file */
-	ret2 = fs_close(&f);
-	if (ret2 < 0) {
-		LOG_ERR("efs_read_block: Could not close file: %d", ret2);
-		if (ret >= 0) {
-			ret = ret2;
+		if (ret == 0) {
+			memcpy(file->user_block + block_offset, data, this_size);
+			file->block_size = MAX(file->block_size, block_offset + this_size);
+			file->dirty = true;
+
+			/* Update pointers/counters */
+			data += this_size;
+			size -= this_size;
+			copied += this_size;
+			file->offset += this_size;
+			file->size = MAX(file->size, file->offset);
 		}
 	}
 
-	/* Free any memory that we allocated */
-	if (file_block != NULL) {
-		memset(file_block, 0, EFS_FILE_BLOCK_SIZE);
-		k_free(file_block);
+	/* Return the error or the number of bytes written */
+	return (ret == 0) ? copied : ret;
+}
+
+int efs_file_seek(struct efs_file *file, off_t offset, int whence)
+{
+	off_t position;
+
+	if (file == NULL || file->file_block == NULL) {
+		return -EINVAL;
 	}
-	if (user_block != NULL) {
-		memset(user_block, 0, EFS_USER_BLOCK_SIZE);
-		k_free(user_block);
+
+	switch (whence) {
+	case FS_SEEK_SET:
+		position = offset;
+		break;
+	case FS_SEEK_CUR:
+		position = file->offset + offset;
+		break;
+	case FS_SEEK_END:
+		position = file->size + offset;
+		break;
+	default:
+		return -EINVAL;
 	}
 
-	/* Return error or the number of bytes copied */
-	if (ret == 0) {
-		ret = copied;
+	if (position < 0 || position > file->size) {
+		return -EINVAL;
 	}
+
+	file->offset = position;
+	return 0;
+}
+
+ssize_t efs_file_size(struct efs_file *file)
+{
+	if (file == NULL || file->file_block == NULL) {
+		return -EINVAL;
+	}
+
+	return file->size;
+}
+
+int efs_file_truncate(struct efs_file *file)
+{
+	int ret;
+
+	if (file == NULL || file->file_block == NULL) {
+		return -EINVAL;
+	}
+
+	if ((file->flags & FS_O_WRITE) == 0) {
+		return -EACCES;
+	}
+
+	/* Anything cached belongs to the old contents */
+	file->block_number = EFS_NO_BLOCK;
+	file->dirty = false;
+	cache_invalidate(file->name_hash, EFS_NO_BLOCK);
+
+	ret = fs_truncate(&file->f, 0);
+	if (ret < 0) {
+		LOG_ERR("efs_file_truncate: Could not truncate file: %d", ret);
+	} else {
+		file->size = 0;
+		file->offset = 0;
+	}
+
 	return ret;
 }
 
-ssize_t efs_get_file_size(const char *abs_path)
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static int file_name_hash_gen(const char *abs_path, uint8_t *hash, uint8_t hash_len)
 {
-	char simple_path[FSU_MAX_ABS_PATH_SIZE + 1];
-	ssize_t file_size = 0;
-	int num_blocks;
-	int block_offset;
 	int ret = 0;
-	int ret2;
-	uint8_t *file_block = NULL;
-	uint8_t *user_block = NULL;
-	struct efs_block_header *hdr = NULL;
-	struct fs_file_t f;
+	psa_status_t s;
+	size_t hash_len_out;
 
-	/* Validate the input parameters */
-	if (abs_path == NULL) {
+	/* Make sure that the hash buffer is the right size */
+	if (hash_len != PSA_HASH_LENGTH(FSE_FILE_NAME_HASH_ALG)) {
 		ret = -EINVAL;
 	}
 
-	/* Remove any extra slashes in the path */
+	/* Compute the hash */
 	if (ret == 0) {
-		ret = fsu_simplify_path(abs_path, simple_path);
-		if (ret < 0) {
-			LOG_ERR("efs_get_file_size: Invalid input path: %s", abs_path);
+		s = psa_hash_compute(FSE_FILE_NAME_HASH_ALG, abs_path, strlen(abs_path), hash,
+				     hash_len, &hash_len_out);
+		if (s == PSA_SUCCESS && hash_len != hash_len_out) {
+			ret = -EFAULT;
 		} else {
-			ret = 0;
+			ret = s;
+		}
+	}
+
+	return ret;
+}
+
+static int encrypt_block(struct efs_block_header *hdr, uint8_t *user_data, ssize_t user_data_len,
+			 uint8_t *out)
+{
+	uint32_t enc_size = 0;
+	int ret = 0;
+
+	/* Validate the input */
+	if (hdr == NULL || user_data == NULL || user_data_len == 0 ||
+	    user_data_len > EFS_USER_SIZE(EFS_MAX_BLOCK_SIZE)) {
+		ret = -EINVAL;
+	}
+
+	/* Generate a new IV for this block */
+	if (ret == 0) {
+		ret = lcz_hw_key_generate_iv(hdr->iv, LCZ_HW_KEY_IV_LEN);
+		if (ret != 0) {
+			LOG_ERR("Block encrypt failed to generate IV: %d", ret);
 		}
 	}
 
+	/* Encrypt the block */
+	if (ret == 0) {
+		ret = lcz_hw_key_encrypt_data(hdr->iv, sizeof(hdr->iv),
+					      (const uint8_t *)&(hdr->auth_data),
+					      sizeof(hdr->auth_data), user_data, user_data_len, out,
+					      user_data_len + LCZ_HW_KEY_MAC_LEN, &enc_size);
+		if (ret != 0) {
+			LOG_ERR("Block encrypt failed: %d", ret);
+		} else if (enc_size != (LCZ_HW_KEY_MAC_LEN + user_data_len)) {
+			LOG_ERR("Block encrypt output not expected length (%d != %d)", enc_size,
+				LCZ_HW_KEY_MAC_LEN + user_data_len);
+			ret = -EFAULT;
+		}
+	}
+
+	return ret;
+}
+
+static int decrypt_block(const uint8_t *name_hash, int block_number, struct efs_block_header *hdr,
+			 uint8_t *in_data, int in_data_len, uint8_t *out_data, int out_data_len)
+{
+	int ret;
+	uint32_t out_data_len_ret = 0;
+
+	/* Decrypt and authenticate the block */
+	ret = lcz_hw_key_decrypt_data(hdr->iv, sizeof(hdr->iv), (const uint8_t *)&(hdr->auth_data),
+				      sizeof(hdr->auth_data), in_data, in_data_len, out_data,
+				      out_data_len, &out_data_len_ret);
+
+	/* Compare provided data with authenticated header data */
+	if (ret != 0) {
+		LOG_ERR("decrypt_block: Decrypt failed: %d", ret);
+	} else if (out_data_len_ret != out_data_len) {
+		LOG_ERR("decrypt_block: Decrypt output not expected length (%d != %d)",
+			out_data_len_ret, out_data_len);
+		ret = -EFAULT;
+	} else if (hdr->auth_data.block_number != block_number ||
+		   block_size_of(hdr) != EFS_FILE_BLOCK_ENC_OFFSET + in_data_len ||
+		   (hdr->auth_data.block_size & EFS_BLOCK_DATA_MASK) > out_data_len ||
+		   memcmp(name_hash, hdr->auth_data.file_name_hash,
+			  sizeof(hdr->auth_data.file_name_hash)) != 0) {
+		LOG_ERR("decrypt_block: Decryption succeeded, but metadata is incorrect");
+		memset(out_data, 0, out_data_len);
+		ret = -EINVAL;
+	}
+
+	return ret;
+}
+
+/**
+ * The plaintext size is computed from the number of blocks and the size field in the header of
+ * the last block. The header is associated data, so it is stored in the clear and doesn't need
+ * to be decrypted. It is authenticated when the last block is read. The block size is read from
+ * the header of the first block; it isn't changed for an empty file.
+ */
+static int read_size(struct fs_file_t *f, size_t *size, uint16_t *file_block_size)
+{
+	struct efs_block_header hdr;
+	off_t file_size = 0;
+	int num_blocks = 0;
+	int ret;
+
+	*size = 0;
+
 	/* Get the encrypted size */
+	ret = fs_seek(f, 0, FS_SEEK_END);
 	if (ret == 0) {
-		file_size = fsu_get_file_size_abs(simple_path);
+		file_size = fs_tell(f);
 		if (file_size < 0) {
-			LOG_ERR("efs_get_file_size: Could not read flash file size: %d", file_size);
 			ret = file_size;
 		}
 	}
-
-	/* If the file is empty, shortcut this entire function */
-	if (file_size == 0) {
-		return 0;
+	if (ret < 0) {
+		LOG_ERR("read_size: Could not read flash file size: %d", ret);
 	}
 
-	/* Get the number of file blocks */
-	num_blocks = file_size / EFS_FILE_BLOCK_SIZE;
+	if (ret < 0 || file_size == 0) {
+		return ret;
+	} else if (file_size < sizeof(hdr)) {
+		LOG_ERR("read_size: File is smaller than a block header (%d)", file_size);
+		return -EINVAL;
+	}
 
-	/* Make sure that the file is a mulitple of the encrypted block size */
+	/* Get the block size */
+	ret = read_header(f, 0, &hdr);
 	if (ret == 0) {
-		if ((file_size % EFS_FILE_BLOCK_SIZE) != 0) {
-			LOG_ERR("efs_get_file_size: File is not multiple of block size (%d)",
-				file_size);
+		*file_block_size = block_size_of(&hdr);
+		if (*file_block_size == 0) {
+			LOG_ERR("read_size: Invalid block size code");
 			ret = -EINVAL;
 		}
 	}
 
-	/* Open the file */
-	fs_file_t_init(&f);
+	/* Encrypted files must be a multiple of the block size */
 	if (ret == 0) {
-		ret = fs_open(&f, simple_path, FS_O_READ);
-		if (ret < 0) {
-			LOG_ERR("efs_get_file_size: fs_open failed %d", ret);
+		if ((file_size % *file_block_size) != 0) {
+			LOG_ERR("read_size: File is not multiple of block size (%d)", file_size);
+			ret = -EINVAL;
 		}
+		num_blocks = file_size / *file_block_size;
 	}
 
-	/* Allocate memory for the file block */
-	file_block = (uint8_t *)k_malloc(EFS_FILE_BLOCK_SIZE);
-	if (file_block == NULL) {
-		LOG_ERR("efs_get_file_size: Could not allocate memory for the file block");
-		ret = -ENOMEM;
+	/* Read the header of the last encrypted block */
+	if (ret == 0 && num_blocks > 1) {
+		ret = read_header(f, (num_blocks - 1) * *file_block_size, &hdr);
 	}
 
-	/* Allocate memory for the output block */
-	user_block = (uint8_t *)k_malloc(EFS_USER_BLOCK_SIZE);
-	if (user_block == NULL) {
-		LOG_ERR("efs_get_file_size: Could not allocate memory for the user block");
-		ret = -ENOMEM;
+	/* Sanity check the header */
+	if (ret == 0) {
+		if (hdr.auth_data.block_number != (num_blocks - 1) ||
+		    block_size_of(&hdr) != *file_block_size ||
+		    (hdr.auth_data.block_size & EFS_BLOCK_DATA_MASK) >
+			    EFS_USER_SIZE(*file_block_size)) {
+			LOG_ERR("read_size: Invalid header for block %d", num_blocks - 1);
+			ret = -EINVAL;
+		} else {
+			*size = ((num_blocks - 1) * EFS_USER_SIZE(*file_block_size)) +
+				(hdr.auth_data.block_size & EFS_BLOCK_DATA_MASK);
+		}
 	}
 
-	/* Seek to the start of the last encrypted block */
-	block_offset = num_blocks - 1;
-	ret = fs_seek(&f, block_offset * EFS_FILE_BLOCK_SIZE, FS_SEEK_SET);
+	return ret;
+}
+
+static int read_header(struct fs_file_t *f, off_t position, struct efs_block_header *hdr)
+{
+	int ret;
+
+	ret = fs_seek(f, position, FS_SEEK_SET);
 	if (ret < 0) {
-		LOG_ERR("efs_get_file_size: seek failed to block %d: %d", block_offset, ret);
+		LOG_ERR("read_header: seek failed to %d: %d", position, ret);
 	}
 
-	/* Read the encrypted block */
 	if (ret == 0) {
-		ret = fs_read(&f, file_block, EFS_FILE_BLOCK_SIZE);
+		ret = fs_read(f, hdr, sizeof(*hdr));
 		if (ret < 0) {
-			LOG_ERR("efs_get_file_size: read failed for block %d: %d", block_offset,
-				ret);
-		} else if (ret != EFS_FILE_BLOCK_SIZE) {
-			LOG_ERR("efs_get_file_size: Read only returned %d bytes", ret);
+			LOG_ERR("read_header: read failed at %d: %d", position, ret);
+		} else if (ret != sizeof(*hdr)) {
+			LOG_ERR("read_header: Read only returned %d bytes", ret);
 			ret = -EIO;
 		} else {
 			/* Good read */
@@ -691,338 +989,475 @@ ssize_t efs_get_file_size(const char *abs_path)
 		}
 	}
 
-	/* Decrypt the block */
-	if (ret == 0) {
-		hdr = (struct efs_block_header *)file_block;
-		ret = decrypt_block(simple_path, block_offset, hdr,
-				    file_block + EFS_FILE_BLOCK_ENC_OFFSET,
-				    EFS_FILE_BLOCK_SIZE - EFS_FILE_BLOCK_ENC_OFFSET, user_block,
-				    EFS_USER_BLOCK_SIZE);
-		if (ret < 0) {
-			LOG_ERR("efs_get_file_size: decrypt failed for block %d", block_offset);
+	return ret;
+}
+
+/* Code that is stored in the header for a block size; negative if the size isn't supported */
+static int block_size_code(size_t file_block_size)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(block_sizes); i++) {
+		if (block_sizes[i] == file_block_size) {
+			return i;
 		}
 	}
 
-	/* Close the file */
-	ret2 = fs_close(&f);
-	if (ret2 < 0) {
-		LOG_ERR("efs_get_file_size: Could not close file: %d", ret2);
-		if (ret == 0) {
-			ret = ret2;
+	return -EINVAL;
+}
+
+/* Block size of a file from a block header; 0 if the code is invalid */
+static uint16_t block_size_of(const struct efs_block_header *hdr)
+{
+	uint16_t code = hdr->auth_data.block_size >> EFS_BLOCK_SIZE_CODE_SHIFT;
+
+	return (code < ARRAY_SIZE(block_sizes)) ? block_sizes[code] : 0;
+}
+
+/* The most specific directory setting or else the Kconfig block size */
+static uint16_t new_file_block_size(const char *abs_path)
+{
+	uint16_t block_size = CONFIG_FSU_ENCRYPTED_BLOCK_SIZE;
+#if CONFIG_FSU_ENCRYPTED_BLOCK_SIZE_DIRS > 0
+	size_t match_len = 0;
+	size_t len;
+	int i;
+
+	k_mutex_lock(&block_size_mutex, K_FOREVER);
+	for (i = 0; i < ARRAY_SIZE(block_size_dirs); i++) {
+		len = strlen(block_size_dirs[i].path);
+		if (block_size_dirs[i].block_size != 0 && len > match_len &&
+		    strncmp(abs_path, block_size_dirs[i].path, len) == 0 && abs_path[len] == '/') {
+			block_size = block_size_dirs[i].block_size;
+			match_len = len;
 		}
 	}
+	k_mutex_unlock(&block_size_mutex);
+#endif
 
-	/* Compute the file size */
-	if (ret == 0) {
-		ret = ((num_blocks - 1) * EFS_USER_BLOCK_SIZE) + hdr->auth_data.block_size;
-	}
+	return block_size;
+}
 
-	/* Free any memory that we allocated */
-	if (file_block != NULL) {
-		memset(file_block, 0, EFS_FILE_BLOCK_SIZE);
-		k_free(file_block);
-	}
-	if (user_block != NULL) {
-		memset(user_block, 0, EFS_USER_BLOCK_SIZE);
-		k_free(user_block);
+static int read_exact(struct fs_file_t *f, void *data, size_t size, int block_number)
+{
+	int ret;
+
+	ret = fs_read(f, data, size);
+	if (ret < 0) {
+		LOG_ERR("load_block: read failed for block %d: %d", block_number, ret);
+	} else if (ret != size) {
+		LOG_ERR("load_block: Read only returned %d bytes", ret);
+		ret = -EIO;
+	} else {
+		/* Good read */
+		ret = 0;
 	}
 
 	return ret;
 }
 
-int efs_sha256(uint8_t hash[FSU_HASH_SIZE], const char *abs_path, size_t size)
+/* Read and decrypt a block into the user block of the handle (unless it is already there) */
+static int load_block(struct efs_file *file, int block_number)
 {
-	char simple_path[FSU_MAX_ABS_PATH_SIZE + 1];
-	int block_offset = 0;
-	int this_size;
-	ssize_t file_size;
-	uint8_t *file_block = NULL;
-	uint8_t *user_block = NULL;
 	struct efs_block_header *hdr;
-	struct fs_file_t f;
-	int ret = 0;
-	int ret2;
-	psa_hash_operation_t operation = PSA_HASH_OPERATION_INIT;
-	psa_status_t psa_ret;
-	size_t hash_out_len = 0;
+	bool sequential;
+	bool read_ahead;
+	bool cached;
+	int ret;
 
-	/* Start the hash operation */
-	psa_ret = psa_hash_setup(&operation, PSA_ALG_SHA_256);
-	if (psa_ret != PSA_SUCCESS) {
-		LOG_ERR("efs_sha256: Failed to setup hash operation: %d", psa_ret);
-		ret = psa_ret;
+	if (block_number == file->block_number) {
+		return 0;
 	}
 
-	/* Validate the input parameters */
-	if (ret == 0) {
-		if (abs_path == NULL || hash == NULL || size == 0) {
-			LOG_ERR("efs_sha256: Invalid input parameters");
-			ret = -EINVAL;
+	sequential = (file->block_number == EFS_NO_BLOCK || file->block_number + 1 == block_number);
+
+	/* A modified block must be written before it is replaced */
+	ret = store_block(file);
+
+	/* The block may have been read while the previous block was decrypted */
+	read_ahead = (ret == 0 && read_ahead_take(file, block_number));
+	hdr = (struct efs_block_header *)file->file_block;
+
+	/* Seek to the start of the encrypted block */
+	if (ret == 0 && !read_ahead) {
+		ret = fs_seek(&file->f, block_number * file->file_block_size, FS_SEEK_SET);
+		if (ret < 0) {
+			LOG_ERR("load_block: seek failed to block %d: %d", block_number, ret);
 		}
 	}
 
-	/* Remove any extra slashes in the path */
-	if (ret == 0) {
-		ret = fsu_simplify_path(abs_path, simple_path);
+	/* Read the header of the encrypted block */
+	if (ret == 0 && !read_ahead) {
+		ret = read_exact(&file->f, file->file_block, EFS_FILE_BLOCK_ENC_OFFSET,
+				 block_number);
+	}
+
+	/* A decrypted copy of the block can be used if the header is unchanged */
+	cached = (ret == 0 && cache_get(file, block_number));
+
+	/* Read the rest of the encrypted block */
+	if (ret == 0 && !cached && !read_ahead) {
+		ret = read_exact(&file->f, file->file_block + EFS_FILE_BLOCK_ENC_OFFSET,
+				 file->file_block_size - EFS_FILE_BLOCK_ENC_OFFSET, block_number);
+	}
+
+	/* Read the next block while this block is decrypted */
+	if (ret == 0 && sequential) {
+		read_ahead_start(file, block_number + 1);
+	}
+
+	/* Decrypt the block */
+	if (ret == 0 && !cached) {
+		ret = decrypt_block(file->name_hash, block_number, hdr,
+				    file->file_block + EFS_FILE_BLOCK_ENC_OFFSET,
+				    file->file_block_size - EFS_FILE_BLOCK_ENC_OFFSET,
+				    file->user_block, file->user_block_size);
 		if (ret < 0) {
-			LOG_ERR("efs_sha256: Invalid input path: %s", abs_path);
+			LOG_ERR("load_block: decrypt failed for block %d", block_number);
 		} else {
-			ret = 0;
+			cache_put(hdr, file->user_block, file->user_block_size);
 		}
 	}
 
-	/* Get the size of the encrypted file */
 	if (ret == 0) {
-		file_size = fsu_get_file_size_abs(simple_path);
-		if (file_size < 0) {
-			LOG_ERR("efs_sha256: Could not read flash file size: %d", file_size);
-			ret = file_size;
-		}
+		file->block_number = block_number;
+		file->block_size = hdr->auth_data.block_size & EFS_BLOCK_DATA_MASK;
+	} else if (file->dirty == false) {
+		file->block_number = EFS_NO_BLOCK;
 	}
 
-	/* Make sure that the file is a mulitple of the encrypted block size */
-	if (ret == 0) {
-		if ((file_size % EFS_FILE_BLOCK_SIZE) != 0) {
-			LOG_ERR("efs_sha256: File is not multiple of block size (%d)", file_size);
-			ret = -EINVAL;
-		}
-	}
+	return ret;
+}
 
-	/* Open the file */
-	fs_file_t_init(&f);
-	if (ret == 0) {
-		ret = fs_open(&f, simple_path, FS_O_READ);
-		if (ret < 0) {
-			LOG_ERR("efs_sha256: fs_open failed %d", ret);
-		}
+/* Encrypt and write the user block of the handle if it was modified */
+static int store_block(struct efs_file *file)
+{
+	struct efs_block_header *hdr = (struct efs_block_header *)file->file_block;
+	int ret;
+
+	if (!file->dirty) {
+		return 0;
 	}
 
-	/* Allocate memory for the file block */
-	file_block = (uint8_t *)k_malloc(EFS_FILE_BLOCK_SIZE);
-	if (file_block == NULL) {
-		LOG_ERR("efs_sha256: Could not allocate memory for the file block");
-		ret = -ENOMEM;
+	/* The decrypted copy of the block is no longer valid */
+	cache_invalidate(file->name_hash, file->block_number);
+
+	/* Populate the header for this block */
+	hdr->auth_data.block_number = file->block_number;
+	hdr->auth_data.block_size =
+		file->block_size | (block_size_code(file->file_block_size) << EFS_BLOCK_SIZE_CODE_SHIFT);
+	memcpy(hdr->auth_data.file_name_hash, file->name_hash, sizeof(file->name_hash));
+
+	/* Zero out the rest */
+	memset(file->user_block + file->block_size, 0, file->user_block_size - file->block_size);
+
+	/* Encrypt the block */
+	ret = encrypt_block(hdr, file->user_block, file->user_block_size,
+			    file->file_block + EFS_FILE_BLOCK_ENC_OFFSET);
+	if (ret < 0) {
+		LOG_ERR("store_block: encrypt failed for block %d: %d", file->block_number, ret);
 	}
 
-	/* Allocate memory for the output block */
-	user_block = (uint8_t *)k_malloc(EFS_USER_BLOCK_SIZE);
-	if (user_block == NULL) {
-		LOG_ERR("efs_sha256: Could not allocate memory for the user block");
-		ret = -ENOMEM;
+	/* Seek to the start of the encrypted block */
+	if (ret == 0) {
+		ret = fs_seek(&file->f, file->block_number * file->file_block_size, FS_SEEK_SET);
+		if (ret < 0) {
+			LOG_ERR("store_block: seek failed to block %d: %d", file->block_number,
+				ret);
+		}
 	}
 
-	/* Read the block(s) of the file */
-	while (ret == 0 && size > 0) {
-		/* Read the encrypted block */
-		ret = fs_read(&f, file_block, EFS_FILE_BLOCK_SIZE);
+	/* Write the block to the file */
+	if (ret == 0) {
+		ret = fs_write(&file->f, file->file_block, file->file_block_size);
 		if (ret < 0) {
-			LOG_ERR("efs_sha256: read failed for block %d", block_offset);
-		} else if (ret != EFS_FILE_BLOCK_SIZE) {
-			LOG_ERR("efs_sha256: Read only returned %d bytes", ret);
+			LOG_ERR("store_block: write failed to block %d: %d", file->block_number,
+				ret);
+		} else if (ret != file->file_block_size) {
+			LOG_ERR("store_block: write only wrote %d bytes", ret);
 			ret = -EIO;
 		} else {
-			/* Good read */
+			/* Good write */
 			ret = 0;
+			file->dirty = false;
 		}
+	}
 
-		/* Decrypt the block */
-		if (ret == 0) {
-			hdr = (struct efs_block_header *)file_block;
-			ret = decrypt_block(simple_path, block_offset, hdr,
-					    file_block + EFS_FILE_BLOCK_ENC_OFFSET,
-					    EFS_FILE_BLOCK_SIZE - EFS_FILE_BLOCK_ENC_OFFSET,
-					    user_block, EFS_USER_BLOCK_SIZE);
-			if (ret < 0) {
-				LOG_ERR("efs_sha256: decrypt failed for block %d", block_offset);
-			}
-		}
+	return ret;
+}
 
-		/* Copy the decrypted data to the user's buffer */
-		if (ret == 0) {
-			/* Limit the data size to what is in this block */
-			this_size = size;
-			if (this_size > hdr->auth_data.block_size) {
-				this_size = hdr->auth_data.block_size;
-			}
+/* Free the memory of a handle */
+static void release(struct efs_file *file)
+{
+	read_ahead_stop(file);
 
-			/* Update the hash with this data */
-			psa_ret = psa_hash_update(&operation, user_block, this_size);
-			if (psa_ret != PSA_SUCCESS) {
-				LOG_ERR("efa_sha256: Hash update failed: %d", psa_ret);
-				ret = -EFAULT;
-			}
+	if (file->file_block != NULL) {
+		buffer_free(file->file_block, file->file_block_size + file->user_block_size);
+	}
+	file->file_block = NULL;
+	file->user_block = NULL;
+	file->block_number = EFS_NO_BLOCK;
+	file->dirty = false;
+}
 
-			/* Update counters */
-			size -= this_size;
+/* Blocks that fit are taken from the pool; larger blocks are allocated from the heap */
+static uint8_t *buffer_alloc(size_t size, k_timeout_t timeout)
+{
+	k_spinlock_key_t key;
+	void *buffer = NULL;
+
+#if CONFIG_FSU_ENCRYPTED_BUFFER_POOL_SIZE > 0
+	if (size <= EFS_POOL_BUFFER_SIZE) {
+		int ret = k_mem_slab_alloc(&efs_buffer_pool, &buffer, timeout);
+
+		key = k_spin_lock(&buffer_stats_lock);
+		if (ret == 0) {
+			buffer_stats.used += 1;
+			buffer_stats.peak = MAX(buffer_stats.peak, buffer_stats.used);
+		} else {
+			buffer_stats.timeouts += 1;
+			buffer = NULL;
 		}
+		k_spin_unlock(&buffer_stats_lock, key);
 
-		/* Move to the next block */
-		if (ret == 0 && size > 0) {
-			/* Don't try the next block if the current block is not full */
-			if (hdr->auth_data.block_size != EFS_USER_BLOCK_SIZE) {
-				break;
-			} else {
-				/* Try the next block */
-				block_offset++;
-			}
+		if (ret < 0) {
+			LOG_ERR("buffer_alloc: No buffer available: %d", ret);
 		}
+		return buffer;
 	}
+#else
+	ARG_UNUSED(timeout);
+#endif
 
-	/* Close the file */
-	ret2 = fs_close(&f);
-	if (ret2 < 0) {
-		LOG_ERR("efs_sha256: Could not close file: %d", ret2);
-		if (ret >= 0) {
-			ret = ret2;
-		}
+	buffer = k_malloc(size);
+	if (buffer != NULL) {
+		key = k_spin_lock(&buffer_stats_lock);
+		buffer_stats.heap += 1;
+		k_spin_unlock(&buffer_stats_lock, key);
 	}
 
-	/* Free any memory that we allocated */
-	if (file_block != NULL) {
-		memset(file_block, 0, EFS_FILE_BLOCK_SIZE);
-		k_free(file_block);
+	return buffer;
+}
+
+/* Plaintext is zeroized before the buffer is returned */
+static void buffer_free(uint8_t *buffer, size_t size)
+{
+	memset(buffer, 0, size);
+
+#if CONFIG_FSU_ENCRYPTED_BUFFER_POOL_SIZE > 0
+	if (size <= EFS_POOL_BUFFER_SIZE) {
+		k_spinlock_key_t key;
+
+		k_mem_slab_free(&efs_buffer_pool, (void **)&buffer);
+
+		key = k_spin_lock(&buffer_stats_lock);
+		buffer_stats.used -= 1;
+		k_spin_unlock(&buffer_stats_lock, key);
+		return;
 	}
-	if (user_block != NULL) {
-		memset(user_block, 0, EFS_USER_BLOCK_SIZE);
-		k_free(user_block);
+#endif
+
+	k_free(buffer);
+}
+
+static int write_file(const char *abs_path, void *vdata, size_t size, fs_mode_t flags)
+{
+	struct efs_file file;
+	int ret;
+	int ret2;
+
+	/* Validate input parameters */
+	if (abs_path == NULL) {
+		LOG_ERR("efs_write: invalid path");
+		return -EINVAL;
+	} else if (size != 0 && vdata == NULL) {
+		LOG_ERR("efs_write: null data pointer for size %d", size);
+		return -EINVAL;
 	}
 
-	/* Finish the hash operation */
+	ret = efs_file_open(&file, abs_path, flags);
 	if (ret == 0) {
-		psa_ret = psa_hash_finish(&operation, hash, FSU_HASH_SIZE, &hash_out_len);
-		if (psa_ret != PSA_SUCCESS) {
-			LOG_ERR("efs_sha256: Hash finish failed: %d", psa_ret);
-			ret = psa_ret;
-		} else if (hash_out_len != FSU_HASH_SIZE) {
-			LOG_ERR("efs_sha256: Hash output not expected length (%d)", hash_out_len);
-			ret = -EFAULT;
-		}
-	} else {
-		psa_ret = psa_hash_abort(&operation);
-		if (psa_ret != PSA_SUCCESS) {
-			LOG_ERR("efa_sha256: Hash abort failed: %d", psa_ret);
+		ret = efs_file_write(&file, vdata, size);
+
+		ret2 = efs_file_close(&file);
+		if (ret >= 0 && ret2 < 0) {
+			ret = ret2;
 		}
 	}
 
-	/* Return any error */
 	return ret;
 }
 
-/**************************************************************************************************/
-/* Local Function Definitions                                                                     */
-/**************************************************************************************************/
-static int file_name_hash_gen(const char *abs_path, uint8_t *hash, uint8_t hash_len)
+#if defined(CONFIG_FSU_ENCRYPTED_READ_AHEAD)
+/* Read-ahead is used by read-only handles of files with more than one block */
+static void read_ahead_init(struct efs_file *file)
 {
-	int ret = 0;
-	psa_status_t s;
-	size_t hash_len_out;
-
-	/* Make sure that the hash buffer is the right size */
-	if (hash_len != PSA_HASH_LENGTH(FSE_FILE_NAME_HASH_ALG)) {
-		ret = -EINVAL;
+	if ((file->flags & FS_O_WRITE) != 0 || file->size <= file->user_block_size ||
+	    file->file_block_size > CONFIG_FSU_ENCRYPTED_BLOCK_SIZE) {
+		return;
 	}
 
-	/* Compute the hash */
-	if (ret == 0) {
-		s = psa_hash_compute(FSE_FILE_NAME_HASH_ALG, abs_path, strlen(abs_path), hash,
-				     hash_len, &hash_len_out);
-		if (s == PSA_SUCCESS && hash_len != hash_len_out) {
-			ret = -EFAULT;
-		} else {
-			ret = s;
-		}
+	/* The file can be read without read-ahead, so don't wait for a buffer */
+	if (k_mem_slab_alloc(&efs_read_ahead_pool, (void **)&file->ahead_block, K_NO_WAIT) == 0) {
+		k_work_init(&file->ahead_work, read_ahead_handler);
+	} else {
+		file->ahead_block = NULL;
 	}
+}
 
-	return ret;
+static void read_ahead_start(struct efs_file *file, int block_number)
+{
+	if (file->ahead_block != NULL && !file->ahead_pending &&
+	    block_number * file->user_block_size < file->size) {
+		file->ahead_block_number = block_number;
+		file->ahead_pending = true;
+		k_work_submit_to_queue(&read_ahead_queue, &file->ahead_work);
+	}
 }
 
-static int file_name_hash_comp(const char *abs_path, uint8_t *hash, uint8_t hash_len)
+/* Wait for a pending read. If it read block_number, it becomes the file block of the handle.
+ * The work queue still uses the work item after the handler returns, so the handle (usually on
+ * the stack of the caller) can't be reused or released until the work item is flushed.
+ */
+static bool read_ahead_take(struct efs_file *file, int block_number)
 {
-	int ret = 0;
-	psa_status_t s;
+	struct k_work_sync sync;
+	uint8_t *block;
 
-	/* Make sure that the hash buffer is the right size */
-	if (hash_len != PSA_HASH_LENGTH(FSE_FILE_NAME_HASH_ALG)) {
-		ret = -EINVAL;
+	if (!file->ahead_pending) {
+		return false;
 	}
 
-	/* Compute the hash */
-	if (ret == 0) {
-		s = psa_hash_compare(FSE_FILE_NAME_HASH_ALG, abs_path, strlen(abs_path), hash,
-				     hash_len);
-		ret = s;
+	(void)k_work_flush(&file->ahead_work, &sync);
+	file->ahead_pending = false;
+
+	if (file->ahead_ret < 0 || file->ahead_block_number != block_number) {
+		return false;
 	}
 
-	return ret;
+	block = file->file_block;
+	file->file_block = file->ahead_block;
+	file->ahead_block = block;
+	return true;
 }
 
-static int encrypt_block(struct efs_block_header *hdr, uint8_t *user_data, ssize_t user_data_len,
-			 uint8_t *out)
+static void read_ahead_stop(struct efs_file *file)
 {
-	uint32_t enc_size = 0;
-	int ret = 0;
+	uint8_t *buffer;
 
-	/* Validate the input */
-	if (hdr == NULL || user_data == NULL || user_data_len == 0 ||
-	    user_data_len > EFS_USER_BLOCK_SIZE) {
-		ret = -EINVAL;
+	if (file->ahead_block == NULL) {
+		return;
 	}
 
-	/* Generate a new IV for this block */
-	if (ret == 0) {
-		ret = lcz_hw_key_generate_iv(hdr->iv, LCZ_HW_KEY_IV_LEN);
-		if (ret != 0) {
-			LOG_ERR("Block encrypt failed to generate IV: %d", ret);
-		}
+	(void)read_ahead_take(file, EFS_NO_BLOCK);
+
+	/* The file block is freed with the user block that follows it */
+	buffer = file->user_block - file->file_block_size;
+	if (file->file_block != buffer) {
+		file->ahead_block = file->file_block;
+		file->file_block = buffer;
 	}
 
-	/* Encrypt the block */
-	if (ret == 0) {
-		ret = lcz_hw_key_encrypt_data(hdr->iv, sizeof(hdr->iv),
-					      (const uint8_t *)&(hdr->auth_data),
-					      sizeof(hdr->auth_data), user_data, user_data_len, out,
-					      EFS_USER_BLOCK_SIZE + LCZ_HW_KEY_MAC_LEN, &enc_size);
-		if (ret != 0) {
-			LOG_ERR("Block encrypt failed: %d", ret);
-		} else if (enc_size != (LCZ_HW_KEY_MAC_LEN + user_data_len)) {
-			LOG_ERR("Block encrypt output not expected length (%d != %d)", enc_size,
-				LCZ_HW_KEY_MAC_LEN + user_data_len);
-			ret = -EFAULT;
+	memset(file->ahead_block, 0, file->file_block_size);
+	k_mem_slab_free(&efs_read_ahead_pool, (void **)&file->ahead_block);
+	file->ahead_block = NULL;
+}
+
+/* Runs on the read-ahead work queue; the handle doesn't use the file until the read is taken */
+static void read_ahead_handler(struct k_work *work)
+{
+	struct efs_file *file = CONTAINER_OF(work, struct efs_file, ahead_work);
+
+	file->ahead_ret = fs_seek(&file->f, file->ahead_block_number * file->file_block_size,
+				  FS_SEEK_SET);
+	if (file->ahead_ret == 0) {
+		file->ahead_ret = read_exact(&file->f, file->ahead_block, file->file_block_size,
+					     file->ahead_block_number);
+	}
+}
+#endif
+
+#if CONFIG_FSU_ENCRYPTED_BLOCK_CACHE_SIZE > 0
+/* Copy a decrypted block into the user block of the handle if the header (read from the file)
+ * matches a cached block. The header is checked like it would be after decryption.
+ */
+static bool cache_get(struct efs_file *file, int block_number)
+{
+	struct efs_block_header *hdr = (struct efs_block_header *)file->file_block;
+	bool found = false;
+	int i;
+
+	if (file->user_block_size > sizeof(block_cache[0].data) ||
+	    hdr->auth_data.block_number != block_number ||
+	    memcmp(file->name_hash, hdr->auth_data.file_name_hash, sizeof(file->name_hash)) != 0) {
+		return false;
+	}
+
+	k_mutex_lock(&block_cache_mutex, K_FOREVER);
+	for (i = 0; i < ARRAY_SIZE(block_cache); i++) {
+		if (block_cache[i].valid &&
+		    memcmp(&block_cache[i].hdr, hdr, sizeof(block_cache[i].hdr)) == 0) {
+			memcpy(file->user_block, block_cache[i].data, file->user_block_size);
+			block_cache[i].last_used = ++block_cache_time;
+			found = true;
+			break;
 		}
 	}
+	k_mutex_unlock(&block_cache_mutex);
 
-	return ret;
+	return found;
 }
 
-static int decrypt_block(const char *abs_path, int block_number, struct efs_block_header *hdr,
-			 uint8_t *in_data, int in_data_len, uint8_t *out_data, int out_data_len)
+/* Replace an empty or the least recently used entry. Blocks that don't fit aren't cached. */
+static void cache_put(const struct efs_block_header *hdr, const uint8_t *data, size_t size)
 {
-	int ret;
-	uint32_t out_data_len_ret = 0;
+	struct block_cache_entry *entry = &block_cache[0];
+	int i;
 
-	/* Decrypt and authenticate the block */
-	ret = lcz_hw_key_decrypt_data(hdr->iv, sizeof(hdr->iv), (const uint8_t *)&(hdr->auth_data),
-				      sizeof(hdr->auth_data), in_data, in_data_len, out_data,
-				      out_data_len, &out_data_len_ret);
+	if (size > sizeof(entry->data)) {
+		return;
+	}
 
-	/* Compare provided data with authenticated header data */
-	if (ret != 0) {
-		LOG_ERR("decrypt_block: Decrypt failed: %d", ret);
-	} else if (out_data_len_ret != out_data_len) {
-		LOG_ERR("decrypt_block: Decrypt output not expected length (%d != %d)",
-			out_data_len_ret, out_data_len);
-		ret = -EFAULT;
-	} else if (hdr->auth_data.block_number != block_number ||
-		   file_name_hash_comp(abs_path, hdr->auth_data.file_name_hash,
-				       sizeof(hdr->auth_data.file_name_hash)) != 0) {
-		LOG_ERR("decrypt_block: Decryption succeeded, but metadata is incorrect");
-		memset(out_data, 0, out_data_len);
-		ret = -EINVAL;
+	k_mutex_lock(&block_cache_mutex, K_FOREVER);
+	for (i = 0; i < ARRAY_SIZE(block_cache); i++) {
+		if (!block_cache[i].valid) {
+			entry = &block_cache[i];
+			break;
+		} else if (block_cache[i].last_used < entry->last_used) {
+			entry = &block_cache[i];
+		}
 	}
 
-	return ret;
+	/* Zeroize the evicted block */
+	memset(entry, 0, sizeof(*entry));
+	memcpy(&entry->hdr, hdr, sizeof(entry->hdr));
+	memcpy(entry->data, data, size);
+	entry->last_used = ++block_cache_time;
+	entry->valid = true;
+	k_mutex_unlock(&block_cache_mutex);
 }
 
+/* Remove a block of a file (or all blocks when block_number is EFS_NO_BLOCK) */
+static void cache_invalidate(const uint8_t *name_hash, int block_number)
+{
+	struct block_cache_entry *entry;
+	int i;
+
+	k_mutex_lock(&block_cache_mutex, K_FOREVER);
+	for (i = 0; i < ARRAY_SIZE(block_cache); i++) {
+		entry = &block_cache[i];
+		if (entry->valid &&
+		    (block_number == EFS_NO_BLOCK ||
+		     entry->hdr.auth_data.block_number == block_number) &&
+		    memcmp(entry->hdr.auth_data.file_name_hash, name_hash,
+			   sizeof(entry->hdr.auth_data.file_name_hash)) == 0) {
+			memset(entry, 0, sizeof(*entry));
+		}
+	}
+	k_mutex_unlock(&block_cache_mutex);
+}
+#endif
+
 /**************************************************************************************************/
 /* SYS_INIT                                                                                       */
 /**************************************************************************************************/
@@ -1039,5 +1474,12 @@ static int lcz_enc_fs_init(const struct device *device)
 		}
 	}
 
+#if defined(CONFIG_FSU_ENCRYPTED_READ_AHEAD)
+	k_work_queue_start(&read_ahead_queue, read_ahead_stack,
+			   K_THREAD_STACK_SIZEOF(read_ahead_stack),
+			   CONFIG_FSU_ENCRYPTED_READ_AHEAD_PRIORITY, NULL);
+	k_thread_name_set(&read_ahead_queue.thread, "efs_read_ahead");
+#endif
+
 	return r;
 }
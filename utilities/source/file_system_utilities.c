@@ -36,6 +36,40 @@ LOG_MODULE_REGISTER(fsu, CONFIG_FSU_LOG_LEVEL);
 		break;                                                                             \
 	}
 
+/* Algorithms that fsu_digest_abs can compute */
+#define DIGEST_ALGORITHMS                                                                          \
+	((IS_ENABLED(CONFIG_FSU_HASH) ? FSU_DIGEST_SHA256 : 0) |                                   \
+	 (IS_ENABLED(CONFIG_FSU_CHECKSUM) ? FSU_DIGEST_CRC32 : 0))
+
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+/* File kept open by the append and write functions. The path is simplified. */
+struct cached_file {
+	struct fs_file_t handle;
+	char path[FSU_MAX_ABS_PATH_SIZE + 1];
+	int64_t last_used;
+	bool open;
+};
+#endif
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static ssize_t fsu_wa(const char *path, const char *name, void *data, size_t size, bool append);
+
+static ssize_t fsu_wa_abs(const char *abs_path, void *data, size_t size, bool append);
+
+static size_t digest_chunk_size(uint32_t algorithms);
+
+static int wa_open(struct fs_file_t **handle, const char *abs_path, bool append);
+static int wa_close(struct fs_file_t *handle, ssize_t status);
+
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+static void file_cache_work_handler(struct k_work *work);
+static int file_cache_open(struct cached_file **entry, const char *abs_path);
+static int file_cache_release(const char *abs_path, bool close);
+static int file_cache_close(struct cached_file *entry);
+#endif
+
 /**************************************************************************************************/
 /* Local Data Definitions                                                                         */
 /**************************************************************************************************/
@@ -55,12 +89,13 @@ static struct fs_mount_t littlefs_mnt = { .type = FS_LITTLEFS,
 static bool lfs_mounted;
 #endif
 
-/**************************************************************************************************/
-/* Local Function Prototypes                                                                      */
-/**************************************************************************************************/
-static ssize_t fsu_wa(const char *path, const char *name, void *data, size_t size, bool append);
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+static K_MUTEX_DEFINE(file_cache_mutex);
 
-static ssize_t fsu_wa_abs(const char *abs_path, void *data, size_t size, bool append);
+static K_WORK_DELAYABLE_DEFINE(file_cache_work, file_cache_work_handler);
+
+static struct cached_file file_cache[CONFIG_FSU_FILE_CACHE_SIZE];
+#endif
 
 /**************************************************************************************************/
 /* Global Function Definitions                                                                    */
@@ -96,6 +131,25 @@ int fsu_lfs_mount(void)
 	return rc;
 }
 
+int fsu_lfs_unmount(void)
+{
+	int rc = 0;
+#ifdef CONFIG_FSU_LFS_MOUNT
+	k_mutex_lock(&lfs_init_mutex, K_FOREVER);
+	if (lfs_mounted) {
+		(void)fsu_close_cached(NULL);
+		rc = fs_unmount(&littlefs_mnt);
+		if (rc != 0) {
+			LOG_ERR("Error unmounting littlefs [%d]", rc);
+		} else {
+			lfs_mounted = false;
+		}
+	}
+	k_mutex_unlock(&lfs_init_mutex);
+#endif
+	return rc;
+}
+
 void fsu_list_directory(const char *path)
 {
 	if (path == NULL) {
@@ -139,6 +193,9 @@ struct fs_dirent *fsu_find(const char *path, const char *name, size_t *count,
 		return results;
 	}
 
+	/* Sizes of cached files are only updated when they are committed */
+	(void)fsu_flush(NULL);
+
 	/* Count matching items */
 	fs_dir_t_init(&dir);
 	int rc = fs_opendir(&dir, path);
@@ -217,54 +274,12 @@ int fsu_sha256(uint8_t hash[FSU_HASH_SIZE], const char *path, const char *name,
 
 int fsu_sha256_abs(uint8_t hash[FSU_HASH_SIZE], const char *abs_path, size_t size)
 {
-	int rc = -EPERM;
+	struct fsu_digest digest;
+	int rc;
 
-	memset(&hash[0], 0, FSU_HASH_SIZE);
+	rc = fsu_digest_abs(&digest, FSU_DIGEST_SHA256, abs_path, size);
+	memcpy(hash, digest.sha256, FSU_HASH_SIZE);
 
-#ifdef CONFIG_FSU_HASH
-	struct fs_file_t f;
-
-	fs_file_t_init(&f);
-	rc = fs_open(&f, abs_path, FS_O_READ);
-	if (rc < 0) {
-		return rc;
-	}
-
-	uint8_t *pBuffer = k_malloc(CONFIG_FSU_HASH_CHUNK_SIZE);
-	mbedtls_sha256_context *pCtx = k_malloc(sizeof(mbedtls_sha256_context));
-	if ((pBuffer != NULL) && (pCtx != NULL)) {
-		mbedtls_sha256_init(pCtx);
-		rc = mbedtls_sha256_starts(pCtx, 0);
-
-		size_t rem = size;
-		ssize_t bytes_read;
-		size_t length;
-		while (rc == 0 && rem > 0) {
-			length = MIN(rem, CONFIG_FSU_HASH_CHUNK_SIZE);
-			bytes_read = fs_read(&f, pBuffer, length);
-			if (bytes_read == length) {
-				rc = mbedtls_sha256_update(pCtx, pBuffer, length);
-				rem -= length;
-			} else {
-				rc = -EIO;
-			}
-		}
-
-		if (rc == 0 && rem == 0) {
-			rc = mbedtls_sha256_finish(pCtx, hash);
-		}
-	} else {
-		rc = -ENOMEM;
-	}
-
-	if (pBuffer != NULL) {
-		k_free(pBuffer);
-	}
-	if (pCtx != NULL) {
-		k_free(pCtx);
-	}
-	(void)fs_close(&f);
-#endif
 	return rc;
 }
 
@@ -285,40 +300,88 @@ int fsu_crc32(uint32_t *checksum, const char *path, const char *name, size_t siz
 }
 
 int fsu_crc32_abs(uint32_t *checksum, const char *abs_path, size_t size)
+{
+	struct fsu_digest digest;
+	int rc;
+
+	rc = fsu_digest_abs(&digest, FSU_DIGEST_CRC32, abs_path, size);
+	*checksum = digest.crc32;
+
+	return rc;
+}
+
+int fsu_digest_abs(struct fsu_digest *digest, uint32_t algorithms, const char *abs_path,
+		   size_t size)
 {
 	int rc = -EPERM;
+	size_t chunk_size = digest_chunk_size(algorithms);
 
-	*checksum = 0;
+	memset(digest, 0, sizeof(*digest));
 
-#ifdef CONFIG_FSU_CHECKSUM
+	if (chunk_size == 0 || (algorithms & ~DIGEST_ALGORITHMS) != 0) {
+		return rc;
+	}
 
+#if defined(CONFIG_FSU_HASH) || defined(CONFIG_FSU_CHECKSUM)
 	struct fs_file_t f;
 
+	(void)fsu_flush(abs_path);
 	fs_file_t_init(&f);
 	rc = fs_open(&f, abs_path, FS_O_READ);
 	if (rc < 0) {
 		return rc;
 	}
 
-	uint8_t *pBuffer = k_malloc(CONFIG_FSU_CHECKSUM_CHUNK_SIZE);
-	if (pBuffer != NULL) {
-		size_t rem = size;
-		ssize_t bytes_read;
-		size_t length;
-		while (rc == 0 && rem > 0) {
-			length = MIN(rem, CONFIG_FSU_CHECKSUM_CHUNK_SIZE);
-			bytes_read = fs_read(&f, pBuffer, length);
-			if (bytes_read == length) {
-				*checksum = crc32_ieee_update(*checksum, pBuffer, bytes_read);
-				rem -= length;
-			} else {
-				rc = -EIO;
-			}
-		}
-	} else {
+	/* Each chunk is passed to every requested algorithm so the file is only read once */
+	uint8_t *pBuffer = k_malloc(chunk_size);
+	if (pBuffer == NULL) {
 		rc = -ENOMEM;
 	}
 
+#ifdef CONFIG_FSU_HASH
+	mbedtls_sha256_context *pCtx = NULL;
+	if (rc == 0 && (algorithms & FSU_DIGEST_SHA256) != 0) {
+		pCtx = k_malloc(sizeof(mbedtls_sha256_context));
+		if (pCtx != NULL) {
+			mbedtls_sha256_init(pCtx);
+			rc = mbedtls_sha256_starts(pCtx, 0);
+		} else {
+			rc = -ENOMEM;
+		}
+	}
+#endif
+
+	size_t rem = size;
+	ssize_t bytes_read;
+	size_t length;
+	while (rc == 0 && rem > 0) {
+		length = MIN(rem, chunk_size);
+		bytes_read = fs_read(&f, pBuffer, length);
+		if (bytes_read != length) {
+			rc = -EIO;
+			break;
+		}
+#ifdef CONFIG_FSU_HASH
+		if (pCtx != NULL) {
+			rc = mbedtls_sha256_update(pCtx, pBuffer, length);
+		}
+#endif
+#ifdef CONFIG_FSU_CHECKSUM
+		if ((algorithms & FSU_DIGEST_CRC32) != 0) {
+			digest->crc32 = crc32_ieee_update(digest->crc32, pBuffer, length);
+		}
+#endif
+		rem -= length;
+	}
+
+#ifdef CONFIG_FSU_HASH
+	if (rc == 0 && pCtx != NULL) {
+		rc = mbedtls_sha256_finish(pCtx, digest->sha256);
+	}
+	if (pCtx != NULL) {
+		k_free(pCtx);
+	}
+#endif
 	if (pBuffer != NULL) {
 		k_free(pBuffer);
 	}
@@ -381,6 +444,24 @@ ssize_t fsu_write_abs(const char *abs_path, void *data, size_t size)
 	return fsu_wa_abs(abs_path, data, size, false);
 }
 
+int fsu_flush(const char *abs_path)
+{
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+	return file_cache_release(abs_path, false);
+#else
+	return 0;
+#endif
+}
+
+int fsu_close_cached(const char *abs_path)
+{
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+	return file_cache_release(abs_path, true);
+#else
+	return 0;
+#endif
+}
+
 int fsu_delete(const char *path, const char *name)
 {
 	char abs_path[FSU_MAX_ABS_PATH_SIZE];
@@ -397,6 +478,7 @@ int fsu_delete(const char *path, const char *name)
 int fsu_delete_abs(const char *abs_path)
 {
 	LOG_DBG("Deleting (unlinking) file %s", abs_path);
+	(void)fsu_close_cached(abs_path);
 	return fs_unlink(abs_path);
 }
 
@@ -419,6 +501,7 @@ int fsu_delete_files(const char *path, const char *name)
 			(void)fsu_build_full_name(abs_path, sizeof(abs_path), path,
 						  pEntries[i].name);
 			LOG_DBG("Deleting (unlinking) file %s", abs_path);
+			(void)fsu_close_cached(abs_path);
 			status = fs_unlink(abs_path);
 			if (status == 0) {
 				i += 1;
@@ -562,6 +645,7 @@ ssize_t fsu_read_abs_block(const char *abs_path, uint32_t offset, void *data, si
 			break;
 		}
 
+		(void)fsu_flush(abs_path);
 		r = fs_stat(abs_path, entry);
 		if (r < 0) {
 			LOG_DBG("File %s does not exist: %d", abs_path, r);
@@ -611,6 +695,7 @@ ssize_t fsu_get_file_size_abs(const char *abs_path)
 			break;
 		}
 
+		(void)fsu_flush(abs_path);
 		r = fs_stat(abs_path, entry);
 		if (r < 0) {
 			LOG_WRN("%s not found", abs_path);
@@ -723,19 +808,21 @@ static ssize_t fsu_wa(const char *path, const char *name, void *data, size_t siz
 
 static ssize_t fsu_wa_abs(const char *abs_path, void *data, size_t size, bool append)
 {
-	fs_mode_t flags = FS_O_CREATE | FS_O_WRITE | (append ? FS_O_APPEND : 0);
 	const char *desc = append ? "append" : "write";
 	ssize_t rc = -EPERM;
 
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+	k_mutex_lock(&file_cache_mutex, K_FOREVER);
+#endif
 	do {
 		if (abs_path == NULL) {
 			LOG_ERR("Invalid path + file name");
 			break;
 		}
 
-		struct fs_file_t handle;
-		fs_file_t_init(&handle);
-		rc = fs_open(&handle, abs_path, flags);
+		struct fs_file_t file;
+		struct fs_file_t *handle = &file;
+		rc = wa_open(&handle, abs_path, append);
 		if (rc < 0) {
 			LOG_ERR("Unable to open file %s for %s", abs_path, desc);
 		}
@@ -743,10 +830,10 @@ static ssize_t fsu_wa_abs(const char *abs_path, void *data, size_t size, bool ap
 
 		/* When rewriting a file the size must be updated. */
 		if (rc >= 0 && !append) {
-			rc = fs_truncate(&handle, size);
+			rc = fs_truncate(handle, size);
 		}
 
-		rc = fs_write(&handle, data, size);
+		rc = fs_write(handle, data, size);
 		if (rc < 0) {
 			LOG_ERR("Unable to %s file %s", desc, abs_path);
 		} else if (rc != size) {
@@ -756,7 +843,7 @@ static ssize_t fsu_wa_abs(const char *abs_path, void *data, size_t size, bool ap
 			LOG_DBG("%s %s (%d)", abs_path, desc, rc);
 		}
 
-		int rc2 = fs_close(&handle);
+		int rc2 = wa_close(handle, rc);
 		if (rc2 < 0) {
 			LOG_ERR("Unable to close file");
 			/* Don't mask other errors */
@@ -766,6 +853,9 @@ static ssize_t fsu_wa_abs(const char *abs_path, void *data, size_t size, bool ap
 		}
 
 	} while (0);
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+	k_mutex_unlock(&file_cache_mutex);
+#endif
 
 #ifdef CONFIG_FSU_REWRITE_SIZE_CHECK
 	if (rc >= 0 && !append) {
@@ -780,3 +870,174 @@ static ssize_t fsu_wa_abs(const char *abs_path, void *data, size_t size, bool ap
 
 	return rc;
 }
+
+/* Digests that include SHA256 use the hash chunk size */
+static size_t digest_chunk_size(uint32_t algorithms)
+{
+#ifdef CONFIG_FSU_HASH
+	if ((algorithms & FSU_DIGEST_SHA256) != 0) {
+		return CONFIG_FSU_HASH_CHUNK_SIZE;
+	}
+#endif
+#ifdef CONFIG_FSU_CHECKSUM
+	if ((algorithms & FSU_DIGEST_CRC32) != 0) {
+		return CONFIG_FSU_CHECKSUM_CHUNK_SIZE;
+	}
+#endif
+	ARG_UNUSED(algorithms);
+	return 0;
+}
+
+/* A cached file is positioned for the write; otherwise, handle is opened. Mutex must be held. */
+static int wa_open(struct fs_file_t **handle, const char *abs_path, bool append)
+{
+	fs_mode_t flags = FS_O_CREATE | FS_O_WRITE | (append ? FS_O_APPEND : 0);
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+	char key[FSU_MAX_ABS_PATH_SIZE + 1];
+	struct cached_file *entry;
+	int rc;
+
+	/* The same file can be named by different strings */
+	if (fsu_simplify_path(abs_path, key) >= 0) {
+		rc = file_cache_open(&entry, key);
+		if (rc == 0) {
+			rc = fs_seek(&entry->handle, 0, append ? FS_SEEK_END : FS_SEEK_SET);
+			if (rc < 0) {
+				(void)file_cache_close(entry);
+			} else {
+				*handle = &entry->handle;
+			}
+		}
+		return rc;
+	}
+#endif
+	fs_file_t_init(*handle);
+	return fs_open(*handle, abs_path, flags);
+}
+
+/* A cached file is kept open unless the write failed. Mutex must be held. */
+static int wa_close(struct fs_file_t *handle, ssize_t status)
+{
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+	struct cached_file *entry;
+
+	for (entry = file_cache; entry < &file_cache[CONFIG_FSU_FILE_CACHE_SIZE]; entry++) {
+		if (handle == &entry->handle) {
+			if (status < 0) {
+				return file_cache_close(entry);
+			}
+			entry->last_used = k_uptime_get();
+			(void)k_work_schedule(&file_cache_work,
+					      K_MSEC(CONFIG_FSU_FILE_CACHE_IDLE_MS));
+			return 0;
+		}
+	}
+#endif
+	return fs_close(handle);
+}
+
+#if CONFIG_FSU_FILE_CACHE_SIZE > 0
+/* Close files that haven't been written for the idle time */
+static void file_cache_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+	struct cached_file *entry;
+	int64_t idle;
+	int64_t next = CONFIG_FSU_FILE_CACHE_IDLE_MS;
+	bool open = false;
+
+	k_mutex_lock(&file_cache_mutex, K_FOREVER);
+	for (entry = file_cache; entry < &file_cache[CONFIG_FSU_FILE_CACHE_SIZE]; entry++) {
+		if (!entry->open) {
+			continue;
+		}
+		idle = k_uptime_get() - entry->last_used;
+		if (idle >= CONFIG_FSU_FILE_CACHE_IDLE_MS) {
+			if (file_cache_close(entry) < 0) {
+				LOG_ERR("Unable to close cached file %s", entry->path);
+			}
+		} else {
+			next = MIN(next, CONFIG_FSU_FILE_CACHE_IDLE_MS - idle);
+			open = true;
+		}
+	}
+
+	if (open) {
+		(void)k_work_schedule(&file_cache_work, K_MSEC(next));
+	}
+	k_mutex_unlock(&file_cache_mutex);
+}
+
+/* Find the file or open it in place of an unused or the least recently used file */
+static int file_cache_open(struct cached_file **entry, const char *abs_path)
+{
+	struct cached_file *lru = NULL;
+	struct cached_file *e;
+	int rc;
+
+	for (e = file_cache; e < &file_cache[CONFIG_FSU_FILE_CACHE_SIZE]; e++) {
+		if (e->open && strcmp(e->path, abs_path) == 0) {
+			*entry = e;
+			return 0;
+		}
+		if (lru == NULL || (lru->open && (!e->open || e->last_used < lru->last_used))) {
+			lru = e;
+		}
+	}
+
+	if (lru->open && file_cache_close(lru) < 0) {
+		LOG_ERR("Unable to close cached file %s", lru->path);
+	}
+
+	/* Opened without FS_O_APPEND so that the file can also be rewritten */
+	fs_file_t_init(&lru->handle);
+	rc = fs_open(&lru->handle, abs_path, FS_O_CREATE | FS_O_WRITE);
+	if (rc == 0) {
+		strcpy(lru->path, abs_path);
+		lru->open = true;
+		*entry = lru;
+	}
+
+	return rc;
+}
+
+/* Sync or close the file (or all files if abs_path is NULL) */
+static int file_cache_release(const char *abs_path, bool close)
+{
+	char key[FSU_MAX_ABS_PATH_SIZE + 1];
+	struct cached_file *entry;
+	int rc = 0;
+	int rc2;
+
+	/* A path that can't be simplified can't be in the cache */
+	if (abs_path != NULL && fsu_simplify_path(abs_path, key) < 0) {
+		return 0;
+	}
+
+	k_mutex_lock(&file_cache_mutex, K_FOREVER);
+	for (entry = file_cache; entry < &file_cache[CONFIG_FSU_FILE_CACHE_SIZE]; entry++) {
+		if (!entry->open || (abs_path != NULL && strcmp(entry->path, key) != 0)) {
+			continue;
+		}
+		rc2 = close ? file_cache_close(entry) : fs_sync(&entry->handle);
+		if (rc2 < 0) {
+			LOG_ERR("Unable to %s cached file %s", close ? "close" : "sync",
+				entry->path);
+			/* Report the first error */
+			if (rc == 0) {
+				rc = rc2;
+			}
+		}
+	}
+	k_mutex_unlock(&file_cache_mutex);
+
+	return rc;
+}
+
+/* Mutex must be held */
+static int file_cache_close(struct cached_file *entry)
+{
+	entry->open = false;
+	return fs_close(&entry->handle);
+}
+#endif
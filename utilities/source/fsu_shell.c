@@ -64,6 +64,8 @@ static const char SET_DESCRIPTION[] = "Set a parameter:\r\n"
 
 #define FSUS_ALLOW_DELETE_ALL_STR "-f"
 
+#define FSUS_BENCH_CHUNK_SIZE 1024
+
 /**************************************************************************************************/
 /* Local Function Prototypes                                                                      */
 /**************************************************************************************************/
@@ -83,6 +85,9 @@ static int fsu_enc_create_cmd(const struct shell *shell, size_t argc, char **arg
 static int fsu_enc_append_cmd(const struct shell *shell, size_t argc, char **argv);
 static int fsu_enc_dump_cmd(const struct shell *shell, size_t argc, char **argv);
 static int fsu_enc_sha256_cmd(const struct shell *shell, size_t argc, char **argv);
+static int fsu_enc_bench_cmd(const struct shell *shell, size_t argc, char **argv);
+static void fsu_print_rate(const struct shell *shell, const char *name, ssize_t status,
+			   size_t size, int64_t ms);
 #endif
 
 static int fsu_shell_init(const struct device *device);
@@ -108,6 +113,8 @@ SHELL_STATIC_SUBCMD_SET_CREATE(
 	SHELL_CMD(enc_append, NULL, "Append to an encrypted file", fsu_enc_append_cmd),
 	SHELL_CMD(enc_dump, NULL, "Dump the contents of an encrypted file", fsu_enc_dump_cmd),
 	SHELL_CMD(enc_sha, NULL, "Calculate hash of an encrypted file", fsu_enc_sha256_cmd),
+	SHELL_CMD(enc_bench, NULL, "Measure hash and read rate of an encrypted file",
+		  fsu_enc_bench_cmd),
 #endif
 	SHELL_SUBCMD_SET_END);
 
@@ -392,6 +399,65 @@ static int fsu_enc_sha256_cmd(const struct shell *shell, size_t argc, char **arg
 	fsu_free_found(pEntries);
 	return 0;
 }
+
+static int fsu_enc_bench_cmd(const struct shell *shell, size_t argc, char **argv)
+{
+	char *abs_path = fsu_name_handler(argc, argv);
+	uint8_t hash[FSU_HASH_SIZE];
+	struct efs_file file;
+	uint8_t *chunk;
+	ssize_t status = 0;
+	ssize_t file_size = 0;
+	int64_t start;
+	int64_t ms;
+
+	file_size = efs_get_file_size(abs_path);
+	if (file_size <= 0) {
+		shell_print(shell, "Failed to read file size of %s: %d", abs_path, file_size);
+		return 0;
+	}
+
+	chunk = (uint8_t *)k_malloc(FSUS_BENCH_CHUNK_SIZE);
+	if (chunk == NULL) {
+		shell_print(shell, "Unable to allocate read buffer");
+		return 0;
+	}
+
+	start = k_uptime_get();
+	status = efs_sha256(hash, abs_path, file_size);
+	ms = k_uptime_delta(&start);
+	fsu_print_rate(shell, "Hash", status, file_size, ms);
+
+	start = k_uptime_get();
+	status = efs_file_open(&file, abs_path, FS_O_READ);
+	if (status == 0) {
+		do {
+			status = efs_file_read(&file, chunk, FSUS_BENCH_CHUNK_SIZE);
+		} while (status > 0);
+		(void)efs_file_close(&file);
+	}
+	ms = k_uptime_delta(&start);
+	fsu_print_rate(shell, "Read", status, file_size, ms);
+
+	memset(chunk, 0, FSUS_BENCH_CHUNK_SIZE);
+	k_free(chunk);
+	return 0;
+}
+
+static void fsu_print_rate(const struct shell *shell, const char *name, ssize_t status,
+			   size_t size, int64_t ms)
+{
+	uint32_t rate;
+
+	if (status < 0) {
+		shell_print(shell, "%s failed %d", name, status);
+	} else {
+		/* Hundredths of a MB/s */
+		rate = (uint32_t)((size * 100000ULL) / (MAX(ms, 1) * 1000000ULL));
+		shell_print(shell, "%s of %u bytes took %u ms (%u.%02u MB/s)", name, size,
+			    (uint32_t)ms, rate / 100, rate % 100);
+	}
+}
 #endif
 
 static int fsu_shell_init(const struct device *device)
@@ -0,0 +1,586 @@
+/**
+ * @file lcz_kv_parser.c
+ * @brief Parser for text files of key=value lines that is shared by the
+ * key-value pair and parameter file modules.
+ *
+ * Copyright (c) 2022 Laird Connectivity
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(lcz_kv_parser, CONFIG_LCZ_KV_PARSER_LOG_LEVEL);
+
+/**************************************************************************************************/
+/* Includes                                                                                       */
+/**************************************************************************************************/
+#include <zephyr.h>
+#include <sys/util.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "file_system_utilities.h"
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+#include "encrypted_file_storage.h"
+#endif
+#include "lcz_kv_parser.h"
+
+/**************************************************************************************************/
+/* Local Constant, Macro and Type Definitions                                                     */
+/**************************************************************************************************/
+#define CR_CHAR '\r'
+#define EOL_CHAR '\n'
+
+#define CHUNK_SIZE CONFIG_LCZ_KV_PARSER_CHUNK_SIZE
+#define MAX_LINE_SIZE CONFIG_LCZ_KV_PARSER_MAX_LINE_SIZE
+
+#define ARRAY_INITIAL_CAPACITY 8
+
+/* Word-at-a-time (SWAR) byte tests. Any false positives only cause the
+ * word to be processed one character at a time.
+ */
+#define SWAR_SIZE sizeof(uint32_t)
+#define SWAR_ONES 0x01010101UL
+#define SWAR_HIGHS 0x80808080UL
+#define SWAR_HAS_ZERO(x) (((x) - SWAR_ONES) & ~(x) & SWAR_HIGHS)
+#define SWAR_HAS_LESS(x, n) (((x) - (SWAR_ONES * (n))) & ~(x) & SWAR_HIGHS)
+#define SWAR_HAS_MORE(x, n) ((((x) + (SWAR_ONES * (127 - (n)))) | (x)) & SWAR_HIGHS)
+#define SWAR_HAS_BYTE(x, c) SWAR_HAS_ZERO((x) ^ (SWAR_ONES * (uint8_t)(c)))
+
+/* State that is carried between chunks */
+typedef struct parser {
+	const lcz_kv_syntax_t *syntax;
+	lcz_kv_parser_callback_t cb;
+	void *context;
+	/* Output; NULL when validating */
+	char *buf;
+	size_t size;
+	/* When true, lines are kept (in place) instead of overwritten (stream) */
+	bool keep;
+	size_t length;
+	size_t line_start;
+	/* Position of delimiter in line; negative until found */
+	int delimiter;
+	uint32_t id;
+	bool comment;
+	size_t lines;
+	int pairs;
+} parser_t;
+
+/**************************************************************************************************/
+/* Local Function Prototypes                                                                      */
+/**************************************************************************************************/
+static void parser_init(parser_t *p, const lcz_kv_syntax_t *syntax, char *buf, size_t size,
+			lcz_kv_parser_callback_t cb, void *context);
+static int parser_feed(parser_t *p, const char *data, size_t size);
+static int parser_finish(parser_t *p);
+static int store(parser_t *p, const char *data, size_t size);
+static int start_value(parser_t *p);
+static int end_line(parser_t *p);
+static int emit(parser_t *p);
+static bool plain_word(const lcz_kv_syntax_t *syntax, const char *str);
+static size_t stream_line_size(const lcz_kv_syntax_t *syntax);
+
+static void index_sift_down(const void *array, lcz_kv_index_less_t less, uint16_t *index,
+			    int root, int count);
+
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+static ssize_t efs_read_chunk(const char *abs_path, uint32_t offset, void *data, size_t size);
+#endif
+
+/**************************************************************************************************/
+/* Global Data Definitions                                                                        */
+/**************************************************************************************************/
+const lcz_kv_io_t lcz_kv_io_clear = {
+	.get_size = fsu_get_file_size_abs,
+	.read_block = fsu_read_abs_block,
+	.msg = "cleartext",
+};
+
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+const lcz_kv_io_t lcz_kv_io_encrypted = {
+	.get_size = efs_get_file_size,
+	.read_block = efs_read_chunk,
+	.msg = "encrypted",
+};
+#endif
+
+/**************************************************************************************************/
+/* Global Function Definitions                                                                    */
+/**************************************************************************************************/
+int lcz_kv_parser_validate(const lcz_kv_syntax_t *syntax, const char *str, size_t size)
+{
+	parser_t p;
+	int r;
+
+	if (syntax == NULL || (str == NULL && size != 0)) {
+		return -EINVAL;
+	}
+
+	parser_init(&p, syntax, NULL, 0, NULL, NULL);
+	r = parser_feed(&p, str, size);
+	if (r == 0) {
+		r = parser_finish(&p);
+	}
+
+	LOG_DBG("Found %d pairs status: %d", p.pairs, r);
+
+	return (r < 0) ? r : p.pairs;
+}
+
+int lcz_kv_parser_read(const lcz_kv_io_t *io, const char *fname, size_t *fsize, char **fstr)
+{
+	ssize_t size;
+	ssize_t r;
+
+	*fsize = 0;
+	*fstr = NULL;
+
+	if (io == NULL || fname == NULL) {
+		return -EINVAL;
+	}
+
+	size = io->get_size(fname);
+	LOG_DBG("'%s' %s file size bytes: %d", fname, io->msg, size);
+	if (size < 0) {
+		return size;
+	} else if (size == 0) {
+		LOG_ERR("%s file %s is empty", io->msg, fname);
+		return -ENOENT;
+	}
+
+	*fstr = k_malloc(size + 1);
+	if (*fstr == NULL) {
+		LOG_ERR("Could not allocate %d bytes for %s", size + 1, fname);
+		return -ENOMEM;
+	}
+
+	r = io->read_block(fname, 0, *fstr, size);
+	if (r != size) {
+		LOG_ERR("Could not read %s file %s: %d", io->msg, fname, r);
+		memset(*fstr, 0, size);
+		k_free(*fstr);
+		*fstr = NULL;
+		return (r < 0) ? r : -EIO;
+	}
+
+	(*fstr)[size] = '\0';
+	*fsize = size;
+	return 0;
+}
+
+int lcz_kv_parser_parse(const lcz_kv_syntax_t *syntax, char *str, size_t *size,
+			lcz_kv_parser_callback_t cb, void *context)
+{
+	parser_t p;
+	int r;
+
+	if (syntax == NULL || str == NULL || size == NULL) {
+		return -EINVAL;
+	}
+
+	/* Output never passes input because characters are only removed */
+	parser_init(&p, syntax, str, *size, cb, context);
+	p.keep = true;
+
+	r = parser_feed(&p, str, *size);
+	if (r == 0) {
+		r = parser_finish(&p);
+	}
+
+	if (r == 0) {
+		/* Clear the remainder of the input string */
+		memset(&str[p.length], 0, *size - p.length + 1);
+		*size = p.length;
+	}
+
+	LOG_DBG("Found %d pairs status: %d", p.pairs, r);
+
+	return (r < 0) ? r : p.pairs;
+}
+
+int lcz_kv_parser_load(const lcz_kv_syntax_t *syntax, const lcz_kv_io_t *io, const char *fname,
+		       size_t *fsize, char **fstr, lcz_kv_parser_callback_t cb, void *context)
+{
+	size_t size;
+	int r;
+
+	r = lcz_kv_parser_read(io, fname, fsize, fstr);
+	if (r < 0) {
+		return r;
+	}
+
+	size = *fsize;
+	r = lcz_kv_parser_parse(syntax, *fstr, fsize, cb, context);
+	if (r < 0) {
+		/* Clear file data (it may have been encrypted) */
+		memset(*fstr, 0, size);
+		k_free(*fstr);
+		*fstr = NULL;
+		*fsize = 0;
+	}
+
+	return r;
+}
+
+int lcz_kv_parser_stream(const lcz_kv_syntax_t *syntax, const lcz_kv_io_t *io, const char *fname,
+			 lcz_kv_parser_callback_t cb, void *context)
+{
+	int r = 0;
+	ssize_t file_size;
+	ssize_t length;
+	uint32_t offset = 0;
+	size_t line_size;
+	parser_t p;
+	char *buf;
+
+	if (syntax == NULL || io == NULL || fname == NULL || cb == NULL) {
+		return -EINVAL;
+	}
+
+	file_size = io->get_size(fname);
+	LOG_DBG("'%s' %s file size bytes: %d", fname, io->msg, file_size);
+	if (file_size < 0) {
+		return file_size;
+	} else if (file_size == 0) {
+		LOG_ERR("%s file %s is empty", io->msg, fname);
+		return -ENOENT;
+	}
+
+	/* Chunk and line are allocated together; only the line spans chunks */
+	line_size = stream_line_size(syntax);
+	buf = k_malloc(CHUNK_SIZE + line_size);
+	if (buf == NULL) {
+		return -ENOMEM;
+	}
+
+	parser_init(&p, syntax, buf + CHUNK_SIZE, line_size, cb, context);
+
+	while (r == 0 && offset < (size_t)file_size) {
+		length = io->read_block(fname, offset, buf, MIN(CHUNK_SIZE, file_size - offset));
+		if (length <= 0) {
+			LOG_ERR("Unable to read %s file %s at %u: %d", io->msg, fname, offset,
+				length);
+			r = (length < 0) ? length : -EIO;
+			break;
+		}
+		offset += length;
+		r = parser_feed(&p, buf, length);
+	}
+
+	if (r == 0) {
+		r = parser_finish(&p);
+	}
+
+	/* Clear file data (it may have been encrypted) */
+	memset(buf, 0, CHUNK_SIZE + line_size);
+	k_free(buf);
+
+	LOG_DBG("Found %d pairs status: %d", p.pairs, r);
+
+	return (r < 0) ? r : p.pairs;
+}
+
+void *lcz_kv_parser_array_add(void **array, size_t *capacity, size_t count, size_t item_size)
+{
+	size_t new_capacity;
+	uint8_t *items;
+
+	if (count >= *capacity) {
+		new_capacity = MAX(*capacity * 2, ARRAY_INITIAL_CAPACITY);
+		items = k_malloc(new_capacity * item_size);
+		if (items == NULL) {
+			return NULL;
+		}
+		if (*array != NULL) {
+			memcpy(items, *array, count * item_size);
+			k_free(*array);
+		}
+		*array = items;
+		*capacity = new_capacity;
+	}
+
+	items = (uint8_t *)*array + (count * item_size);
+	memset(items, 0, item_size);
+	return items;
+}
+
+int lcz_kv_index_build(const void *array, int count, lcz_kv_index_less_t less, uint16_t **index)
+{
+	uint16_t tmp;
+	int i;
+
+	if (array == NULL || less == NULL || index == NULL || count < 0 || count > UINT16_MAX) {
+		return -EINVAL;
+	}
+
+	*index = NULL;
+	if (count == 0) {
+		return 0;
+	}
+
+	*index = k_malloc(count * sizeof(uint16_t));
+	if (*index == NULL) {
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < count; i++) {
+		(*index)[i] = i;
+	}
+
+	/* Heap sort: O(N log N) without recursion or additional memory */
+	for (i = (count / 2) - 1; i >= 0; i--) {
+		index_sift_down(array, less, *index, i, count);
+	}
+
+	for (i = count - 1; i > 0; i--) {
+		tmp = (*index)[0];
+		(*index)[0] = (*index)[i];
+		(*index)[i] = tmp;
+		index_sift_down(array, less, *index, 0, i);
+	}
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* Local Function Definitions                                                                     */
+/**************************************************************************************************/
+static void parser_init(parser_t *p, const lcz_kv_syntax_t *syntax, char *buf, size_t size,
+			lcz_kv_parser_callback_t cb, void *context)
+{
+	memset(p, 0, sizeof(*p));
+	p->syntax = syntax;
+	p->buf = buf;
+	p->size = size;
+	p->cb = cb;
+	p->context = context;
+	p->delimiter = -1;
+}
+
+/**
+ * @brief CRs are skipped. Comment and blank lines are removed. A callback
+ * occurs at the end of each key-value pair line.
+ */
+static int parser_feed(parser_t *p, const char *data, size_t size)
+{
+	const lcz_kv_syntax_t *syntax = p->syntax;
+	const char *eol;
+	int r = 0;
+	uint8_t digit;
+	size_t i;
+	char c;
+
+	for (i = 0; i < size && r == 0; i++) {
+		if (p->comment) {
+			eol = memchr(&data[i], EOL_CHAR, size - i);
+			if (eol == NULL) {
+				break;
+			}
+			i = eol - data;
+		}
+
+		/* Fast path for runs of characters that are only stored */
+		if (IS_ENABLED(CONFIG_LCZ_KV_PARSER_WORD_SCAN) && (size - i) >= SWAR_SIZE &&
+		    (p->delimiter >= 0 || syntax->key_type == LCZ_KV_KEY_STRING) &&
+		    plain_word(syntax, &data[i])) {
+			r = store(p, &data[i], SWAR_SIZE);
+			i += SWAR_SIZE - 1;
+			continue;
+		}
+
+		c = data[i];
+		if (c == CR_CHAR) {
+			continue;
+		} else if (c == EOL_CHAR) {
+			r = end_line(p);
+		} else if (syntax->comment != 0 && c == syntax->comment) {
+			if (p->length != p->line_start) {
+				LOG_ERR("Comment character must start line: %u pos: %u",
+					p->lines + 1, p->length - p->line_start);
+				r = -EINVAL;
+			}
+			p->comment = true;
+		} else if (!isprint((int)c)) {
+			LOG_ERR("Non-printable char 0x%x at line: %u pos: %u", c, p->lines + 1,
+				p->length - p->line_start);
+			r = -EINVAL;
+		} else if (c == syntax->delimiter && p->delimiter < 0) {
+			r = start_value(p);
+			if (r == 0) {
+				r = store(p, &c, 1);
+			}
+		} else if (c == syntax->delimiter && !syntax->delimiter_in_value) {
+			LOG_ERR("Unexpected delimiter line: %u", p->lines + 1);
+			r = -EINVAL;
+		} else if (p->delimiter < 0 && syntax->key_type == LCZ_KV_KEY_HEX_ID) {
+			r = char2hex(c, &digit);
+			if (r < 0) {
+				LOG_ERR("Invalid id character 0x%x line: %u", c, p->lines + 1);
+			} else {
+				p->id = (p->id << 4) | digit;
+				r = store(p, &c, 1);
+			}
+		} else {
+			r = store(p, &c, 1);
+		}
+	}
+
+	return r;
+}
+
+/* Like lcz_kvp_validate_file, the last pair must be terminated */
+static int parser_finish(parser_t *p)
+{
+	if (!p->comment && p->length != p->line_start) {
+		LOG_ERR("Unexpected end of file line: %u", p->lines + 1);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int store(parser_t *p, const char *data, size_t size)
+{
+	if (p->buf != NULL) {
+		if ((p->length + size) > p->size) {
+			LOG_ERR("Line %u is longer than %u", p->lines + 1, p->size);
+			return -E2BIG;
+		}
+		/* In place, the output can overlap the input */
+		memmove(&p->buf[p->length], data, size);
+	}
+
+	p->length += size;
+	return 0;
+}
+
+static int start_value(parser_t *p)
+{
+	size_t key_len = p->length - p->line_start;
+
+	if (key_len == 0 ||
+	    (p->syntax->max_key_len != 0 && key_len > p->syntax->max_key_len)) {
+		LOG_ERR("Invalid key length: %u line: %u", key_len, p->lines + 1);
+		return -EINVAL;
+	}
+
+	p->delimiter = key_len;
+	return 0;
+}
+
+static int end_line(parser_t *p)
+{
+	static const char eol = EOL_CHAR;
+	bool pair = (!p->comment && p->length != p->line_start);
+	int r = 0;
+
+	p->lines += 1;
+	if (pair) {
+		r = emit(p);
+	}
+
+	p->comment = false;
+	p->delimiter = -1;
+	p->id = 0;
+
+	if (pair && p->keep) {
+		if (r == 0) {
+			r = store(p, &eol, 1);
+		}
+		p->line_start = p->length;
+	} else {
+		p->length = p->line_start;
+	}
+
+	return r;
+}
+
+static int emit(parser_t *p)
+{
+	const lcz_kv_syntax_t *syntax = p->syntax;
+	size_t line_len = p->length - p->line_start;
+	const char *line = (p->buf != NULL) ? &p->buf[p->line_start] : NULL;
+	lcz_kv_token_t token;
+	int r;
+
+	if (p->delimiter < 0) {
+		LOG_ERR("Delimiter not found line: %u", p->lines);
+		return -EINVAL;
+	}
+
+	token.key = line;
+	token.key_len = p->delimiter;
+	token.id = p->id;
+	token.value = (line != NULL) ? &line[p->delimiter + 1] : NULL;
+	token.value_len = line_len - p->delimiter - 1;
+
+	if ((token.value_len == 0 && syntax->require_value) ||
+	    (syntax->max_value_len != 0 && token.value_len > syntax->max_value_len)) {
+		LOG_ERR("Invalid value length: %u line: %u", token.value_len, p->lines);
+		return -EINVAL;
+	}
+
+	if (p->cb != NULL) {
+		r = p->cb(&token, p->context);
+		if (r < 0) {
+			return r;
+		}
+	}
+
+	p->pairs += 1;
+	return 0;
+}
+
+/**
+ * @retval true if all characters in the word are printable and none of them
+ * are the delimiter or the comment character.
+ */
+static bool plain_word(const lcz_kv_syntax_t *syntax, const char *str)
+{
+	uint32_t w;
+
+	/* Buffer may not be aligned */
+	memcpy(&w, str, sizeof(w));
+
+	/* Printable is 0x20 to 0x7E (EOL is not printable) */
+	return !(SWAR_HAS_LESS(w, 0x20) | SWAR_HAS_MORE(w, 0x7E) |
+		 SWAR_HAS_BYTE(w, syntax->delimiter) | SWAR_HAS_BYTE(w, syntax->comment));
+}
+
+/* Line doesn't include the EOL */
+static size_t stream_line_size(const lcz_kv_syntax_t *syntax)
+{
+	if (syntax->max_key_len != 0 && syntax->max_value_len != 0) {
+		return syntax->max_key_len + 1 + syntax->max_value_len;
+	} else {
+		return MAX_LINE_SIZE;
+	}
+}
+
+static void index_sift_down(const void *array, lcz_kv_index_less_t less, uint16_t *index,
+			    int root, int count)
+{
+	int child;
+	uint16_t tmp;
+
+	while ((child = (2 * root) + 1) < count) {
+		if ((child + 1) < count && less(array, index[child], index[child + 1])) {
+			child += 1;
+		}
+		if (!less(array, index[root], index[child])) {
+			break;
+		}
+		tmp = index[root];
+		index[root] = index[child];
+		index[child] = tmp;
+		root = child;
+	}
+}
+
+#if defined(CONFIG_FSU_ENCRYPTED_FILES)
+static ssize_t efs_read_chunk(const char *abs_path, uint32_t offset, void *data, size_t size)
+{
+	return efs_read_block(abs_path, offset, data, size);
+}
+#endif